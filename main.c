@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pyco_compiler.h"
 
 int main()
@@ -79,11 +80,24 @@ int main()
 
     pyco_compile_options compile_options = pyco_initialize_compile_options();
 
-    compile_options.allocators.malloc = malloc;
-    compile_options.allocators.realloc = realloc;
-    compile_options.allocators.free = free;
+    compile_options.allocators = pyco_default_allocators();
+    compile_options.collect_stats = 1;
+    compile_options.ast_json_path = "tree_output.js";
 
-    pyco_compile(input9, strlen(input9), compile_options);
+    pyco_compiled_program program = pyco_compile(input9, strlen(input9), compile_options);
+
+    printf("testing lexer - token count: %llu\n", program.stats.tokens_count);
+    printf("lex %llu ns, parse %llu ns, codegen %llu ns, %llu bytes of bytecode, %llu nodes, %llu bytes allocated, %llu reallocs, arena peak %llu bytes\n\n",
+           program.stats.phase_nanoseconds[PYCO_COMPILE_PHASE_LEX],
+           program.stats.phase_nanoseconds[PYCO_COMPILE_PHASE_PARSE],
+           program.stats.phase_nanoseconds[PYCO_COMPILE_PHASE_CODEGEN],
+           program.size,
+           program.stats.nodes_count,
+           program.stats.bytes_allocated,
+           program.stats.realloc_calls,
+           program.stats.arena_peak);
+
+    pyco_free_compiled_program(&program);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef PYCO_BYTECODE_H
+#define PYCO_BYTECODE_H
+
+#include "pyco_compiler.h"
+
+// the program pyco_compile puts into pyco_compiled_program.data, written by the compiler and run by the VM.
+// the sections are addressed by byte offsets from the start of the program and nothing in it is a pointer or a
+// symbol id, the names are bytes in the name pool, so a program can be copied, cached or loaded by another process
+#define PYCO_BYTECODE_MAGIC 0x43425950u // "PYBC"
+#define PYCO_BYTECODE_VERSION 1
+
+// instructions are 32 bit words with the opcode in the low byte and register A above it. the upper half holds
+// either registers B and C, or one 16 bit operand Bx that jumps and small integers read as sBx, biased by
+// PYCO_INSTRUCTION_SBX_BIAS. jumps are relative to the instruction after the jump
+#define PYCO_INSTRUCTION_SBX_BIAS 0x7FFF
+#define PYCO_INSTRUCTION_SBX_MIN (-PYCO_INSTRUCTION_SBX_BIAS)
+#define PYCO_INSTRUCTION_SBX_MAX (0xFFFF - PYCO_INSTRUCTION_SBX_BIAS)
+
+#define PYCO_INSTRUCTION_OP(instruction) ((instruction) & 0xFF)
+#define PYCO_INSTRUCTION_A(instruction) (((instruction) >> 8) & 0xFF)
+#define PYCO_INSTRUCTION_B(instruction) (((instruction) >> 16) & 0xFF)
+#define PYCO_INSTRUCTION_C(instruction) ((instruction) >> 24)
+#define PYCO_INSTRUCTION_SC(instruction) ((int)(signed char)((instruction) >> 24))
+#define PYCO_INSTRUCTION_BX(instruction) ((instruction) >> 16)
+#define PYCO_INSTRUCTION_SBX(instruction) ((int)((instruction) >> 16) - PYCO_INSTRUCTION_SBX_BIAS)
+
+#define PYCO_INSTRUCTION_ABC(op, a, b, c) ((pyco_uint32)(op) | ((pyco_uint32)(a) << 8) | ((pyco_uint32)(b) << 16) | ((pyco_uint32)(pyco_uint8)(c) << 24))
+#define PYCO_INSTRUCTION_ABX(op, a, bx) ((pyco_uint32)(op) | ((pyco_uint32)(a) << 8) | ((pyco_uint32)(bx) << 16))
+#define PYCO_INSTRUCTION_ASBX(op, a, sbx) PYCO_INSTRUCTION_ABX(op, a, (pyco_uint32)((sbx) + PYCO_INSTRUCTION_SBX_BIAS))
+
+// R are the registers of the running function, K the constant pool and G the globals.
+// nil and the integer 0 are false, comparisons give the integer 1 or 0
+enum PYCO_OPCODE
+{
+    PYCO_OP_NOP = 0,
+    PYCO_OP_MOVE,          // R[A] = R[B]
+    PYCO_OP_LOAD_NIL,      // R[A] = nil
+    PYCO_OP_LOAD_INT,      // R[A] = sBx
+    PYCO_OP_LOAD_CONST,    // R[A] = K[Bx]
+    PYCO_OP_LOAD_FUNCTION, // R[A] = function Bx
+    PYCO_OP_LOAD_STRUCT,   // R[A] = struct Bx
+    PYCO_OP_GET_GLOBAL,    // R[A] = G[Bx]
+    PYCO_OP_SET_GLOBAL,    // G[Bx] = R[A]
+    PYCO_OP_ADD,           // R[A] = R[B] + R[C]
+    PYCO_OP_SUBTRACT,      // R[A] = R[B] - R[C]
+    PYCO_OP_MULTIPLY,      // R[A] = R[B] * R[C]
+    PYCO_OP_DIVIDE,        // R[A] = R[B] / R[C]
+    PYCO_OP_ADD_INT,       // R[A] = R[B] + sC
+    PYCO_OP_EQUAL,         // R[A] = R[B] == R[C]
+    PYCO_OP_LESS,          // R[A] = R[B] < R[C]
+    PYCO_OP_LESS_EQUAL,    // R[A] = R[B] <= R[C]
+    PYCO_OP_NOT,           // R[A] = !R[B]
+    PYCO_OP_BITWISE_NOT,   // R[A] = ~R[B]
+    PYCO_OP_JUMP,          // jump by sBx
+    PYCO_OP_JUMP_IF,       // jump by sBx when R[A] is true
+    PYCO_OP_JUMP_IF_NOT,   // jump by sBx when R[A] is false
+    PYCO_OP_NEW_ARRAY,     // R[A] = array of R[B] by R[B + 1] ... for C dimensions, the elements start as 0
+    PYCO_OP_GET_INDEX,     // R[A] = R[B][R[C]], a string indexes the fields of a struct value
+    PYCO_OP_SET_INDEX,     // R[A][R[B]] = R[C]
+    PYCO_OP_CALL,          // R[A] = R[A](R[A + 1] ... R[A + B]), calling a struct makes a value of it
+    PYCO_OP_RETURN,        // returns R[A], or nil when B is 0
+    PYCO_OP_COUNT,
+};
+
+enum PYCO_CONSTANT_TYPE
+{
+    PYCO_CONSTANT_INTEGER,
+    PYCO_CONSTANT_REAL,
+    PYCO_CONSTANT_STRING, // the bytes are in the name pool, escapes are kept as written
+};
+
+typedef struct pyco_bytecode_constant
+{
+    pyco_uint32 type;
+    pyco_uint32 length; // bytes of a string
+    union
+    {
+        pyco_uint64 integer;
+        double real;
+        pyco_uint64 string; // offset in the name pool
+    } value;
+} pyco_bytecode_constant;
+
+// function 0 is the script itself, it runs the top-level statements
+typedef struct pyco_bytecode_function
+{
+    pyco_uint32 name; // offset in the name pool, the script has no name
+    pyco_uint32 name_length;
+    pyco_uint32 code; // first instruction in the code section
+    pyco_uint32 code_count;
+    pyco_uint16 arity; // the arguments are passed in the first registers
+    pyco_uint16 registers;
+} pyco_bytecode_function;
+
+enum PYCO_GLOBAL_KIND
+{
+    PYCO_GLOBAL_VARIABLE, // declared by the script, nil until the script sets it
+    PYCO_GLOBAL_FUNCTION, // holds function `index` before the script runs
+    PYCO_GLOBAL_STRUCT,   // holds struct `index` before the script runs
+    PYCO_GLOBAL_EXTERN,   // used without being declared, the host provides it by name
+};
+
+// the top-level declarations and the names the script expects from the host
+typedef struct pyco_bytecode_global
+{
+    pyco_uint32 name;
+    pyco_uint32 name_length;
+    pyco_uint32 kind;
+    pyco_uint32 index;
+} pyco_bytecode_global;
+
+typedef struct pyco_bytecode_struct
+{
+    pyco_uint32 name;
+    pyco_uint32 name_length;
+    pyco_uint32 fields; // first field in the field section
+    pyco_uint32 fields_count;
+} pyco_bytecode_struct;
+
+typedef struct pyco_bytecode_field
+{
+    pyco_uint32 name;
+    pyco_uint32 name_length;
+    pyco_uint32 type_name; // the type as written, a builtin one like int32 or the name of a struct
+    pyco_uint32 type_name_length;
+} pyco_bytecode_field;
+
+typedef struct pyco_bytecode_header
+{
+    pyco_uint32 magic;
+    pyco_uint32 version;
+    pyco_uint32 size; // bytes of the whole program, the header included
+    pyco_uint32 constants_count;
+    pyco_uint32 constants;
+    pyco_uint32 functions_count;
+    pyco_uint32 functions;
+    pyco_uint32 globals_count;
+    pyco_uint32 globals;
+    pyco_uint32 structs_count;
+    pyco_uint32 structs;
+    pyco_uint32 fields_count;
+    pyco_uint32 fields;
+    pyco_uint32 code_count;
+    pyco_uint32 code;
+    pyco_uint32 names_size;
+    pyco_uint32 names;
+} pyco_bytecode_header;
+
+#endif
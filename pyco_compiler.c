@@ -1,37 +1,181 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // clock_gettime, pthreads
+#endif
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // strtod_l
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <float.h>
+#include <locale.h>
+#include <time.h>
 #include "pyco_compiler.h"
+#include "pyco_bytecode.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#include <xlocale.h>
+#endif
+
+#if defined(_WIN32)
+typedef _locale_t pyco_locale;
+#else
+typedef locale_t pyco_locale;
+#endif
+
+#if !defined(PYCO_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define PYCO_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PYCO_TARGET_SSE2
+#define PYCO_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define PYCO_TARGET_SSE2 __attribute__((target("sse2")))
+#define PYCO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 // MARK: MISC
 
+// a token kind fits in one byte, the low bits hold the type and the high bits the flags
+enum PYCO_TOKEN_TYPE
+{
+    PYCO_TOKEN_TYPE_NONE = 0,
+    PYCO_TOKEN_TYPE_IDENTIFIER,
+    PYCO_TOKEN_TYPE_INTEGER,
+    PYCO_TOKEN_TYPE_FLOAT,
+    PYCO_TOKEN_TYPE_DOUBLE,
+    PYCO_TOKEN_TYPE_INDENT_SPACE,
+    PYCO_TOKEN_TYPE_INDENT_TAB,
+    PYCO_TOKEN_TYPE_STRING,
+    PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL,
+    PYCO_TOKEN_TYPE_SPECIAL,
+    PYCO_TOKEN_TYPE_KEYWORD,
+
+    PYCO_TOKEN_TYPE_MASK = 0x0F,
+};
+
 enum PYCO_TOKEN_FLAG
 {
-    PYCO_TOKEN_FLAG_SUCCESSIVE = (1 << 3),
+    PYCO_TOKEN_FLAG_SUCCESSIVE = (1 << 4),
+    PYCO_TOKEN_FLAG_LINE_START = (1 << 5),
+    PYCO_TOKEN_FLAG_ERROR_INCOMPLETE = (1 << 6),
+    PYCO_TOKEN_FLAG_ERROR_MALFORMED = (1 << 7),
 };
 
-enum PYCO_TOKEN_TYPE
+// number tokens carry these next to their decoded value
+enum PYCO_LITERAL_FLAG
 {
-    PYCO_TOKEN_TYPE_IDENTIFIER = (1 << 5),
+    PYCO_LITERAL_FLAG_HEX = (1 << 0),
+    // the literal does not fit its type, integers are clamped to the largest value and reals are infinite
+    PYCO_LITERAL_FLAG_OVERFLOW = (1 << 1),
+    // only on literal nodes, the token was flagged PYCO_TOKEN_FLAG_ERROR_MALFORMED and has no value
+    PYCO_LITERAL_FLAG_MALFORMED = (1 << 2),
+};
 
-    PYCO_TOKEN_TYPE_NUMBER = (1 << 8),
-    PYCO_TOKEN_TYPE_INTEGER = (1 << 9),
-    PYCO_TOKEN_TYPE_FLOAT = (1 << 10),
-    PYCO_TOKEN_TYPE_DOUBLE = (1 << 11),
+typedef union pyco_literal_value
+{
+    pyco_uint64 integer;
+    double real; // float literals hold the nearest float, widened
+} pyco_literal_value;
 
-    PYCO_TOKEN_TYPE_INDENT = (1 << 17),
-    PYCO_TOKEN_TYPE_INDENT_SPACE = (1 << 18),
-    PYCO_TOKEN_TYPE_INDENT_TAB = (1 << 19),
+typedef struct pyco_literal
+{
+    pyco_literal_value value;
+    pyco_uint32 flags; // PYCO_LITERAL_FLAG
+} pyco_literal;
 
-    PYCO_TOKEN_TYPE_STRING = (1 << 20),
-    PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL = (1 << 21),
+// keyword tokens carry one of these in their payload
+enum PYCO_KEYWORD
+{
+    PYCO_KEYWORD_NONE = 0,
+    PYCO_KEYWORD_IF,
+    PYCO_KEYWORD_ELSE,
+    PYCO_KEYWORD_FOR,
+    PYCO_KEYWORD_DO,
+    PYCO_KEYWORD_WHILE,
+    PYCO_KEYWORD_CONTINUE,
+    PYCO_KEYWORD_BREAK,
+    PYCO_KEYWORD_FUNCTION,
+    PYCO_KEYWORD_STRUCT,
+    PYCO_KEYWORD_RETURN,
+};
 
-    PYCO_TOKEN_TYPE_SPECIAL = (1 << 22),
+enum PYCO_OPERATOR
+{
+    PYCO_OPERATOR_NONE = PYCO_NULL,
+    PYCO_OPERATOR_COMPOSITE = (1 << 0),
+    PYCO_OPERATOR_ADD = (1 << 1),
+    PYCO_OPERATOR_SUBTRACT = (1 << 2),
+    PYCO_OPERATOR_MULTIPLY = (1 << 3),
+    PYCO_OPERATOR_DIVIDE = (1 << 4),
+    PYCO_OPERATOR_INCREMENT = (1 << 5),
+    PYCO_OPERATOR_DECREMENT = (1 << 6),
+    PYCO_OPERATOR_ASSIGN = (1 << 7),
+    PYCO_OPERATOR_ASSIGN_TYPE = (1 << 8),
+    PYCO_OPERATOR_ASSIGN_CONST = (1 << 9),
+    PYCO_OPERATOR_EQUAL = (1 << 10),
+    PYCO_OPERATOR_GREATER = (1 << 11),
+    PYCO_OPERATOR_LESS = (1 << 12),
+    PYCO_OPERATOR_AND = (1 << 13),
+    PYCO_OPERATOR_OR = (1 << 14),
+    PYCO_OPERATOR_NOT = (1 << 15),
+    PYCO_OPERATOR_XOR = (1 << 16),
+    PYCO_OPERATOR_BITWISE = (1 << 17),
+    PYCO_OPERATOR_LEFT_SHIFT = (1 << 18),
+    PYCO_OPERATOR_RIGHT_SHIFT = (1 << 19),
+    PYCO_OPERATOR_TERNARY = (1 << 20),
+    PYCO_OPERATOR_GROUPING = (1 << 21),
+    PYCO_OPERATOR_FUNCTION_CALL = (1 << 22),
+    PYCO_OPERATOR_ARRAY_INDEX = (1 << 25),
+    PYCO_OPERATOR_MEMBER_ACCESS = (1 << 26),
+    PYCO_OPERATOR_INVALID = (1 << 30),
+};
 
-    PYCO_TOKEN_TYPE_ERROR = (1 << 25),
-    PYCO_TOKEN_TYPE_ERROR_INCOMPLETE = (1 << 26),
-    PYCO_TOKEN_TYPE_ERROR_MALFORMED = (1 << 26),
+// special tokens carry one of these in their payload, it indexes PYCO_OPERATORS
+enum PYCO_OPERATOR_ID
+{
+    PYCO_OPERATOR_ID_NONE = 0,
+    PYCO_OPERATOR_ID_INVALID,
+    PYCO_OPERATOR_ID_COLON,
+    PYCO_OPERATOR_ID_DECLARE,
+    PYCO_OPERATOR_ID_DECLARE_CONST,
+    PYCO_OPERATOR_ID_PLUS,
+    PYCO_OPERATOR_ID_PLUS_ASSIGN,
+    PYCO_OPERATOR_ID_INCREMENT,
+    PYCO_OPERATOR_ID_MINUS,
+    PYCO_OPERATOR_ID_MINUS_ASSIGN,
+    PYCO_OPERATOR_ID_DECREMENT,
+    PYCO_OPERATOR_ID_STAR,
+    PYCO_OPERATOR_ID_STAR_ASSIGN,
+    PYCO_OPERATOR_ID_SLASH,
+    PYCO_OPERATOR_ID_SLASH_ASSIGN,
+    PYCO_OPERATOR_ID_ASSIGN,
+    PYCO_OPERATOR_ID_EQUAL,
+    PYCO_OPERATOR_ID_LESS,
+    PYCO_OPERATOR_ID_LESS_EQUAL,
+    PYCO_OPERATOR_ID_LEFT_SHIFT,
+    PYCO_OPERATOR_ID_GREATER,
+    PYCO_OPERATOR_ID_GREATER_EQUAL,
+    PYCO_OPERATOR_ID_RIGHT_SHIFT,
+    PYCO_OPERATOR_ID_NOT,
+    PYCO_OPERATOR_ID_BITWISE_NOT,
+    PYCO_OPERATOR_ID_TERNARY,
+    PYCO_OPERATOR_ID_GROUPING,
+    PYCO_OPERATOR_ID_ARRAY_INDEX,
+    PYCO_OPERATOR_ID_MEMBER_ACCESS,
+    PYCO_OPERATOR_ID_COUNT,
 };
 
 enum PYCO_AST_NODE_TYPE
@@ -55,6 +199,7 @@ enum PYCO_AST_NODE_TYPE
     PYCO_AST_NODE_TYPE_CONTINUE,
     PYCO_AST_NODE_TYPE_BREAK,
     PYCO_AST_NODE_TYPE_SCOPE,
+    PYCO_AST_NODE_TYPE_RETURN,
 };
 
 const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_NONE = "NONE";
@@ -76,6 +221,94 @@ const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_DO_WHILE = "DO_WHILE";
 const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_CONTINUE = "CONTINUE";
 const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_BREAK = "BREAK";
 const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_SCOPE = "SCOPE";
+const pyco_uint8 *PYCO_AST_NODE_TYPE_NAME_RETURN = "RETURN";
+
+// what a node is named by, either the token it was made from or one of the parts the parser splits statements into
+enum PYCO_AST_LABEL
+{
+    PYCO_AST_LABEL_NONE = 0,
+    PYCO_AST_LABEL_TOKEN,
+    PYCO_AST_LABEL_IF_TRUE,
+    PYCO_AST_LABEL_CONDITION,
+    PYCO_AST_LABEL_ELSE,
+    PYCO_AST_LABEL_ARGUMENTS,
+    PYCO_AST_LABEL_ARGUMENT_PART_EMPTY,
+    PYCO_AST_LABEL_ARGUMENT_EXPRESSION,
+    PYCO_AST_LABEL_INDEX_OPERATOR,
+    PYCO_AST_LABEL_ARRAY_TYPE, // `[size]element`, the size and the element type are its children
+    PYCO_AST_LABEL_COUNT,
+};
+
+static const char *PYCO_AST_LABEL_NAMES[PYCO_AST_LABEL_COUNT] = {
+    [PYCO_AST_LABEL_IF_TRUE] = "IF_TRUE",
+    [PYCO_AST_LABEL_CONDITION] = "CONDITION",
+    [PYCO_AST_LABEL_ELSE] = "ELSE",
+    [PYCO_AST_LABEL_ARGUMENTS] = "ARGUMENTS",
+    [PYCO_AST_LABEL_ARGUMENT_PART_EMPTY] = "ARGUMENT_PART_EMPTY",
+    [PYCO_AST_LABEL_ARGUMENT_EXPRESSION] = "ARGUMENT_EXPRESSION",
+    [PYCO_AST_LABEL_INDEX_OPERATOR] = "INDEX_OPERATOR",
+    [PYCO_AST_LABEL_ARRAY_TYPE] = "ARRAY_TYPE",
+};
+
+// flags of PYCO_AST_NODE_TYPE_LITERAL nodes, the kind of token the literal was made from
+enum PYCO_AST_LITERAL_FLAG
+{
+    PYCO_AST_LITERAL_FLAG_STRING = (1 << 0),
+    PYCO_AST_LITERAL_FLAG_REAL = (1 << 1), // float and double numbers, the value is in real
+};
+
+static inline void *_pyco_malloc(const pyco_allocators *allocators, pyco_uint64 size)
+{
+    return allocators->malloc(allocators->context, size);
+}
+
+static inline void *_pyco_realloc(const pyco_allocators *allocators, void *pointer, pyco_uint64 old_size, pyco_uint64 size)
+{
+    return allocators->realloc(allocators->context, pointer, old_size, size);
+}
+
+static inline void _pyco_free(const pyco_allocators *allocators, void *pointer)
+{
+    allocators->free(allocators->context, pointer);
+}
+
+static void *_pyco_default_malloc(void *context, size_t size)
+{
+    return malloc(size);
+}
+
+static void *_pyco_default_realloc(void *context, void *pointer, size_t old_size, size_t size)
+{
+    return realloc(pointer, size);
+}
+
+static void _pyco_default_free(void *context, void *pointer)
+{
+    free(pointer);
+}
+
+pyco_allocators pyco_default_allocators()
+{
+    return (pyco_allocators){
+        .malloc = _pyco_default_malloc,
+        .realloc = _pyco_default_realloc,
+        .free = _pyco_default_free,
+        .context = PYCO_NULL,
+    };
+}
+
+// bytes asked from the allocators and realloc calls of one component, summed up into pyco_compile_stats
+typedef struct pyco_allocation_counters
+{
+    pyco_uint64 bytes;
+    pyco_uint64 reallocs;
+} pyco_allocation_counters;
+
+static inline void _count_allocation(pyco_allocation_counters *counters, pyco_uint64 size, bool realloc)
+{
+    counters->bytes += size;
+    counters->reallocs += realloc;
+}
 
 // MARK: BUFFER READER
 typedef struct pyco_buffer
@@ -100,17 +333,17 @@ pyco_buffer_reader create_buffer_reader(const pyco_buffer *buffer)
     };
 }
 
-inline bool is_buffer_reader_valid(pyco_buffer_reader *reader)
+static inline bool is_buffer_reader_valid(pyco_buffer_reader *reader)
 {
     return reader->buffer && reader->data_pointer && reader->buffer->size;
 }
 
-inline char buffer_reader_current_char(pyco_buffer_reader *reader)
+static inline char buffer_reader_current_char(pyco_buffer_reader *reader)
 {
     return reader->data_pointer[reader->offset];
 }
 
-inline char buffer_reader_peek_next_char(pyco_buffer_reader *reader)
+static inline char buffer_reader_peek_next_char(pyco_buffer_reader *reader)
 {
     if (reader->offset >= reader->buffer->size)
     {
@@ -120,7 +353,7 @@ inline char buffer_reader_peek_next_char(pyco_buffer_reader *reader)
     return reader->data_pointer[reader->offset + 1];
 }
 
-inline char buffer_reader_next_char(pyco_buffer_reader *reader)
+static inline char buffer_reader_next_char(pyco_buffer_reader *reader)
 {
     if (reader->offset >= reader->buffer->size)
     {
@@ -130,7 +363,7 @@ inline char buffer_reader_next_char(pyco_buffer_reader *reader)
     return reader->data_pointer[reader->offset++];
 }
 
-inline bool buffer_reader_next_char_valid(pyco_buffer_reader *reader)
+static inline bool buffer_reader_next_char_valid(pyco_buffer_reader *reader)
 {
     return (reader->offset + 1) < reader->buffer->size;
 }
@@ -150,1684 +383,7893 @@ const pyco_uint8 *buffer_reader_get_data_pointer(pyco_buffer_reader *reader, pyc
     return reader->data_pointer + offset;
 }
 
-// MARK: TOKENIZER
+// MARK: ARENA
 
-typedef struct token_location
-{
-    pyco_uint64 line;
-    pyco_uint64 column;
-    pyco_uint64 offset;
-} token_location;
+#define PYCO_ARENA_ALIGNMENT 16
 
-typedef struct pyco_token
+// blocks are chained and never move, so anything allocated from the arena keeps its address until the
+// arena is reset or freed. every new block is at least twice the size of the previous one
+typedef struct pyco_arena_block
 {
-    pyco_flags flags;
-    pyco_uint64 length;
-    char *value;
-
-    token_location start;
-    token_location end;
-
-    struct pyco_token *next;
-} pyco_token;
+    struct pyco_arena_block *next;
+    pyco_uint64 size;
+    pyco_uint64 used;
+} pyco_arena_block;
 
-typedef struct pyco_lexer_options
+typedef struct pyco_arena
 {
-    pyco_uint64 token_block_initial_size;
-    pyco_uint64 token_block_increment_size;
-    pyco_uint64 token_buffer_block_initial_size;
-    pyco_uint64 token_buffer_block_increment_size;
     pyco_allocators allocators;
-} pyco_lexer_options;
+    pyco_arena_block *first;
+    pyco_arena_block *current;
+    pyco_uint64 initial_size;
+    pyco_allocation_counters counters;
+} pyco_arena;
 
-typedef struct pyco_lexer
+static inline pyco_uint64 _arena_align(pyco_uint64 size)
 {
-    pyco_lexer_options options;
-    pyco_uint64 token_buffer_allocated;
-    pyco_uint64 token_buffer_offset;
-    pyco_uint8 *token_buffer_data;
-    pyco_token *tokens;
-    pyco_token *current_token;
-    pyco_uint64 tokens_allocated;
-    pyco_uint64 tokens_count;
-    pyco_uint64 current_line;
-    pyco_uint64 last_newline;
-    pyco_uint8 track_indents;
-} pyco_lexer;
+    return (size + PYCO_ARENA_ALIGNMENT - 1) & ~(pyco_uint64)(PYCO_ARENA_ALIGNMENT - 1);
+}
+
+// the block header is padded so the first allocation in a block is aligned too
+static inline pyco_uint8 *_arena_block_data(pyco_arena_block *block)
+{
+    return (pyco_uint8 *)block + _arena_align(sizeof(pyco_arena_block));
+}
 
-void _lexer_add_token(pyco_lexer *lexer, const pyco_uint8 *source_token, token_location start, token_location end, pyco_uint64 length, pyco_flags type)
+pyco_arena_block *_arena_add_block(pyco_arena *arena, pyco_uint64 minimum_size)
 {
-    const pyco_uint64 null_terminator_length = 1;
+    pyco_uint64 size = arena->current ? arena->current->size * 2 : arena->initial_size;
 
-    if (lexer->token_buffer_offset + length + null_terminator_length > lexer->token_buffer_allocated)
+    while (size < minimum_size)
     {
-        lexer->token_buffer_allocated = lexer->token_buffer_allocated + lexer->options.token_buffer_block_increment_size;
-        lexer->token_buffer_data = lexer->options.allocators.realloc(lexer->token_buffer_data, lexer->token_buffer_allocated);
+        size *= 2;
     }
 
-    pyco_uint8 *token_value = &lexer->token_buffer_data[lexer->token_buffer_offset];
-    for (pyco_uint64 byte_index = length; byte_index--;)
+    pyco_arena_block *block = _pyco_malloc(&arena->allocators, _arena_align(sizeof(pyco_arena_block)) + size);
+
+    if (!block)
     {
-        token_value[byte_index] = source_token[byte_index];
+        return PYCO_NULL;
     }
-    token_value[length] = '\0';
-    lexer->token_buffer_offset += length + null_terminator_length;
 
-    if (lexer->tokens_count + length > lexer->tokens_allocated)
+    _count_allocation(&arena->counters, _arena_align(sizeof(pyco_arena_block)) + size, false);
+
+    block->size = size;
+    block->used = 0;
+
+    // a block added after a reset goes after the ones being reused
+    if (arena->current)
+    {
+        block->next = arena->current->next;
+        arena->current->next = block;
+    }
+    else
     {
-        lexer->tokens_count = lexer->tokens_allocated + lexer->options.token_block_increment_size;
-        lexer->tokens = lexer->options.allocators.realloc(lexer->tokens, lexer->tokens_count);
+        block->next = PYCO_NULL;
+        arena->first = block;
     }
 
-    pyco_token *token = &lexer->tokens[lexer->tokens_count];
-    token->flags = type;
-    token->length = length;
-    token->value = token_value;
-    token->start = start;
-    token->end = end;
-    token->next = PYCO_NULL;
-    // token->column = start.offset - lexer->last_newline + 1;
+    arena->current = block;
+
+    return block;
+}
 
-    if (lexer->tokens_count)
+// initial_size is a hint for how many bytes will be allocated before the next reset
+pyco_arena *pyco_arena_create(pyco_allocators allocators, pyco_uint64 initial_size)
+{
+    if (!allocators.malloc || !allocators.free)
     {
-        pyco_token *previous_token = &lexer->tokens[lexer->tokens_count - 1];
+        return PYCO_NULL;
+    }
 
-        previous_token->next = token;
+    pyco_arena *arena = _pyco_malloc(&allocators, sizeof(pyco_arena));
 
-        if ((~previous_token->flags & PYCO_TOKEN_TYPE_INDENT) && (token->start.offset == previous_token->end.offset + 1))
-        {
-            token->flags |= PYCO_TOKEN_FLAG_SUCCESSIVE;
-        }
+    if (!arena)
+    {
+        return PYCO_NULL;
     }
 
-    lexer->tokens_count++;
-}
-
-inline bool is_number(char ch, bool include_dot /*= false*/, const bool include_hex /*= false*/)
-{
-    return (ch >= '0' && ch <= '9') || (include_dot && ch == '.') || (include_hex && ch == 'x');
-}
+    arena->allocators = allocators;
+    arena->first = PYCO_NULL;
+    arena->current = PYCO_NULL;
+    arena->initial_size = initial_size > 4096 ? _arena_align(initial_size) : 4096;
+    arena->counters = (pyco_allocation_counters){0};
+    _count_allocation(&arena->counters, sizeof(pyco_arena), false);
 
-inline bool is_special(char ch, char exclude /*= '\0'*/)
-{
-    return (exclude == ch) || (ch == '_') ? false : (ch >= '!' && ch <= '/') || (ch >= ':' && ch <= '@') || (ch >= '[' && ch <= '`') || (ch >= '{' && ch <= '~');
+    return arena;
 }
 
-inline bool is_newline(char ch)
+void *pyco_arena_alloc(pyco_arena *arena, pyco_uint64 size)
 {
-    return ch == '\n' || ch == '\r';
-}
+    size = _arena_align(size);
 
-inline bool is_whitespace(char ch)
-{
-    return ch == ' ' || ch == '\t';
-}
+    pyco_arena_block *block = arena->current;
 
-void _lexer_handle_newlines(pyco_lexer *lexer, pyco_buffer_reader *reader)
-{
-    if (buffer_reader_current_char(reader) == '\r')
+    if (!block || block->used + size > block->size)
     {
-        if (buffer_reader_peek_next_char(reader) == '\n')
+        // blocks kept by a reset are reused in order, skipping the ones too small for this allocation.
+        // a skipped block holds nothing from now on, so it adds nothing to what _arena_used counts
+        for (block = block ? block->next : PYCO_NULL; block && block->size < size;)
+        {
+            block->used = 0;
+            block = block->next;
+        }
+
+        if (block)
+        {
+            block->used = 0;
+            arena->current = block;
+        }
+        else if (!(block = _arena_add_block(arena, size)))
         {
-            buffer_reader_next_char(reader);
+            return PYCO_NULL;
         }
     }
 
-    lexer->last_newline = buffer_reader_get_position(reader) + 1;
-    lexer->current_line++;
-    lexer->track_indents = 1;
+    void *data = _arena_block_data(block) + block->used;
+    block->used += size;
+
+    return data;
 }
 
-void _lexer_handle_indents(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// bytes handed out since the last reset, the blocks after the current one are not in use yet
+pyco_uint64 _arena_used(pyco_arena *arena)
 {
-    const char current_char = buffer_reader_current_char(reader);
-
-    token_location token_start = {
-        .offset = buffer_reader_get_position(reader),
-        .line = lexer->current_line,
-        .column = 1,
-    };
-
-    const pyco_uint8 *token_pointer = buffer_reader_get_data_pointer(reader, token_start.offset);
-
-    pyco_flags token_type = PYCO_TOKEN_TYPE_INDENT | PYCO_TOKEN_TYPE_INDENT_SPACE;
-    pyco_uint32 token_length = 1;
-
-    if (current_char == '\t')
-    {
-        token_type = PYCO_TOKEN_TYPE_INDENT | PYCO_TOKEN_TYPE_INDENT_TAB;
-    }
+    pyco_uint64 used = 0;
 
-    while (buffer_reader_peek_next_char(reader) == current_char)
+    for (pyco_arena_block *block = arena->first; block; block = block->next)
     {
-        token_length++;
-        buffer_reader_next_char(reader);
-    }
+        used += block->used;
 
-    if (is_newline(buffer_reader_current_char(reader)))
-    {
-        return;
+        if (block == arena->current)
+        {
+            break;
+        }
     }
 
-    token_location token_end = {
-        .line = lexer->current_line,
-        .column = buffer_reader_get_position(reader) - lexer->last_newline + 1,
-        .offset = buffer_reader_get_position(reader),
-    };
-
-    _lexer_add_token(lexer, token_pointer, token_start, token_end, token_length, token_type);
+    return used;
 }
 
-void _lexer_handle_whitespaces(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// forgets every allocation but keeps the blocks, so the next fill does not go back to the system allocator
+void pyco_arena_reset(pyco_arena *arena)
 {
-    if (lexer->track_indents)
+    if (arena && arena->first)
     {
-        _lexer_handle_indents(lexer, reader);
+        arena->current = arena->first;
+        arena->first->used = 0;
     }
 }
 
-inline token_location _initialize_token_location(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// where the next allocation goes, a rewind to it forgets everything allocated after it
+typedef struct pyco_arena_mark
 {
-    return (token_location){
-        .line = lexer->current_line,
-        .column = buffer_reader_get_position(reader) - lexer->last_newline + 1,
-        .offset = buffer_reader_get_position(reader),
+    pyco_arena_block *block;
+    pyco_uint64 used;
+} pyco_arena_mark;
+
+static inline pyco_arena_mark _arena_mark(pyco_arena *arena)
+{
+    return (pyco_arena_mark){
+        .block = arena->current,
+        .used = arena->current ? arena->current->used : 0,
     };
 }
 
-void _lexer_handle_numbers(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// the blocks after the mark are kept and reused in order, like after a reset
+static inline void _arena_rewind(pyco_arena *arena, pyco_arena_mark mark)
 {
-    token_location token_start = _initialize_token_location(lexer, reader);
-
-    const pyco_uint8 *token_pointer = buffer_reader_get_data_pointer(reader, token_start.offset);
+    if (!mark.block)
+    {
+        pyco_arena_reset(arena);
+        return;
+    }
 
-    pyco_flags token_type = PYCO_TOKEN_TYPE_NUMBER | PYCO_TOKEN_TYPE_INTEGER;
-    pyco_uint32 token_length = 1;
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+}
 
-    while (buffer_reader_next_char_valid(reader))
+void pyco_arena_free(pyco_arena *arena)
+{
+    if (!arena)
     {
-        char next_char = buffer_reader_peek_next_char(reader);
-
-        if (!is_number(next_char, false, false) && next_char != '.')
-        {
-            token_type |= PYCO_TOKEN_TYPE_ERROR_MALFORMED;
-        }
+        return;
+    }
 
-        if (is_whitespace(next_char) ||
-            is_newline(next_char) ||
-            is_special(next_char, '.'))
-        {
-            break;
-        }
+    for (pyco_arena_block *block = arena->first; block;)
+    {
+        pyco_arena_block *next_block = block->next;
+        _pyco_free(&arena->allocators, block);
+        block = next_block;
+    }
 
-        if (next_char == '.')
-        {
-            if (token_type & PYCO_TOKEN_TYPE_DOUBLE)
-            {
-                token_type |= PYCO_TOKEN_TYPE_ERROR_MALFORMED;
-            }
+    _pyco_free(&arena->allocators, arena);
+}
 
-            token_type = PYCO_TOKEN_TYPE_NUMBER | PYCO_TOKEN_TYPE_DOUBLE;
-        }
+static void *_arena_linear_malloc(void *context, size_t size)
+{
+    return pyco_arena_alloc(context, size);
+}
 
-        token_length++;
+static void *_arena_linear_realloc(void *context, void *pointer, size_t old_size, size_t size)
+{
+    pyco_arena *arena = context;
+    pyco_arena_block *block = arena->current;
 
-        buffer_reader_next_char(reader);
+    // the last allocation of the block grows in place when the block has room for it
+    if (pointer && block && (pyco_uint8 *)pointer + _arena_align(old_size) == _arena_block_data(block) + block->used &&
+        block->used - _arena_align(old_size) + _arena_align(size) <= block->size)
+    {
+        block->used = block->used - _arena_align(old_size) + _arena_align(size);
+        return pointer;
     }
 
-    if (buffer_reader_peek_next_char(reader) == 'f' && token_type & PYCO_TOKEN_TYPE_DOUBLE)
-    {
-        token_type = PYCO_TOKEN_TYPE_NUMBER | PYCO_TOKEN_TYPE_FLOAT;
-        token_length++;
+    void *data = pyco_arena_alloc(arena, size);
 
-        buffer_reader_next_char(reader);
+    if (data && pointer)
+    {
+        memcpy(data, pointer, old_size < size ? old_size : size);
     }
 
-    lexer->track_indents = 0;
-
-    token_location token_end = _initialize_token_location(lexer, reader);
+    return data;
+}
 
-    _lexer_add_token(lexer, token_pointer, token_start, token_end, token_length, token_type);
+static void _arena_linear_free(void *context, void *pointer)
+{
 }
 
-void _lexer_handle_identifiers(pyco_lexer *lexer, pyco_buffer_reader *reader)
+pyco_allocators pyco_arena_allocators(pyco_arena *arena)
 {
-    token_location token_start = _initialize_token_location(lexer, reader);
+    return (pyco_allocators){
+        .malloc = _arena_linear_malloc,
+        .realloc = _arena_linear_realloc,
+        .free = _arena_linear_free,
+        .context = arena,
+    };
+}
 
-    const pyco_uint8 *token_pointer = buffer_reader_get_data_pointer(reader, token_start.offset);
+// MARK: THREADS
 
-    pyco_uint32 token_length = 1;
+// just what the batch compile needs, a lock and threads that are started and joined
+#if defined(_WIN32)
+typedef CRITICAL_SECTION pyco_mutex;
+typedef HANDLE pyco_thread;
+#else
+typedef pthread_mutex_t pyco_mutex;
+typedef pthread_t pyco_thread;
+#endif
 
-    while (buffer_reader_next_char_valid(reader))
-    {
-        char next_char = buffer_reader_peek_next_char(reader);
+typedef void (*PYCO_FUNC_THREAD)(void *argument);
 
-        if (is_whitespace(next_char) || is_newline(next_char) || (next_char != '_' && is_special(next_char, '\0')))
-        {
-            break;
-        }
+typedef struct pyco_thread_start
+{
+    PYCO_FUNC_THREAD function;
+    void *argument;
+} pyco_thread_start;
 
-        token_length++;
+static inline void _pyco_mutex_init(pyco_mutex *mutex)
+{
+#if defined(_WIN32)
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, PYCO_NULL);
+#endif
+}
 
-        buffer_reader_next_char(reader);
-    }
+static inline void _pyco_mutex_destroy(pyco_mutex *mutex)
+{
+#if defined(_WIN32)
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
 
-    lexer->track_indents = 0;
+static inline void _pyco_mutex_lock(pyco_mutex *mutex)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
 
-    token_location token_end = _initialize_token_location(lexer, reader);
+static inline void _pyco_mutex_unlock(pyco_mutex *mutex)
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
 
-    _lexer_add_token(lexer, token_pointer, token_start, token_end, token_length, PYCO_TOKEN_TYPE_IDENTIFIER);
+#if defined(_WIN32)
+static DWORD WINAPI _pyco_thread_main(LPVOID argument)
+{
+    pyco_thread_start *start = argument;
+    start->function(start->argument);
+    return 0;
+}
+#else
+static void *_pyco_thread_main(void *argument)
+{
+    pyco_thread_start *start = argument;
+    start->function(start->argument);
+    return PYCO_NULL;
 }
+#endif
 
-void _lexer_handle_strings(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// the start has to stay valid until the thread is joined
+bool _pyco_thread_create(pyco_thread *thread, pyco_thread_start *start)
 {
-    token_location token_start = _initialize_token_location(lexer, reader);
+#if defined(_WIN32)
+    return (*thread = CreateThread(PYCO_NULL, 0, _pyco_thread_main, start, 0, PYCO_NULL)) != PYCO_NULL;
+#else
+    return pthread_create(thread, PYCO_NULL, _pyco_thread_main, start) == 0;
+#endif
+}
 
-    const pyco_uint8 *token_pointer = buffer_reader_get_data_pointer(reader, token_start.offset);
+void _pyco_thread_join(pyco_thread thread)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, PYCO_NULL);
+#endif
+}
 
-    char bracket_type = buffer_reader_current_char(reader);
+pyco_uint32 _pyco_cpu_count()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (pyco_uint32)count : 1;
+#endif
+}
 
-    pyco_flags token_type = PYCO_TOKEN_TYPE_STRING;
-    pyco_uint32 token_length = 0;
+// runs the function once on every one of the arguments, the first on the calling thread and the others on threads of
+// their own. when a thread can not be started its argument is run on the calling thread after the others are started
+void _pyco_run_parallel(PYCO_FUNC_THREAD function, void *arguments, pyco_uint64 argument_size, pyco_uint32 count, const pyco_allocators *allocators)
+{
+    pyco_thread *threads = count > 1 ? _pyco_malloc(allocators, (sizeof(pyco_thread) + sizeof(pyco_thread_start) + sizeof(bool)) * count) : PYCO_NULL;
+    pyco_thread_start *starts = threads ? (pyco_thread_start *)(threads + count) : PYCO_NULL;
+    bool *started = threads ? (bool *)(starts + count) : PYCO_NULL;
 
-    if (bracket_type == '`')
+    for (pyco_uint32 i = 1; i < count && threads; i++)
     {
-        token_type |= PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL;
+        starts[i] = (pyco_thread_start){function, (pyco_uint8 *)arguments + argument_size * i};
+        started[i] = _pyco_thread_create(&threads[i], &starts[i]);
     }
 
-    while (buffer_reader_next_char_valid(reader))
-    {
-        char next_char = buffer_reader_peek_next_char(reader);
+    function(arguments);
 
-        if (is_newline(next_char))
+    for (pyco_uint32 i = 1; i < count; i++)
+    {
+        if (!threads || !started[i])
         {
-            if ((token_type & PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL) == 0)
-            {
-                token_type |= PYCO_TOKEN_TYPE_ERROR;
-                token_type |= PYCO_TOKEN_TYPE_ERROR_INCOMPLETE;
-                break;
-            }
-
-            lexer->current_line++;
+            function((pyco_uint8 *)arguments + argument_size * i);
         }
+    }
 
-        if (next_char == bracket_type)
+    for (pyco_uint32 i = 1; i < count && threads; i++)
+    {
+        if (started[i])
         {
-            buffer_reader_next_char(reader);
-            break;
+            _pyco_thread_join(threads[i]);
         }
+    }
 
-        token_length++;
-
-        buffer_reader_next_char(reader);
+    if (threads)
+    {
+        _pyco_free(allocators, threads);
     }
+}
 
-    lexer->track_indents = 0;
+// MARK: RUN SCANNERS
+
+static inline bool is_special(char ch, char exclude /*= '\0'*/)
+{
+    return (exclude == ch) || (ch == '_') ? false : (ch >= '!' && ch <= '/') || (ch >= ':' && ch <= '@') || (ch >= '[' && ch <= '`') || (ch >= '{' && ch <= '~');
+}
 
-    token_location token_end = _initialize_token_location(lexer, reader);
+static inline bool is_newline(char ch)
+{
+    return ch == '\n' || ch == '\r';
+}
 
-    _lexer_add_token(lexer, token_pointer, token_start, token_end, token_length, token_type);
+static inline bool is_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\t';
 }
 
-void _lexer_handle_specials(pyco_lexer *lexer, pyco_buffer_reader *reader)
+// every scanner returns the offset of the first byte in [offset, size) that ends the run, or size
+typedef struct pyco_scanner
+{
+    pyco_uint64 (*identifier_end)(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size);
+    pyco_uint64 (*string_end)(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size, pyco_uint8 bracket);
+} pyco_scanner;
+
+enum PYCO_SCANNER
 {
-    token_location token_start = _initialize_token_location(lexer, reader);
+    PYCO_SCANNER_AUTO = 0,
+    PYCO_SCANNER_SCALAR,
+    PYCO_SCANNER_SSE2,
+    PYCO_SCANNER_AVX2,
+};
 
-    const pyco_uint8 *token_pointer = buffer_reader_get_data_pointer(reader, token_start.offset);
+static inline bool _scanner_is_identifier_stop(pyco_uint8 ch)
+{
+    return is_whitespace(ch) || is_newline(ch) || is_special(ch, '\0');
+}
 
-    pyco_uint32 token_length = 1;
+static inline bool _scanner_is_string_stop(pyco_uint8 ch, pyco_uint8 bracket)
+{
+    return ch == bracket || is_newline(ch);
+}
 
-    switch (buffer_reader_current_char(reader))
+pyco_uint64 _scanner_scalar_identifier_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size)
+{
+    while (offset < size && !_scanner_is_identifier_stop(data[offset]))
     {
-    case '"':
-    case '`':
-        _lexer_handle_strings(lexer, reader);
-        return;
+        offset++;
     }
 
-    lexer->track_indents = 0;
+    return offset;
+}
 
-    token_location token_end = _initialize_token_location(lexer, reader);
+pyco_uint64 _scanner_scalar_string_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size, pyco_uint8 bracket)
+{
+    while (offset < size && !_scanner_is_string_stop(data[offset], bracket))
+    {
+        offset++;
+    }
 
-    _lexer_add_token(lexer, token_pointer, token_start, token_end, token_length, PYCO_TOKEN_TYPE_SPECIAL);
+    return offset;
 }
 
-pyco_lexer_options lexer_initialize_options()
+#if defined(PYCO_SIMD_X86)
+
+static inline pyco_uint32 _scanner_first_set_bit(pyco_uint32 mask)
 {
-    return (pyco_lexer_options){
-        .token_block_initial_size = 1000,
-        .token_block_increment_size = 1000,
-        .token_buffer_block_initial_size = 2000,
-        .token_buffer_block_increment_size = 2000,
-        .allocators = {
-            .malloc = PYCO_NULL,
-            .realloc = PYCO_NULL,
-            .free = PYCO_NULL,
-        }};
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
 }
 
-pyco_lexer *lexer_create(pyco_lexer_options options)
+// the byte ranges below are all in 0x21..0x7E, so signed compares also reject bytes >= 0x80
+PYCO_TARGET_SSE2 static inline __m128i _scanner_sse2_in_range(__m128i chars, char low, char high)
 {
-    if (!options.allocators.malloc || !options.allocators.realloc || !options.allocators.free)
-    {
-        return PYCO_NULL;
-    }
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8(high + 1)));
+}
 
-    if (!options.token_block_initial_size && !options.token_block_increment_size)
-    {
-        return PYCO_NULL;
-    }
+PYCO_TARGET_SSE2 static inline __m128i _scanner_sse2_identifier_stops(__m128i chars)
+{
+    __m128i stops = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))));
 
-    pyco_lexer *lexer = options.allocators.malloc(sizeof(pyco_lexer));
-    lexer->options = options;
-    lexer->current_line = 1;
-    lexer->last_newline = 0;
-    lexer->track_indents = 1;
-    lexer->tokens = 0;
+    stops = _mm_or_si128(stops, _scanner_sse2_in_range(chars, '!', '/'));
+    stops = _mm_or_si128(stops, _scanner_sse2_in_range(chars, ':', '@'));
+    stops = _mm_or_si128(stops, _mm_andnot_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('_')), _scanner_sse2_in_range(chars, '[', '`')));
+    stops = _mm_or_si128(stops, _scanner_sse2_in_range(chars, '{', '~'));
 
-    lexer->tokens_count = 0;
-    lexer->tokens_allocated = options.token_block_initial_size;
-    if (lexer->tokens_allocated)
-    {
-        lexer->tokens = options.allocators.malloc(sizeof(pyco_token) * lexer->tokens_allocated);
-    }
+    return stops;
+}
 
-    lexer->token_buffer_offset = 0;
-    lexer->token_buffer_allocated = options.token_buffer_block_initial_size;
-    if (lexer->token_buffer_allocated)
+PYCO_TARGET_SSE2 pyco_uint64 _scanner_sse2_identifier_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size)
+{
+    for (; offset + 16 <= size; offset += 16)
     {
-        lexer->token_buffer_data = options.allocators.malloc(lexer->token_buffer_allocated);
-    }
+        __m128i chars = _mm_loadu_si128((const __m128i *)(data + offset));
+        pyco_uint32 mask = (pyco_uint32)_mm_movemask_epi8(_scanner_sse2_identifier_stops(chars));
 
-    lexer->current_token = lexer->tokens;
+        if (mask)
+        {
+            return offset + _scanner_first_set_bit(mask);
+        }
+    }
 
-    return lexer;
+    return _scanner_scalar_identifier_end(data, offset, size);
 }
 
-bool lexer_free(pyco_lexer *lexer)
+PYCO_TARGET_SSE2 pyco_uint64 _scanner_sse2_string_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size, pyco_uint8 bracket)
 {
-    if (lexer && lexer->options.allocators.free)
+    const __m128i brackets = _mm_set1_epi8((char)bracket);
+
+    for (; offset + 16 <= size; offset += 16)
     {
-        if (lexer->token_buffer_data)
-        {
-            lexer->options.allocators.free(lexer->token_buffer_data);
-        }
+        __m128i chars = _mm_loadu_si128((const __m128i *)(data + offset));
+        __m128i stops = _mm_or_si128(
+            _mm_cmpeq_epi8(chars, brackets),
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))));
+        pyco_uint32 mask = (pyco_uint32)_mm_movemask_epi8(stops);
 
-        if (lexer->tokens)
+        if (mask)
         {
-            lexer->options.allocators.free(lexer->tokens);
+            return offset + _scanner_first_set_bit(mask);
         }
-
-        lexer->options.allocators.free(lexer);
-
-        return true;
     }
 
-    return false;
+    return _scanner_scalar_string_end(data, offset, size, bracket);
 }
 
-bool lexer_process_buffer(pyco_lexer *lexer, const pyco_buffer *buffer)
+PYCO_TARGET_AVX2 static inline __m256i _scanner_avx2_in_range(__m256i chars, char low, char high)
 {
-    pyco_buffer_reader reader = create_buffer_reader(buffer);
+    return _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
 
-    if (!is_buffer_reader_valid(&reader))
-    {
-        return false;
-    }
+PYCO_TARGET_AVX2 static inline __m256i _scanner_avx2_identifier_stops(__m256i chars)
+{
+    __m256i stops = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r'))));
 
-    do
+    stops = _mm256_or_si256(stops, _scanner_avx2_in_range(chars, '!', '/'));
+    stops = _mm256_or_si256(stops, _scanner_avx2_in_range(chars, ':', '@'));
+    stops = _mm256_or_si256(stops, _mm256_andnot_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_')), _scanner_avx2_in_range(chars, '[', '`')));
+    stops = _mm256_or_si256(stops, _scanner_avx2_in_range(chars, '{', '~'));
+
+    return stops;
+}
+
+PYCO_TARGET_AVX2 pyco_uint64 _scanner_avx2_identifier_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size)
+{
+    for (; offset + 32 <= size; offset += 32)
     {
-        char ch = buffer_reader_current_char(&reader);
+        __m256i chars = _mm256_loadu_si256((const __m256i *)(data + offset));
+        pyco_uint32 mask = (pyco_uint32)_mm256_movemask_epi8(_scanner_avx2_identifier_stops(chars));
 
-        if (is_newline(ch))
+        if (mask)
         {
-            _lexer_handle_newlines(lexer, &reader);
-            continue;
+            return offset + _scanner_first_set_bit(mask);
         }
+    }
 
-        if (is_whitespace(ch))
-        {
-            _lexer_handle_whitespaces(lexer, &reader);
-            continue;
-        }
+    return _scanner_sse2_identifier_end(data, offset, size);
+}
 
-        if (is_number(ch, false, false))
-        {
-            _lexer_handle_numbers(lexer, &reader);
-            continue;
-        }
+PYCO_TARGET_AVX2 pyco_uint64 _scanner_avx2_string_end(const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size, pyco_uint8 bracket)
+{
+    const __m256i brackets = _mm256_set1_epi8((char)bracket);
+
+    for (; offset + 32 <= size; offset += 32)
+    {
+        __m256i chars = _mm256_loadu_si256((const __m256i *)(data + offset));
+        __m256i stops = _mm256_or_si256(
+            _mm256_cmpeq_epi8(chars, brackets),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r'))));
+        pyco_uint32 mask = (pyco_uint32)_mm256_movemask_epi8(stops);
 
-        if (is_special(ch, '\0'))
+        if (mask)
         {
-            _lexer_handle_specials(lexer, &reader);
-            continue;
+            return offset + _scanner_first_set_bit(mask);
         }
+    }
 
-        _lexer_handle_identifiers(lexer, &reader);
-    } while (buffer_reader_next_char_valid(&reader) && buffer_reader_next_char(&reader));
-
-    return true;
+    return _scanner_sse2_string_end(data, offset, size, bracket);
 }
 
-const pyco_token *lexer_get_current_token(pyco_lexer *lexer)
+bool _scanner_cpu_supports(pyco_uint32 scanner)
 {
-    return lexer->current_token;
-}
+#if defined(_MSC_VER)
+    int info[4];
 
-const pyco_token *lexer_get_next_token(pyco_lexer *lexer)
-{
-    if (lexer->current_token)
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+
+    if (scanner == PYCO_SCANNER_SSE2)
     {
-        return lexer->current_token = lexer->current_token->next;
+        return sse2;
     }
 
-    return PYCO_NULL;
+    __cpuid(info, 0);
+
+    if (!avx || info[0] < 7)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+
+    return scanner == PYCO_SCANNER_SSE2 ? __builtin_cpu_supports("sse2") : __builtin_cpu_supports("avx2");
+#endif
 }
 
-const pyco_token *lexer_peek_next_token(pyco_lexer *lexer)
+#endif
+
+// picks the widest kernels the cpu supports, the scalar kernels are used everywhere else
+pyco_scanner scanner_select(pyco_uint32 requested)
 {
-    if (lexer->current_token)
+    pyco_scanner scanner = {
+        .identifier_end = _scanner_scalar_identifier_end,
+        .string_end = _scanner_scalar_string_end,
+    };
+
+#if defined(PYCO_SIMD_X86)
+    if ((requested == PYCO_SCANNER_AUTO || requested == PYCO_SCANNER_AVX2) && _scanner_cpu_supports(PYCO_SCANNER_AVX2))
+    {
+        scanner.identifier_end = _scanner_avx2_identifier_end;
+        scanner.string_end = _scanner_avx2_string_end;
+    }
+    else if (requested != PYCO_SCANNER_SCALAR && _scanner_cpu_supports(PYCO_SCANNER_SSE2))
     {
-        return lexer->current_token->next;
+        scanner.identifier_end = _scanner_sse2_identifier_end;
+        scanner.string_end = _scanner_sse2_string_end;
     }
+#endif
 
-    return PYCO_NULL;
+    return scanner;
 }
 
-// MARK: AST TREE BUILDER
+// MARK: SYMBOL TABLE
 
-typedef struct pyco_ast_node
+typedef struct pyco_symbol_name
 {
-    struct pyco_ast_node *parent;
-    struct pyco_ast_node *child_first;
-    struct pyco_ast_node *child_last;
-    struct pyco_ast_node *next;
-    const char *name;
-    pyco_uint32 type;
-    pyco_uint32 flags;
-    void *data;
-} pyco_ast_node;
+    pyco_uint32 offset;
+    pyco_uint32 length;
+} pyco_symbol_name;
 
-typedef struct pyco_ast_options
+// identifiers are interned into dense ids starting at 1, 0 means no symbol. names are copied
+// into a pool so a table can outlive the sources it was filled from and be shared across compiles
+typedef struct pyco_symbol_table
 {
     pyco_allocators allocators;
-    pyco_uint64 buffer_initial_size;
-    pyco_uint64 buffer_increment_size;
-} pyco_ast_options;
-
-typedef struct pyco_ast
+    // open addressing, every slot holds the hash in the high half and the symbol in the low half, empty slots are 0
+    pyco_uint64 *slots;
+    pyco_uint32 slots_mask;
+    pyco_uint32 count;
+    pyco_uint32 allocated;
+    pyco_symbol_name *names;
+    pyco_uint8 *pool;
+    pyco_uint64 pool_size;
+    pyco_uint64 pool_allocated;
+    pyco_allocation_counters counters;
+} pyco_symbol_table;
+
+static inline pyco_uint32 _symbol_load32(const pyco_uint8 *text)
 {
-    pyco_ast_options options;
-    pyco_ast_node *root_node;
-    pyco_uint64 buffer_allocated;
-    pyco_uint64 buffer_offset;
-    pyco_uint8 *buffer_data;
-} pyco_ast;
-
-pyco_ast_node *pyco_ast_node_create(pyco_ast *ast, const char *name, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size);
+    pyco_uint32 word;
+    memcpy(&word, text, 4);
+    return word;
+}
 
-pyco_ast initialize_tree(pyco_ast_options options)
+static inline pyco_uint64 _symbol_load64(const pyco_uint8 *text)
 {
-    pyco_ast tree = {
-        .options = options,
-    };
-
-    tree.buffer_data = options.allocators.malloc(options.buffer_initial_size);
-    tree.buffer_allocated = options.buffer_initial_size;
-    tree.buffer_offset = 0;
-
-    tree.root_node = pyco_ast_node_create(&tree, PYCO_NULL, PYCO_AST_NODE_TYPE_ROOT, PYCO_NULL, 0);
-
-    return tree;
+    pyco_uint64 word;
+    memcpy(&word, text, 8);
+    return word;
 }
 
-pyco_ast_node *pyco_ast_node_create(pyco_ast *ast, const char *name, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
+static inline pyco_uint32 _symbol_hash(const pyco_uint8 *text, pyco_uint64 length)
 {
-    pyco_uint64 node_size = sizeof(pyco_ast_node) + data_size;
+    pyco_uint64 hash = length * 0x9E3779B97F4A7C15ull;
+    pyco_uint64 word;
 
-    if ((ast->buffer_offset + node_size) > ast->buffer_allocated)
+    if (length >= 8)
     {
-        pyco_uint64 new_buffer_size = ast->buffer_allocated + ast->options.buffer_increment_size;
-        ast->buffer_data = ast->options.allocators.realloc(ast->buffer_data, new_buffer_size);
-        ast->buffer_allocated = new_buffer_size;
-    }
+        for (pyco_uint64 offset = 0; offset + 8 < length; offset += 8)
+        {
+            hash = (hash ^ _symbol_load64(text + offset)) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 29;
+        }
 
-    pyco_uint8 *offset = ast->buffer_data + ast->buffer_offset;
+        // the last word overlaps the previous one instead of reading past the name
+        word = _symbol_load64(text + length - 8);
+    }
+    else if (length >= 4)
+    {
+        word = ((pyco_uint64)_symbol_load32(text) << 32) | _symbol_load32(text + length - 4);
+    }
+    else
+    {
+        word = length ? ((pyco_uint64)text[0] << 16) | ((pyco_uint64)text[length >> 1] << 8) | text[length - 1] : 0;
+    }
 
-    pyco_ast_node *node = (pyco_ast_node *)offset;
-    node->data = offset + sizeof(pyco_ast_node);
-    node->name = name;
-    node->type = type;
-    node->flags = flags;
-    node->parent = PYCO_NULL;
-    node->child_first = PYCO_NULL;
-    node->child_last = PYCO_NULL;
-    node->next = PYCO_NULL;
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
 
-    ast->buffer_offset += node_size;
+    // the multiplies only carry bits upwards, fold the high bits back down before the low ones index the table
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
 
-    return node;
+    return (pyco_uint32)hash;
 }
 
-inline pyco_ast_node *pyco_ast_node_append(pyco_ast_node *root_node, pyco_ast_node *node_to_append)
+// compares with the same overlapping loads as the hash so short names never call into memcmp
+static inline bool _symbol_equals(const pyco_uint8 *left, const pyco_uint8 *right, pyco_uint64 length)
 {
-    if (node_to_append == PYCO_NULL)
+    if (length >= 8)
     {
-        return root_node;
+        for (pyco_uint64 offset = 0; offset + 8 < length; offset += 8)
+        {
+            if (_symbol_load64(left + offset) != _symbol_load64(right + offset))
+            {
+                return false;
+            }
+        }
+
+        return _symbol_load64(left + length - 8) == _symbol_load64(right + length - 8);
     }
 
-    if (root_node->child_first == PYCO_NULL)
+    if (length >= 4)
     {
-        root_node->child_first = node_to_append;
-        root_node->child_last = node_to_append;
+        return _symbol_load32(left) == _symbol_load32(right) && _symbol_load32(left + length - 4) == _symbol_load32(right + length - 4);
     }
-    else
+
+    for (pyco_uint64 i = 0; i < length; i++)
     {
-        root_node->child_last->next = node_to_append;
-        root_node->child_last = node_to_append;
+        if (left[i] != right[i])
+        {
+            return false;
+        }
     }
 
-    node_to_append->parent = root_node;
-
-    return node_to_append;
-}
-
-pyco_ast_node *pyco_ast_node_add(pyco_ast *ast, pyco_ast_node *root_node, const char *name, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
-{
-    return pyco_ast_node_append(root_node, pyco_ast_node_create(ast, name, type, flags, data_size));
+    return true;
 }
 
-void pyco_ast_free(pyco_ast *ast, pyco_ast_node *root_node)
+// initial_size is a hint for how many names the table will hold, it grows past it when needed
+pyco_symbol_table *pyco_symbol_table_create(pyco_allocators allocators, pyco_uint32 initial_size)
 {
-    ast->options.allocators.free(ast->buffer_data);
-    ast->buffer_allocated = 0;
-    ast->buffer_offset = 0;
-    ast->buffer_data = PYCO_NULL;
-}
+    if (!allocators.malloc || !allocators.realloc || !allocators.free)
+    {
+        return PYCO_NULL;
+    }
 
-// MARK: NODE DATA STRUCTS
+    pyco_symbol_table *table = _pyco_malloc(&allocators, sizeof(pyco_symbol_table));
 
-enum PYCO_VAR_TYPE
-{
-    PYCO_VAR_TYPE_INT8,
-    PYCO_VAR_TYPE_INT16,
-    PYCO_VAR_TYPE_INT32,
-    PYCO_VAR_TYPE_INT64,
-    PYCO_VAR_TYPE_UINT8,
-    PYCO_VAR_TYPE_UINT16,
-    PYCO_VAR_TYPE_UINT32,
-    PYCO_VAR_TYPE_UINT64,
-    PYCO_VAR_TYPE_F32,
-    PYCO_VAR_TYPE_F64,
-    PYCO_VAR_TYPE_BYTE,
-    PYCO_VAR_TYPE_RUNE,
-    PYCO_VAR_TYPE_STRING,
-    PYCO_VAR_TYPE_ARRAY,
-    PYCO_VAR_TYPE_MAP,
-};
+    if (!table)
+    {
+        return PYCO_NULL;
+    }
 
-typedef struct ast_data_struct
-{
-    pyco_uint32 flags;
-} ast_data_struct;
+    table->allocators = allocators;
+    table->slots_mask = 1024 - 1;
+    table->count = 0;
+    table->pool_size = 0;
 
-typedef struct ast_data_struct_field
-{
-    pyco_uint32 type;
-    pyco_uint32 flags;
-} ast_data_struct_field;
+    while (table->slots_mask < initial_size * 2 && table->slots_mask < (1u << 30) - 1)
+    {
+        table->slots_mask = table->slots_mask * 2 + 1;
+    }
 
-// MARK: AST TREE PRINTER
+    table->allocated = (table->slots_mask + 1) / 2;
+    table->pool_allocated = table->allocated * 16;
+    table->slots = _pyco_malloc(&allocators, sizeof(pyco_uint64) * (table->slots_mask + 1));
+    table->names = _pyco_malloc(&allocators, sizeof(pyco_symbol_name) * table->allocated);
+    table->pool = _pyco_malloc(&allocators, table->pool_allocated);
 
-inline void _pyco_ast_node_print_json_indent(FILE *file, pyco_uint32 indent)
-{
-    for (pyco_uint32 i = 0; i < indent; i++)
+    if (!table->slots || !table->names || !table->pool)
     {
-        fprintf(file, "    ");
+        pyco_symbol_table_free(table);
+        return PYCO_NULL;
     }
+
+    memset(table->slots, 0, sizeof(pyco_uint64) * (table->slots_mask + 1));
+
+    table->counters = (pyco_allocation_counters){0};
+    _count_allocation(&table->counters, sizeof(pyco_symbol_table) + sizeof(pyco_uint64) * (table->slots_mask + 1) + sizeof(pyco_symbol_name) * table->allocated + table->pool_allocated, false);
+
+    return table;
 }
 
-const char *_pyco_ast_node_get_node_type(pyco_uint32 type)
+void pyco_symbol_table_free(pyco_symbol_table *table)
 {
-    switch (type)
+    if (!table)
     {
-    case PYCO_AST_NODE_TYPE_NONE:
-        return PYCO_AST_NODE_TYPE_NAME_NONE;
-    case PYCO_AST_NODE_TYPE_ROOT:
-        return PYCO_AST_NODE_TYPE_NAME_ROOT;
-    case PYCO_AST_NODE_TYPE_LITERAL:
-        return PYCO_AST_NODE_TYPE_NAME_LITERAL;
-    case PYCO_AST_NODE_TYPE_STRUCT:
-        return PYCO_AST_NODE_TYPE_NAME_STRUCT;
-    case PYCO_AST_NODE_TYPE_STRUCT_FIELD:
-        return PYCO_AST_NODE_TYPE_NAME_STRUCT_FIELD;
-    case PYCO_AST_NODE_TYPE_FUNCTION:
-        return PYCO_AST_NODE_TYPE_NAME_FUNCTION;
-    case PYCO_AST_NODE_TYPE_ARGUMENTS:
-        return PYCO_AST_NODE_TYPE_NAME_ARGUMENTS;
-    case PYCO_AST_NODE_TYPE_STATEMENT:
-        return PYCO_AST_NODE_TYPE_NAME_STATEMENT;
-    case PYCO_AST_NODE_TYPE_EXPRESSION:
-        return PYCO_AST_NODE_TYPE_NAME_EXPRESSION;
-    case PYCO_AST_NODE_TYPE_CALL:
-        return PYCO_AST_NODE_TYPE_NAME_CALL;
-    case PYCO_AST_NODE_TYPE_IF:
-        return PYCO_AST_NODE_TYPE_NAME_IF;
-    case PYCO_AST_NODE_TYPE_FOR:
-        return PYCO_AST_NODE_TYPE_NAME_FOR;
-    case PYCO_AST_NODE_TYPE_WHILE:
-        return PYCO_AST_NODE_TYPE_NAME_WHILE;
-    case PYCO_AST_NODE_TYPE_DO_WHILE:
-        return PYCO_AST_NODE_TYPE_NAME_DO_WHILE;
-    case PYCO_AST_NODE_TYPE_CONTINUE:
-        return PYCO_AST_NODE_TYPE_NAME_CONTINUE;
-    case PYCO_AST_NODE_TYPE_BREAK:
-        return PYCO_AST_NODE_TYPE_NAME_BREAK;
-    case PYCO_AST_NODE_TYPE_SCOPE:
-        return PYCO_AST_NODE_TYPE_NAME_SCOPE;
+        return;
     }
 
-    return PYCO_AST_NODE_TYPE_NAME_UNKNOWN;
+    _pyco_free(&table->allocators, table->slots);
+    _pyco_free(&table->allocators, table->names);
+    _pyco_free(&table->allocators, table->pool);
+    _pyco_free(&table->allocators, table);
 }
 
-void pyco_ast_node_print_json(FILE *file, pyco_ast_node *node, pyco_uint32 indent)
+bool _symbol_table_grow_slots(pyco_symbol_table *table)
 {
-    _pyco_ast_node_print_json_indent(file, indent);
-    fprintf(file, "{\n");
-
-    _pyco_ast_node_print_json_indent(file, indent + 1);
-    fprintf(file, "type: \"%s\",\n", _pyco_ast_node_get_node_type(node->type));
+    const pyco_uint32 slots_mask = table->slots_mask * 2 + 1;
+    pyco_uint64 *slots = _pyco_malloc(&table->allocators, sizeof(pyco_uint64) * ((pyco_uint64)slots_mask + 1));
 
-    if (node->name)
+    if (!slots)
     {
-        _pyco_ast_node_print_json_indent(file, indent + 1);
-        fprintf(file, "name: \"%s\",\n", node->name);
+        return false;
     }
 
-    if (node->child_first)
+    _count_allocation(&table->counters, sizeof(pyco_uint64) * ((pyco_uint64)slots_mask + 1), false);
+    memset(slots, 0, sizeof(pyco_uint64) * ((pyco_uint64)slots_mask + 1));
+
+    for (pyco_uint64 i = 0; i <= table->slots_mask; i++)
     {
-        _pyco_ast_node_print_json_indent(file, indent + 1);
-        fprintf(file, "children: [\n");
+        if (table->slots[i])
+        {
+            pyco_uint32 index = (pyco_uint32)(table->slots[i] >> 32) & slots_mask;
 
-        pyco_ast_node_print_json(file, node->child_first, indent + 2);
+            while (slots[index])
+            {
+                index = (index + 1) & slots_mask;
+            }
 
-        _pyco_ast_node_print_json_indent(file, indent + 1);
-        fprintf(file, "]\n");
+            slots[index] = table->slots[i];
+        }
     }
 
-    _pyco_ast_node_print_json_indent(file, indent);
+    _pyco_free(&table->allocators, table->slots);
+    table->slots = slots;
+    table->slots_mask = slots_mask;
 
-    if (node->next)
-    {
-        fprintf(file, "},\n");
-        pyco_ast_node_print_json(file, node->next, indent);
-    }
-    else
-    {
-        fprintf(file, "}\n");
-    }
+    return true;
 }
 
-bool pyco_ast_node_to_json_file(const char *filename, pyco_ast_node *root_node, const char *extra)
+bool _symbol_table_add_name(pyco_symbol_table *table, const pyco_uint8 *name, pyco_uint32 length)
 {
-    if (root_node == PYCO_NULL)
+    if (table->count + 1 == table->allocated)
     {
-        return false;
-    }
+        const pyco_uint32 allocated = table->allocated * 2;
+        pyco_symbol_name *names = _pyco_realloc(&table->allocators, table->names, sizeof(pyco_symbol_name) * table->allocated, sizeof(pyco_symbol_name) * allocated);
 
-    FILE *file = fopen(filename, "w");
+        if (!names)
+        {
+            return false;
+        }
 
-    if (file == NULL)
-    {
-        return false;
+        _count_allocation(&table->counters, sizeof(pyco_symbol_name) * allocated, true);
+        table->names = names;
+        table->allocated = allocated;
     }
 
-    if (extra)
+    if (table->pool_size + length > table->pool_allocated)
     {
-        fprintf(file, "/*\n%s\n*/\n\n", extra);
-    }
+        pyco_uint64 pool_allocated = table->pool_allocated * 2;
 
-    fprintf(file, "export const AST = ");
+        while (table->pool_size + length > pool_allocated)
+        {
+            pool_allocated *= 2;
+        }
 
-    pyco_ast_node_print_json(file, root_node, 0);
+        pyco_uint8 *pool = _pyco_realloc(&table->allocators, table->pool, table->pool_allocated, pool_allocated);
 
-    fclose(file);
+        if (!pool)
+        {
+            return false;
+        }
+
+        _count_allocation(&table->counters, pool_allocated, true);
+        table->pool = pool;
+        table->pool_allocated = pool_allocated;
+    }
+
+    memcpy(table->pool + table->pool_size, name, length);
+
+    table->count++;
+    table->names[table->count].offset = (pyco_uint32)table->pool_size;
+    table->names[table->count].length = length;
+    table->pool_size += length;
 
     return true;
 }
 
-// MARK: PARSER
+// returns the symbol of the name, adding it when it was not seen before, 0 when out of memory
+pyco_uint32 pyco_symbol_table_intern(pyco_symbol_table *table, const pyco_uint8 *name, pyco_uint64 length)
+{
+    const pyco_uint32 hash = _symbol_hash(name, length);
+    pyco_uint32 index = hash & table->slots_mask;
 
-enum PYCO_OPERATOR
+    for (pyco_uint64 slot; (slot = table->slots[index]); index = (index + 1) & table->slots_mask)
+    {
+        const pyco_symbol_name *entry = &table->names[(pyco_uint32)slot];
+
+        if ((pyco_uint32)(slot >> 32) == hash && entry->length == length && _symbol_equals(table->pool + entry->offset, name, length))
+        {
+            return (pyco_uint32)slot;
+        }
+    }
+
+    // keep the load under a half so probe runs stay short, a table that can not grow takes no more names
+    // since a full one would never end the probe above
+    if ((table->count + 1) * 2 > table->slots_mask)
+    {
+        if (!_symbol_table_grow_slots(table))
+        {
+            return 0;
+        }
+
+        index = hash & table->slots_mask;
+
+        while (table->slots[index])
+        {
+            index = (index + 1) & table->slots_mask;
+        }
+    }
+
+    if (!_symbol_table_add_name(table, name, (pyco_uint32)length))
+    {
+        return 0;
+    }
+
+    table->slots[index] = ((pyco_uint64)hash << 32) | table->count;
+
+    return table->count;
+}
+
+// the returned name is not NUL-terminated and only valid until the next name is interned
+const pyco_uint8 *pyco_symbol_table_name(pyco_symbol_table *table, pyco_uint32 symbol, pyco_uint64 *length)
 {
-    PYCO_OPERATOR_NONE = PYCO_NULL,
-    PYCO_OPERATOR_COMPOSITE = (1 << 0),
-    PYCO_OPERATOR_ADD = (1 << 1),
-    PYCO_OPERATOR_SUBTRACT = (1 << 2),
-    PYCO_OPERATOR_MULTIPLY = (1 << 3),
-    PYCO_OPERATOR_DIVIDE = (1 << 4),
-    PYCO_OPERATOR_INCREMENT = (1 << 5),
-    PYCO_OPERATOR_DECREMENT = (1 << 6),
-    PYCO_OPERATOR_ASSIGN = (1 << 7),
-    PYCO_OPERATOR_ASSIGN_TYPE = (1 << 8),
-    PYCO_OPERATOR_ASSIGN_CONST = (1 << 9),
-    PYCO_OPERATOR_EQUAL = (1 << 10),
-    PYCO_OPERATOR_GREATER = (1 << 11),
-    PYCO_OPERATOR_LESS = (1 << 12),
-    PYCO_OPERATOR_AND = (1 << 13),
-    PYCO_OPERATOR_OR = (1 << 14),
-    PYCO_OPERATOR_NOT = (1 << 15),
-    PYCO_OPERATOR_XOR = (1 << 16),
-    PYCO_OPERATOR_BITWISE = (1 << 17),
-    PYCO_OPERATOR_LEFT_SHIFT = (1 << 18),
-    PYCO_OPERATOR_RIGHT_SHIFT = (1 << 19),
-    PYCO_OPERATOR_TERNARY = (1 << 20),
-    PYCO_OPERATOR_GROUPING = (1 << 21),
-    PYCO_OPERATOR_FUNCTION_CALL = (1 << 22),
-    PYCO_OPERATOR_ARRAY_INDEX = (1 << 25),
-    PYCO_OPERATOR_MEMBER_ACCESS = (1 << 26),
-    PYCO_OPERATOR_INVALID = (1 << 30),
-};
+    if (!table || !symbol || symbol > table->count)
+    {
+        *length = 0;
+        return PYCO_NULL;
+    }
+
+    *length = table->names[symbol].length;
+
+    return table->pool + table->names[symbol].offset;
+}
+
+pyco_uint32 pyco_symbol_table_count(pyco_symbol_table *table)
+{
+    return table ? table->count : 0;
+}
+
+// forgets every name but keeps the slots, names and pool at the size they grew to
+void pyco_symbol_table_reset(pyco_symbol_table *table)
+{
+    if (table && table->count)
+    {
+        memset(table->slots, 0, sizeof(pyco_uint64) * ((pyco_uint64)table->slots_mask + 1));
+        table->count = 0;
+        table->pool_size = 0;
+    }
+}
+
+// MARK: TOKENIZER
+
+typedef struct token_location
+{
+    pyco_uint64 line;
+    pyco_uint64 column;
+    pyco_uint64 offset;
+} token_location;
+
+// a token view materialized from the token stream, the stream itself only stores the kind, offset, length and payload.
+// the payload is the symbol of identifiers, the keyword of keywords, the operator id of special tokens
+// and the PYCO_LITERAL_FLAG bits of numbers. in the stream numbers hold the slot of their literal instead
+typedef struct pyco_token
+{
+    pyco_uint8 type;
+    pyco_uint8 flags;
+    pyco_uint32 offset;
+    pyco_uint32 length;
+    pyco_uint32 payload;
+    const char *value; // span of `length` bytes into the lexed text, not NUL-terminated
+    pyco_literal_value literal; // decoded value of numbers, unset for everything else
+} pyco_token;
+
+// the token stream is stored as parallel arrays in chained blocks that never move once allocated,
+// every new block is twice the size of the previous one so lexing stays linear in the input size
+typedef struct pyco_token_block
+{
+    struct pyco_token_block *next;
+    pyco_uint64 first; // position of the first token in the stream
+    pyco_uint64 count;
+    pyco_uint64 allocated;
+    // decoded numbers, separate from the token arrays so no other token pays for them. a ring has one slot
+    // for each of its tokens, the numbers of other blocks take the next slot
+    pyco_literal *literals;
+    pyco_uint64 literals_count;
+    pyco_uint64 literals_allocated;
+    pyco_uint32 *offsets;
+    pyco_uint32 *lengths;
+    pyco_uint32 *payloads;
+    pyco_uint8 *kinds;
+} pyco_token_block;
+
+typedef struct pyco_lexer_options
+{
+    pyco_uint64 token_block_initial_size;
+    pyco_uint64 line_index_initial_size;
+    pyco_uint64 source_initial_size;
+    // 0 lexes the whole buffer upfront, otherwise tokens are produced on demand into a ring of this many slots
+    pyco_uint64 token_window_size;
+    pyco_uint32 scanner;
+    pyco_uint8 copy_source;
+    // identifiers are interned into this table, the lexer creates and owns one when it is PYCO_NULL
+    pyco_symbol_table *symbols;
+    pyco_uint32 symbol_table_initial_size;
+    pyco_allocators allocators;
+} pyco_lexer_options;
+
+typedef struct pyco_lexer
+{
+    pyco_lexer_options options;
+    pyco_scanner scanner;
+    pyco_symbol_table *symbols;
+    pyco_uint8 owns_symbols;
+    const pyco_uint8 *source;
+    pyco_uint8 *source_copy;
+    pyco_uint64 source_size;
+    pyco_uint64 source_allocated;
+    // where the scan stopped, a token that reaches the end of a pushed chunk is resumed from here
+    pyco_uint64 scan_offset;
+    pyco_uint64 scan_token_start;
+    pyco_uint8 scan_state;
+    pyco_token_block *token_block_first;
+    pyco_token_block *token_block_last;
+    pyco_uint64 tokens_count;
+    // in pull mode the only block is a power of two ring, tokens_count is then absolute
+    pyco_token_block *token_ring;
+    pyco_uint64 scan_token_limit;
+    pyco_uint64 previous_token_end;
+    // offsets where each line after the first one starts, lines and columns are resolved from it on demand
+    pyco_uint32 *line_offsets;
+    pyco_uint64 lines_allocated;
+    pyco_uint64 lines_count;
+    pyco_uint8 track_indents;
+    pyco_uint8 line_start;
+    pyco_locale numeric_locale; // the C locale reals are read in, created by the first literal that needs it
+    pyco_allocation_counters counters; // the symbol table counts its own
+} pyco_lexer;
+
+#define PYCO_TOKEN_BLOCK_BYTES(size) (sizeof(pyco_token_block) + (sizeof(pyco_uint32) * 3 + sizeof(pyco_uint8)) * (size))
+
+// points the arrays of a block of PYCO_TOKEN_BLOCK_BYTES(size) into the memory behind its header
+static inline void _token_block_layout(pyco_token_block *block, pyco_uint64 size)
+{
+    block->next = PYCO_NULL;
+    block->count = 0;
+    block->allocated = size;
+    block->literals = PYCO_NULL;
+    block->literals_count = 0;
+    block->literals_allocated = 0;
+    block->offsets = (pyco_uint32 *)(block + 1);
+    block->lengths = block->offsets + size;
+    block->payloads = block->lengths + size;
+    block->kinds = (pyco_uint8 *)(block->payloads + size);
+}
+
+// grows the literals of a block to hold at least count of them
+static bool _token_block_reserve_literals(pyco_token_block *block, const pyco_allocators *allocators, pyco_allocation_counters *counters, pyco_uint64 count)
+{
+    if (count <= block->literals_allocated)
+    {
+        return true;
+    }
+
+    const pyco_uint64 allocated = block->literals_allocated * 2 > count ? block->literals_allocated * 2 : (count < 64 ? 64 : count);
+    pyco_literal *literals = _pyco_realloc(allocators, block->literals, sizeof(pyco_literal) * block->literals_allocated, sizeof(pyco_literal) * allocated);
+
+    if (!literals)
+    {
+        return false;
+    }
+
+    _count_allocation(counters, sizeof(pyco_literal) * allocated, block->literals_allocated != 0);
+    block->literals = literals;
+    block->literals_allocated = allocated;
+
+    return true;
+}
+
+static inline void _token_block_free(pyco_token_block *block, const pyco_allocators *allocators)
+{
+    if (block->literals)
+    {
+        _pyco_free(allocators, block->literals);
+    }
+
+    _pyco_free(allocators, block);
+}
+
+pyco_token_block *_lexer_add_token_block(pyco_lexer *lexer, pyco_uint64 size)
+{
+    pyco_token_block *block = _pyco_malloc(&lexer->options.allocators, PYCO_TOKEN_BLOCK_BYTES(size));
 
-inline pyco_uint8 _is_successive(const pyco_token *current_token, char operator)
+    if (!block)
+    {
+        return PYCO_NULL;
+    }
+
+    _count_allocation(&lexer->counters, PYCO_TOKEN_BLOCK_BYTES(size), false);
+
+    _token_block_layout(block, size);
+    block->first = lexer->tokens_count;
+
+    if (lexer->token_block_last)
+    {
+        lexer->token_block_last->next = block;
+    }
+    else
+    {
+        lexer->token_block_first = block;
+    }
+
+    lexer->token_block_last = block;
+
+    return block;
+}
+
+#define PYCO_LEXER_NO_TOKEN_END (~0ull)
+
+static inline void _lexer_add_token(pyco_lexer *lexer, pyco_uint64 offset, pyco_uint64 length, pyco_uint8 type, pyco_uint8 flags, pyco_uint32 payload)
 {
-    return (
-        operator != '\0' &&
-        current_token->next &&
-        current_token->next->flags & PYCO_TOKEN_TYPE_SPECIAL &&
-        current_token->next->flags & PYCO_TOKEN_FLAG_SUCCESSIVE &&
-        current_token->next->value[0] == operator);
+    const bool indent = type == PYCO_TOKEN_TYPE_INDENT_SPACE || type == PYCO_TOKEN_TYPE_INDENT_TAB;
+
+    if (lexer->previous_token_end == offset)
+    {
+        flags |= PYCO_TOKEN_FLAG_SUCCESSIVE;
+    }
+
+    // indents never make the next token successive
+    lexer->previous_token_end = indent ? PYCO_LEXER_NO_TOKEN_END : offset + length;
+
+    if (lexer->line_start && !indent)
+    {
+        flags |= PYCO_TOKEN_FLAG_LINE_START;
+        lexer->line_start = 0;
+    }
+
+    pyco_token_block *block = lexer->token_block_last;
+
+    if (!block || block->count == block->allocated)
+    {
+        // in pull mode the only block is the ring, it wraps around instead of growing
+        if (lexer->token_ring)
+        {
+            block->count = 0;
+        }
+        else if (block && block->next)
+        {
+            // blocks kept by a reset are filled again before new ones are added
+            block = lexer->token_block_last = block->next;
+            block->first = lexer->tokens_count;
+        }
+        else if (!(block = _lexer_add_token_block(lexer, block ? block->allocated * 2 : lexer->options.token_block_initial_size)))
+        {
+            return;
+        }
+    }
+
+    block->offsets[block->count] = (pyco_uint32)offset;
+    block->lengths[block->count] = (pyco_uint32)length;
+    block->payloads[block->count] = payload;
+    block->kinds[block->count] = type | flags;
+    block->count++;
+
+    lexer->tokens_count++;
 }
 
-pyco_uint32 _token_to_operator(const pyco_token *token)
+void _lexer_add_line(pyco_lexer *lexer, pyco_uint64 line_offset)
 {
-    if (token == PYCO_NULL || ~token->flags & PYCO_TOKEN_TYPE_SPECIAL)
+    if (lexer->lines_count == lexer->lines_allocated)
     {
-        return PYCO_OPERATOR_NONE;
+        pyco_uint64 lines_allocated = lexer->lines_allocated ? lexer->lines_allocated * 2 : lexer->options.line_index_initial_size;
+        pyco_uint32 *line_offsets = _pyco_realloc(&lexer->options.allocators, lexer->line_offsets, sizeof(pyco_uint32) * lexer->lines_allocated, sizeof(pyco_uint32) * lines_allocated);
+
+        if (!line_offsets)
+        {
+            return;
+        }
+
+        _count_allocation(&lexer->counters, sizeof(pyco_uint32) * lines_allocated, true);
+        lexer->line_offsets = line_offsets;
+        lexer->lines_allocated = lines_allocated;
     }
 
-    if (token->value[0] == ')' || token->value[0] == ']' || token->value[0] == '{' || token->value[0] == '}' || token->value[0] == ';')
+    lexer->line_offsets[lexer->lines_count++] = (pyco_uint32)line_offset;
+}
+
+typedef struct pyco_keyword
+{
+    const char *name;
+    pyco_uint32 length;
+    pyco_uint32 keyword;
+} pyco_keyword;
+
+// perfect hash over the keywords, (first byte + 12 * last byte + length) & 15 is unique for each of them
+static const pyco_keyword PYCO_LEXER_KEYWORDS[16] = {
+    [0] = {"return", 6, PYCO_KEYWORD_RETURN},
+    [1] = {"for", 3, PYCO_KEYWORD_FOR},
+    [3] = {"if", 2, PYCO_KEYWORD_IF},
+    [5] = {"else", 4, PYCO_KEYWORD_ELSE},
+    [6] = {"function", 8, PYCO_KEYWORD_FUNCTION},
+    [7] = {"continue", 8, PYCO_KEYWORD_CONTINUE},
+    [8] = {"while", 5, PYCO_KEYWORD_WHILE},
+    [9] = {"struct", 6, PYCO_KEYWORD_STRUCT},
+    [10] = {"do", 2, PYCO_KEYWORD_DO},
+    [11] = {"break", 5, PYCO_KEYWORD_BREAK},
+};
+
+static inline pyco_uint32 _lexer_find_keyword(const pyco_uint8 *text, pyco_uint64 length)
+{
+    if (length < 2 || length > 8)
     {
-        return PYCO_OPERATOR_NONE;
+        return PYCO_KEYWORD_NONE;
     }
 
-    pyco_uint32 operator = PYCO_OPERATOR_NONE;
-    pyco_uint32 assign_composite = PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE;
+    const pyco_keyword *entry = &PYCO_LEXER_KEYWORDS[(text[0] + 12 * text[length - 1] + length) & 15];
+
+    return entry->length == length && memcmp(entry->name, text, length) == 0 ? entry->keyword : PYCO_KEYWORD_NONE;
+}
+
+typedef struct pyco_operator_info
+{
+    pyco_uint32 operator;
+    pyco_uint8 prefix_power;  // 0 when the operator is not a prefix operator
+    pyco_uint8 postfix_power; // 0 when the operator is not a postfix operator
+    pyco_uint16 infix_powers; // left binding power in the high byte and right in the low one, 0 when not infix
+} pyco_operator_info;
+
+#define PYCO_OPERATOR_INFIX(left, right) (((left) << 8) | (right))
+
+// everything the parser needs to know about an operator, resolved once per token by the lexer
+static const pyco_operator_info PYCO_OPERATORS[PYCO_OPERATOR_ID_COUNT] = {
+    [PYCO_OPERATOR_ID_NONE] = {PYCO_OPERATOR_NONE},
+    [PYCO_OPERATOR_ID_INVALID] = {PYCO_OPERATOR_INVALID},
+    [PYCO_OPERATOR_ID_COLON] = {PYCO_OPERATOR_ASSIGN_TYPE},
+    [PYCO_OPERATOR_ID_DECLARE] = {PYCO_OPERATOR_ASSIGN_TYPE | PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE},
+    [PYCO_OPERATOR_ID_DECLARE_CONST] = {PYCO_OPERATOR_ASSIGN_TYPE | PYCO_OPERATOR_ASSIGN_CONST | PYCO_OPERATOR_COMPOSITE},
+    [PYCO_OPERATOR_ID_PLUS] = {PYCO_OPERATOR_ADD, 0, 0, PYCO_OPERATOR_INFIX(5, 6)},
+    [PYCO_OPERATOR_ID_PLUS_ASSIGN] = {PYCO_OPERATOR_ADD | PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(2, 1)},
+    [PYCO_OPERATOR_ID_INCREMENT] = {PYCO_OPERATOR_INCREMENT | PYCO_OPERATOR_COMPOSITE, 0, 11},
+    [PYCO_OPERATOR_ID_MINUS] = {PYCO_OPERATOR_SUBTRACT, 0, 0, PYCO_OPERATOR_INFIX(5, 6)},
+    [PYCO_OPERATOR_ID_MINUS_ASSIGN] = {PYCO_OPERATOR_SUBTRACT | PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(2, 1)},
+    [PYCO_OPERATOR_ID_DECREMENT] = {PYCO_OPERATOR_DECREMENT | PYCO_OPERATOR_COMPOSITE, 0, 11},
+    [PYCO_OPERATOR_ID_STAR] = {PYCO_OPERATOR_MULTIPLY, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_STAR_ASSIGN] = {PYCO_OPERATOR_MULTIPLY | PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(2, 1)},
+    [PYCO_OPERATOR_ID_SLASH] = {PYCO_OPERATOR_DIVIDE, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_SLASH_ASSIGN] = {PYCO_OPERATOR_DIVIDE | PYCO_OPERATOR_ASSIGN | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(2, 1)},
+    [PYCO_OPERATOR_ID_ASSIGN] = {PYCO_OPERATOR_ASSIGN, 0, 0, PYCO_OPERATOR_INFIX(2, 1)},
+    [PYCO_OPERATOR_ID_EQUAL] = {PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_LESS] = {PYCO_OPERATOR_LESS, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_LESS_EQUAL] = {PYCO_OPERATOR_LESS | PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_LEFT_SHIFT] = {PYCO_OPERATOR_LEFT_SHIFT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE},
+    [PYCO_OPERATOR_ID_GREATER] = {PYCO_OPERATOR_GREATER, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_GREATER_EQUAL] = {PYCO_OPERATOR_GREATER | PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE, 0, 0, PYCO_OPERATOR_INFIX(7, 8)},
+    [PYCO_OPERATOR_ID_RIGHT_SHIFT] = {PYCO_OPERATOR_RIGHT_SHIFT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE},
+    [PYCO_OPERATOR_ID_NOT] = {PYCO_OPERATOR_NOT, 9},
+    [PYCO_OPERATOR_ID_BITWISE_NOT] = {PYCO_OPERATOR_NOT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE},
+    [PYCO_OPERATOR_ID_TERNARY] = {PYCO_OPERATOR_TERNARY, 0, 0, PYCO_OPERATOR_INFIX(4, 3)},
+    [PYCO_OPERATOR_ID_GROUPING] = {PYCO_OPERATOR_GROUPING},
+    [PYCO_OPERATOR_ID_ARRAY_INDEX] = {PYCO_OPERATOR_ARRAY_INDEX, 0, 11},
+    [PYCO_OPERATOR_ID_MEMBER_ACCESS] = {PYCO_OPERATOR_MEMBER_ACCESS, 0, 0, PYCO_OPERATOR_INFIX(14, 13)},
+};
+
+// operator of every single byte special token, closing brackets and ';' end expressions and have none
+static const pyco_uint8 PYCO_LEXER_OPERATOR_IDS[256] = {
+    ['!'] = PYCO_OPERATOR_ID_NOT,
+    ['#'] = PYCO_OPERATOR_ID_INVALID,
+    ['$'] = PYCO_OPERATOR_ID_INVALID,
+    ['%'] = PYCO_OPERATOR_ID_INVALID,
+    ['&'] = PYCO_OPERATOR_ID_INVALID,
+    ['\''] = PYCO_OPERATOR_ID_INVALID,
+    ['('] = PYCO_OPERATOR_ID_GROUPING,
+    ['*'] = PYCO_OPERATOR_ID_STAR,
+    ['+'] = PYCO_OPERATOR_ID_PLUS,
+    [','] = PYCO_OPERATOR_ID_INVALID,
+    ['-'] = PYCO_OPERATOR_ID_MINUS,
+    ['.'] = PYCO_OPERATOR_ID_MEMBER_ACCESS,
+    ['/'] = PYCO_OPERATOR_ID_SLASH,
+    [':'] = PYCO_OPERATOR_ID_COLON,
+    ['<'] = PYCO_OPERATOR_ID_LESS,
+    ['='] = PYCO_OPERATOR_ID_ASSIGN,
+    ['>'] = PYCO_OPERATOR_ID_GREATER,
+    ['?'] = PYCO_OPERATOR_ID_TERNARY,
+    ['@'] = PYCO_OPERATOR_ID_INVALID,
+    ['['] = PYCO_OPERATOR_ID_ARRAY_INDEX,
+    ['\\'] = PYCO_OPERATOR_ID_INVALID,
+    ['^'] = PYCO_OPERATOR_ID_INVALID,
+    ['|'] = PYCO_OPERATOR_ID_INVALID,
+    ['~'] = PYCO_OPERATOR_ID_BITWISE_NOT,
+};
+
+// the automaton only fuses the pairs listed here, the second byte is one of ':', '=', '+', '-', '<' or '>'
+static inline pyco_uint32 _lexer_find_fused_operator(pyco_uint8 first, pyco_uint8 second)
+{
+    if (second == '=')
+    {
+        switch (first)
+        {
+        case ':':
+            return PYCO_OPERATOR_ID_DECLARE;
+        case '+':
+            return PYCO_OPERATOR_ID_PLUS_ASSIGN;
+        case '-':
+            return PYCO_OPERATOR_ID_MINUS_ASSIGN;
+        case '*':
+            return PYCO_OPERATOR_ID_STAR_ASSIGN;
+        case '/':
+            return PYCO_OPERATOR_ID_SLASH_ASSIGN;
+        case '=':
+            return PYCO_OPERATOR_ID_EQUAL;
+        case '<':
+            return PYCO_OPERATOR_ID_LESS_EQUAL;
+        case '>':
+            return PYCO_OPERATOR_ID_GREATER_EQUAL;
+        }
+    }
 
-    switch (token->value[0])
+    switch (first)
     {
     case ':':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_ASSIGN_TYPE | assign_composite : _is_successive(token, ':') ? PYCO_OPERATOR_ASSIGN_TYPE | PYCO_OPERATOR_ASSIGN_CONST | PYCO_OPERATOR_COMPOSITE
-                                                                                                                      : PYCO_OPERATOR_ASSIGN_TYPE;
+        return PYCO_OPERATOR_ID_DECLARE_CONST;
     case '+':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_ADD | assign_composite : _is_successive(token, '+') ? PYCO_OPERATOR_INCREMENT | PYCO_OPERATOR_COMPOSITE
-                                                                                                              : PYCO_OPERATOR_ADD;
+        return PYCO_OPERATOR_ID_INCREMENT;
     case '-':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_SUBTRACT | assign_composite : _is_successive(token, '-') ? PYCO_OPERATOR_DECREMENT | PYCO_OPERATOR_COMPOSITE
-                                                                                                                   : PYCO_OPERATOR_SUBTRACT;
-    case '*':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_MULTIPLY | assign_composite : PYCO_OPERATOR_MULTIPLY;
-    case '/':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_DIVIDE | assign_composite : _is_successive(token, '/') ? PYCO_OPERATOR_NONE | PYCO_OPERATOR_COMPOSITE
-                                                                                                                 : PYCO_OPERATOR_DIVIDE;
-    case '=':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE : PYCO_OPERATOR_ASSIGN;
+        return PYCO_OPERATOR_ID_DECREMENT;
     case '<':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_LESS | PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE : _is_successive(token, '<') ? PYCO_OPERATOR_LEFT_SHIFT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE
-                                                                                                                                            : PYCO_OPERATOR_LESS;
+        return PYCO_OPERATOR_ID_LEFT_SHIFT;
     case '>':
-        return _is_successive(token, '=') ? PYCO_OPERATOR_GREATER | PYCO_OPERATOR_EQUAL | PYCO_OPERATOR_COMPOSITE : _is_successive(token, '>') ? PYCO_OPERATOR_RIGHT_SHIFT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE
-                                                                                                                                               : PYCO_OPERATOR_GREATER;
-    case '!':
-        return PYCO_OPERATOR_NOT;
-    case '~':
-        return PYCO_OPERATOR_NOT | PYCO_OPERATOR_BITWISE | PYCO_OPERATOR_COMPOSITE;
-    case '?':
-        return PYCO_OPERATOR_TERNARY;
-    case '(':
-        return PYCO_OPERATOR_GROUPING;
-    case '[':
-        return PYCO_OPERATOR_ARRAY_INDEX;
-    case '.':
-        return PYCO_OPERATOR_MEMBER_ACCESS;
+        return PYCO_OPERATOR_ID_RIGHT_SHIFT;
+    }
+
+    return PYCO_OPERATOR_ID_INVALID;
+}
+
+// every byte maps to a character class, bytes that are not listed (letters, '_', control bytes and
+// everything above 0x7F) fall into the zero class and continue identifiers
+enum PYCO_CHAR_CLASS
+{
+    PYCO_CHAR_CLASS_IDENTIFIER = 0,
+    PYCO_CHAR_CLASS_F,
+    PYCO_CHAR_CLASS_DIGIT,
+    PYCO_CHAR_CLASS_DOT,
+    PYCO_CHAR_CLASS_SPACE,
+    PYCO_CHAR_CLASS_TAB,
+    PYCO_CHAR_CLASS_LINE_FEED,
+    PYCO_CHAR_CLASS_CARRIAGE_RETURN,
+    PYCO_CHAR_CLASS_QUOTE,
+    PYCO_CHAR_CLASS_BACKTICK,
+    PYCO_CHAR_CLASS_COLON,
+    PYCO_CHAR_CLASS_PLUS,
+    PYCO_CHAR_CLASS_MINUS,
+    PYCO_CHAR_CLASS_STAR,
+    PYCO_CHAR_CLASS_SLASH,
+    PYCO_CHAR_CLASS_EQUAL,
+    PYCO_CHAR_CLASS_LESS,
+    PYCO_CHAR_CLASS_GREATER,
+    PYCO_CHAR_CLASS_SPECIAL,
+    PYCO_CHAR_CLASS_COUNT,
+};
+
+// the states up to PYCO_LEXER_STATE_LAST_RUN can skip ahead with the run scanners,
+// a zero transition ends the token before the current byte
+enum PYCO_LEXER_STATE
+{
+    PYCO_LEXER_STATE_STOP = 0,
+    PYCO_LEXER_STATE_IDENTIFIER,
+    PYCO_LEXER_STATE_STRING,
+    PYCO_LEXER_STATE_TEMPLATE,
+    PYCO_LEXER_STATE_COMMENT,
+    PYCO_LEXER_STATE_LAST_RUN = PYCO_LEXER_STATE_COMMENT,
+    PYCO_LEXER_STATE_START,
+    PYCO_LEXER_STATE_SPACES,
+    PYCO_LEXER_STATE_TABS,
+    PYCO_LEXER_STATE_INTEGER,
+    PYCO_LEXER_STATE_DOUBLE,
+    PYCO_LEXER_STATE_FLOAT,
+    PYCO_LEXER_STATE_MALFORMED_INTEGER,
+    PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+    PYCO_LEXER_STATE_LINE_FEED,
+    PYCO_LEXER_STATE_CARRIAGE_RETURN,
+    PYCO_LEXER_STATE_STRING_CLOSED,
+    PYCO_LEXER_STATE_TEMPLATE_CLOSED,
+    PYCO_LEXER_STATE_COLON,
+    PYCO_LEXER_STATE_PLUS,
+    PYCO_LEXER_STATE_MINUS,
+    PYCO_LEXER_STATE_STAR,
+    PYCO_LEXER_STATE_SLASH,
+    PYCO_LEXER_STATE_EQUAL,
+    PYCO_LEXER_STATE_LESS,
+    PYCO_LEXER_STATE_GREATER,
+    PYCO_LEXER_STATE_SPECIAL,
+    PYCO_LEXER_STATE_COUNT,
+};
+
+static const pyco_uint8 PYCO_LEXER_CHAR_CLASSES[256] = {
+    ['f'] = PYCO_CHAR_CLASS_F,
+    ['0'] = PYCO_CHAR_CLASS_DIGIT,
+    ['1'] = PYCO_CHAR_CLASS_DIGIT,
+    ['2'] = PYCO_CHAR_CLASS_DIGIT,
+    ['3'] = PYCO_CHAR_CLASS_DIGIT,
+    ['4'] = PYCO_CHAR_CLASS_DIGIT,
+    ['5'] = PYCO_CHAR_CLASS_DIGIT,
+    ['6'] = PYCO_CHAR_CLASS_DIGIT,
+    ['7'] = PYCO_CHAR_CLASS_DIGIT,
+    ['8'] = PYCO_CHAR_CLASS_DIGIT,
+    ['9'] = PYCO_CHAR_CLASS_DIGIT,
+    ['.'] = PYCO_CHAR_CLASS_DOT,
+    [' '] = PYCO_CHAR_CLASS_SPACE,
+    ['\t'] = PYCO_CHAR_CLASS_TAB,
+    ['\n'] = PYCO_CHAR_CLASS_LINE_FEED,
+    ['\r'] = PYCO_CHAR_CLASS_CARRIAGE_RETURN,
+    ['"'] = PYCO_CHAR_CLASS_QUOTE,
+    ['`'] = PYCO_CHAR_CLASS_BACKTICK,
+    [':'] = PYCO_CHAR_CLASS_COLON,
+    ['+'] = PYCO_CHAR_CLASS_PLUS,
+    ['-'] = PYCO_CHAR_CLASS_MINUS,
+    ['*'] = PYCO_CHAR_CLASS_STAR,
+    ['/'] = PYCO_CHAR_CLASS_SLASH,
+    ['='] = PYCO_CHAR_CLASS_EQUAL,
+    ['<'] = PYCO_CHAR_CLASS_LESS,
+    ['>'] = PYCO_CHAR_CLASS_GREATER,
+    ['!'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['#'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['$'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['%'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['&'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['\''] = PYCO_CHAR_CLASS_SPECIAL,
+    ['('] = PYCO_CHAR_CLASS_SPECIAL,
+    [')'] = PYCO_CHAR_CLASS_SPECIAL,
+    [','] = PYCO_CHAR_CLASS_SPECIAL,
+    [';'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['?'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['@'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['['] = PYCO_CHAR_CLASS_SPECIAL,
+    ['\\'] = PYCO_CHAR_CLASS_SPECIAL,
+    [']'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['^'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['{'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['|'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['}'] = PYCO_CHAR_CLASS_SPECIAL,
+    ['~'] = PYCO_CHAR_CLASS_SPECIAL,
+};
+
+// two character operators (:= :: ++ += -- -= *= /= == <= << >= >>) are single tokens, '//' starts a comment
+static const pyco_uint8 PYCO_LEXER_TRANSITIONS[PYCO_LEXER_STATE_COUNT][PYCO_CHAR_CLASS_COUNT] = {
+    [PYCO_LEXER_STATE_START] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_IDENTIFIER,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_IDENTIFIER,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_INTEGER,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_SPACE] = PYCO_LEXER_STATE_SPACES,
+        [PYCO_CHAR_CLASS_TAB] = PYCO_LEXER_STATE_TABS,
+        [PYCO_CHAR_CLASS_LINE_FEED] = PYCO_LEXER_STATE_LINE_FEED,
+        [PYCO_CHAR_CLASS_CARRIAGE_RETURN] = PYCO_LEXER_STATE_CARRIAGE_RETURN,
+        [PYCO_CHAR_CLASS_QUOTE] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_BACKTICK] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_COLON] = PYCO_LEXER_STATE_COLON,
+        [PYCO_CHAR_CLASS_PLUS] = PYCO_LEXER_STATE_PLUS,
+        [PYCO_CHAR_CLASS_MINUS] = PYCO_LEXER_STATE_MINUS,
+        [PYCO_CHAR_CLASS_STAR] = PYCO_LEXER_STATE_STAR,
+        [PYCO_CHAR_CLASS_SLASH] = PYCO_LEXER_STATE_SLASH,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_EQUAL,
+        [PYCO_CHAR_CLASS_LESS] = PYCO_LEXER_STATE_LESS,
+        [PYCO_CHAR_CLASS_GREATER] = PYCO_LEXER_STATE_GREATER,
+        [PYCO_CHAR_CLASS_SPECIAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_IDENTIFIER] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_IDENTIFIER,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_IDENTIFIER,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_IDENTIFIER,
+    },
+    [PYCO_LEXER_STATE_INTEGER] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_MALFORMED_INTEGER,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_MALFORMED_INTEGER,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_INTEGER,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_DOUBLE,
+    },
+    [PYCO_LEXER_STATE_DOUBLE] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_FLOAT,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_DOUBLE,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+    },
+    [PYCO_LEXER_STATE_FLOAT] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+    },
+    [PYCO_LEXER_STATE_MALFORMED_INTEGER] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_MALFORMED_INTEGER,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_MALFORMED_INTEGER,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_MALFORMED_INTEGER,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+    },
+    [PYCO_LEXER_STATE_MALFORMED_DOUBLE] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_MALFORMED_DOUBLE,
+    },
+    [PYCO_LEXER_STATE_SPACES] = {
+        [PYCO_CHAR_CLASS_SPACE] = PYCO_LEXER_STATE_SPACES,
+    },
+    [PYCO_LEXER_STATE_TABS] = {
+        [PYCO_CHAR_CLASS_TAB] = PYCO_LEXER_STATE_TABS,
+    },
+    [PYCO_LEXER_STATE_CARRIAGE_RETURN] = {
+        [PYCO_CHAR_CLASS_LINE_FEED] = PYCO_LEXER_STATE_LINE_FEED,
+    },
+    [PYCO_LEXER_STATE_STRING] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_SPACE] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_TAB] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_QUOTE] = PYCO_LEXER_STATE_STRING_CLOSED,
+        [PYCO_CHAR_CLASS_BACKTICK] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_COLON] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_PLUS] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_MINUS] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_STAR] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_SLASH] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_LESS] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_GREATER] = PYCO_LEXER_STATE_STRING,
+        [PYCO_CHAR_CLASS_SPECIAL] = PYCO_LEXER_STATE_STRING,
+    },
+    [PYCO_LEXER_STATE_TEMPLATE] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_SPACE] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_TAB] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_LINE_FEED] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_CARRIAGE_RETURN] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_QUOTE] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_BACKTICK] = PYCO_LEXER_STATE_TEMPLATE_CLOSED,
+        [PYCO_CHAR_CLASS_COLON] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_PLUS] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_MINUS] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_STAR] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_SLASH] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_LESS] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_GREATER] = PYCO_LEXER_STATE_TEMPLATE,
+        [PYCO_CHAR_CLASS_SPECIAL] = PYCO_LEXER_STATE_TEMPLATE,
+    },
+    [PYCO_LEXER_STATE_COMMENT] = {
+        [PYCO_CHAR_CLASS_IDENTIFIER] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_F] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_DIGIT] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_DOT] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_SPACE] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_TAB] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_QUOTE] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_BACKTICK] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_COLON] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_PLUS] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_MINUS] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_STAR] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_SLASH] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_LESS] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_GREATER] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_SPECIAL] = PYCO_LEXER_STATE_COMMENT,
+    },
+    [PYCO_LEXER_STATE_COLON] = {
+        [PYCO_CHAR_CLASS_COLON] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_PLUS] = {
+        [PYCO_CHAR_CLASS_PLUS] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_MINUS] = {
+        [PYCO_CHAR_CLASS_MINUS] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_STAR] = {
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_SLASH] = {
+        [PYCO_CHAR_CLASS_SLASH] = PYCO_LEXER_STATE_COMMENT,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_EQUAL] = {
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_LESS] = {
+        [PYCO_CHAR_CLASS_LESS] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+    [PYCO_LEXER_STATE_GREATER] = {
+        [PYCO_CHAR_CLASS_GREATER] = PYCO_LEXER_STATE_SPECIAL,
+        [PYCO_CHAR_CLASS_EQUAL] = PYCO_LEXER_STATE_SPECIAL,
+    },
+};
+
+// identifiers, strings and comments can be long, their bodies are skipped with the run scanners,
+// whitespace is mostly a single byte between tokens and stays in the automaton
+static inline pyco_uint64 _lexer_skip_run(pyco_lexer *lexer, pyco_uint8 state, const pyco_uint8 *data, pyco_uint64 offset, pyco_uint64 size)
+{
+    switch (state)
+    {
+    case PYCO_LEXER_STATE_IDENTIFIER:
+        return lexer->scanner.identifier_end(data, offset, size);
+    case PYCO_LEXER_STATE_STRING:
+        return lexer->scanner.string_end(data, offset, size, '"');
+    case PYCO_LEXER_STATE_TEMPLATE:
+        return lexer->scanner.string_end(data, offset, size, '`');
+    case PYCO_LEXER_STATE_COMMENT:
+        return lexer->scanner.string_end(data, offset, size, '\n');
+    }
+
+    return offset;
+}
+
+void _lexer_add_string(pyco_lexer *lexer, pyco_uint8 state, pyco_uint64 token_start, pyco_uint64 token_end)
+{
+    const bool closed = state == PYCO_LEXER_STATE_STRING_CLOSED || state == PYCO_LEXER_STATE_TEMPLATE_CLOSED;
+    const pyco_uint8 token_type = state == PYCO_LEXER_STATE_TEMPLATE || state == PYCO_LEXER_STATE_TEMPLATE_CLOSED
+                                      ? PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL
+                                      : PYCO_TOKEN_TYPE_STRING;
+
+    if (token_type == PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL)
+    {
+        const pyco_uint8 *data = lexer->source;
+
+        // a \r\n pair starts a single line, it is recorded once the \n is reached
+        for (pyco_uint64 offset = token_start + 1; offset < token_end; offset++)
+        {
+            if (data[offset] == '\n' || (data[offset] == '\r' && (offset + 1 == token_end || data[offset + 1] != '\n')))
+            {
+                _lexer_add_line(lexer, offset + 1);
+            }
+        }
     }
 
-    return PYCO_OPERATOR_INVALID;
+    // the token value is the string body, without the brackets
+    _lexer_add_token(lexer, token_start + 1, token_end - token_start - (closed ? 2 : 1), token_type, closed ? 0 : PYCO_TOKEN_FLAG_ERROR_INCOMPLETE, 0);
 }
 
-inline pyco_uint16 _encode_powers(pyco_uint8 left, pyco_uint8 right)
+// token kind of the states that end in a plain token, the remaining states are handled in _lexer_accept
+static const pyco_uint8 PYCO_LEXER_STATE_TOKENS[PYCO_LEXER_STATE_COUNT] = {
+    [PYCO_LEXER_STATE_INTEGER] = PYCO_TOKEN_TYPE_INTEGER,
+    [PYCO_LEXER_STATE_DOUBLE] = PYCO_TOKEN_TYPE_DOUBLE,
+    [PYCO_LEXER_STATE_FLOAT] = PYCO_TOKEN_TYPE_FLOAT,
+    [PYCO_LEXER_STATE_MALFORMED_INTEGER] = PYCO_TOKEN_TYPE_INTEGER | PYCO_TOKEN_FLAG_ERROR_MALFORMED,
+    [PYCO_LEXER_STATE_MALFORMED_DOUBLE] = PYCO_TOKEN_TYPE_DOUBLE | PYCO_TOKEN_FLAG_ERROR_MALFORMED,
+    [PYCO_LEXER_STATE_COLON] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_PLUS] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_MINUS] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_STAR] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_SLASH] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_EQUAL] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_LESS] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_GREATER] = PYCO_TOKEN_TYPE_SPECIAL,
+    [PYCO_LEXER_STATE_SPECIAL] = PYCO_TOKEN_TYPE_SPECIAL,
+};
+
+static inline bool _token_type_is_number(pyco_uint8 type)
 {
-    return (left << 8) | right;
+    return (pyco_uint8)(type - PYCO_TOKEN_TYPE_INTEGER) <= PYCO_TOKEN_TYPE_DOUBLE - PYCO_TOKEN_TYPE_INTEGER;
 }
 
-inline pyco_uint16 _parser_get_prefix_binding_power(pyco_uint32 operator)
+// the automaton already checked the digits, so decoding needs no validation
+static inline pyco_uint64 _lexer_decode_integer(const pyco_uint8 *text, pyco_uint64 length, pyco_uint32 *literal_flags)
 {
-    switch (operator)
+    // 19 digits always fit in 64 bits, only the ones after them are checked
+    const pyco_uint64 unchecked = length < 19 ? length : 19;
+    pyco_uint64 value = 0;
+    pyco_uint64 index = 0;
+
+    for (; index < unchecked; index++)
+    {
+        value = value * 10 + (text[index] - '0');
+    }
+
+    for (; index < length; index++)
+    {
+        const pyco_uint64 digit = text[index] - '0';
+
+        if (value > (~0ull - digit) / 10)
+        {
+            *literal_flags |= PYCO_LITERAL_FLAG_OVERFLOW;
+            return ~0ull;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    return value;
+}
+
+static inline pyco_uint32 _lexer_hex_digit(pyco_uint8 c)
+{
+    if ((pyco_uint8)(c - '0') < 10)
+    {
+        return c - '0';
+    }
+
+    c |= 0x20;
+
+    return (pyco_uint8)(c - 'a') < 6 ? c - 'a' + 10 : 16;
+}
+
+// hex literals end up as malformed integers in the automaton, `0x` is not worth its own states
+static inline bool _lexer_is_hex(const pyco_uint8 *text, pyco_uint64 length)
+{
+    if (length < 3 || text[0] != '0' || (text[1] | 0x20) != 'x')
     {
-    case PYCO_OPERATOR_NOT:
-        return 9;
+        return false;
+    }
+
+    for (pyco_uint64 index = 2; index < length; index++)
+    {
+        if (_lexer_hex_digit(text[index]) > 15)
+        {
+            return false;
+        }
     }
 
-    return 0;
-}
+    return true;
+}
+
+static inline pyco_uint64 _lexer_decode_hex(const pyco_uint8 *text, pyco_uint64 length, pyco_uint32 *literal_flags)
+{
+    pyco_uint64 value = 0;
+
+    for (pyco_uint64 index = 2; index < length; index++)
+    {
+        if (value >> 60)
+        {
+            *literal_flags |= PYCO_LITERAL_FLAG_OVERFLOW;
+            return ~0ull;
+        }
+
+        value = (value << 4) | _lexer_hex_digit(text[index]);
+    }
+
+    return value;
+}
+
+// strtod reads the decimal point of the locale the host set, the literals of a script always use '.'
+static double _lexer_strtod_c(pyco_lexer *lexer, const char *buffer, bool is_float)
+{
+    if (!lexer->numeric_locale)
+    {
+#if defined(_WIN32)
+        lexer->numeric_locale = _create_locale(LC_NUMERIC, "C");
+#else
+        lexer->numeric_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+#endif
+    }
+
+    // without a locale object the host locale is all there is
+    if (!lexer->numeric_locale)
+    {
+        return is_float ? (double)strtof(buffer, PYCO_NULL) : strtod(buffer, PYCO_NULL);
+    }
+
+#if defined(_WIN32)
+    return is_float ? (double)_strtof_l(buffer, PYCO_NULL, lexer->numeric_locale) : _strtod_l(buffer, PYCO_NULL, lexer->numeric_locale);
+#else
+    return is_float ? (double)strtof_l(buffer, PYCO_NULL, lexer->numeric_locale) : strtod_l(buffer, PYCO_NULL, lexer->numeric_locale);
+#endif
+}
+
+// the libc conversion is exact for any input but needs a terminated copy
+double _lexer_decode_real_slow(pyco_lexer *lexer, const pyco_uint8 *text, pyco_uint64 length, bool is_float)
+{
+    char stack_buffer[128];
+    char *buffer = length < sizeof(stack_buffer) ? stack_buffer : _pyco_malloc(&lexer->options.allocators, length + 1);
+
+    if (!buffer)
+    {
+        return 0;
+    }
+
+    if (buffer != stack_buffer)
+    {
+        _count_allocation(&lexer->counters, length + 1, false);
+    }
+
+    memcpy(buffer, text, length);
+    buffer[length] = 0;
+
+    const double value = _lexer_strtod_c(lexer, buffer, is_float);
+
+    if (buffer != stack_buffer)
+    {
+        _pyco_free(&lexer->options.allocators, buffer);
+    }
+
+    return value;
+}
+
+static const double PYCO_LEXER_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// `digits.digits` with the `f` suffix already cut off. a mantissa and power of ten that are both exact in
+// the target type give a correctly rounded result with one division, only the rest goes to the slow path
+static inline double _lexer_decode_real(pyco_lexer *lexer, const pyco_uint8 *text, pyco_uint64 length, bool is_float, pyco_uint32 *literal_flags)
+{
+    pyco_uint64 mantissa = 0;
+    pyco_uint32 digits = 0;
+    pyco_uint32 fraction_digits = 0;
+    bool fraction = false;
+    bool exact = true;
+
+    for (pyco_uint64 index = 0; index < length; index++)
+    {
+        if (text[index] == '.')
+        {
+            fraction = true;
+            continue;
+        }
+
+        const pyco_uint64 digit = text[index] - '0';
+
+        fraction_digits += fraction;
+
+        if (!mantissa && !digit)
+        {
+            continue;
+        }
+
+        if (++digits > 19)
+        {
+            exact = false;
+            break;
+        }
+
+        mantissa = mantissa * 10 + digit;
+    }
+
+#if FLT_EVAL_METHOD == 0
+    if (exact && is_float && mantissa <= (1ull << 24) && fraction_digits <= 10)
+    {
+        return (float)mantissa / (float)PYCO_LEXER_POWERS_OF_TEN[fraction_digits];
+    }
+
+    if (exact && !is_float && mantissa <= (1ull << 53) && fraction_digits <= 22)
+    {
+        return (double)mantissa / PYCO_LEXER_POWERS_OF_TEN[fraction_digits];
+    }
+#endif
+
+    const double value = _lexer_decode_real_slow(lexer, text, length, is_float);
+
+    if (value > (is_float ? FLT_MAX : DBL_MAX))
+    {
+        *literal_flags |= PYCO_LITERAL_FLAG_OVERFLOW;
+    }
+
+    return value;
+}
+
+static inline void _lexer_add_number(pyco_lexer *lexer, pyco_uint8 state, pyco_uint64 token_start, pyco_uint64 token_end)
+{
+    const pyco_uint8 *text = lexer->source + token_start;
+    const pyco_uint64 length = token_end - token_start;
+    pyco_uint8 kind = PYCO_LEXER_STATE_TOKENS[state];
+    pyco_uint32 literal_flags = 0;
+    pyco_literal_value value = {0};
+
+    switch (state)
+    {
+    case PYCO_LEXER_STATE_INTEGER:
+        value.integer = _lexer_decode_integer(text, length, &literal_flags);
+        break;
+    case PYCO_LEXER_STATE_DOUBLE:
+        value.real = _lexer_decode_real(lexer, text, length, false, &literal_flags);
+        break;
+    case PYCO_LEXER_STATE_FLOAT:
+        value.real = _lexer_decode_real(lexer, text, length - 1, true, &literal_flags);
+        break;
+    case PYCO_LEXER_STATE_MALFORMED_INTEGER:
+        if (_lexer_is_hex(text, length))
+        {
+            kind = PYCO_TOKEN_TYPE_INTEGER;
+            literal_flags |= PYCO_LITERAL_FLAG_HEX;
+            value.integer = _lexer_decode_hex(text, length, &literal_flags);
+        }
+        break;
+    }
+
+    const pyco_uint64 tokens_count = lexer->tokens_count;
+
+    lexer->track_indents = 0;
+    _lexer_add_token(lexer, token_start, length, kind & PYCO_TOKEN_TYPE_MASK, kind & ~PYCO_TOKEN_TYPE_MASK, 0);
+
+    if (lexer->tokens_count == tokens_count)
+    {
+        return;
+    }
+
+    pyco_token_block *block = lexer->token_block_last;
+    pyco_uint64 slot = block->count - 1;
+
+    if (!lexer->token_ring)
+    {
+        // like a token that finds no block, a number whose value has nowhere to go is dropped
+        if (!_token_block_reserve_literals(block, &lexer->options.allocators, &lexer->counters, block->literals_count + 1))
+        {
+            block->count--;
+            lexer->tokens_count--;
+            return;
+        }
+
+        slot = block->literals_count++;
+    }
+
+    block->literals[slot] = (pyco_literal){
+        .value = value,
+        .flags = literal_flags,
+    };
+    block->payloads[block->count - 1] = (pyco_uint32)slot;
+}
+
+// turns the state the automaton stopped in into a token
+static inline void _lexer_accept(pyco_lexer *lexer, pyco_uint8 state, pyco_uint64 token_start, pyco_uint64 token_end)
+{
+    const pyco_uint8 kind = PYCO_LEXER_STATE_TOKENS[state];
+
+    if (state == PYCO_LEXER_STATE_IDENTIFIER)
+    {
+        const pyco_uint8 *text = lexer->source + token_start;
+        const pyco_uint32 keyword = _lexer_find_keyword(text, token_end - token_start);
+
+        lexer->track_indents = 0;
+
+        if (keyword)
+        {
+            _lexer_add_token(lexer, token_start, token_end - token_start, PYCO_TOKEN_TYPE_KEYWORD, 0, keyword);
+        }
+        else
+        {
+            _lexer_add_token(lexer, token_start, token_end - token_start, PYCO_TOKEN_TYPE_IDENTIFIER, 0, pyco_symbol_table_intern(lexer->symbols, text, token_end - token_start));
+        }
+
+        return;
+    }
+
+    if (kind == PYCO_TOKEN_TYPE_SPECIAL)
+    {
+        const pyco_uint8 *text = lexer->source + token_start;
+        const pyco_uint32 operator_id = token_end - token_start == 1 ? PYCO_LEXER_OPERATOR_IDS[text[0]] : _lexer_find_fused_operator(text[0], text[1]);
+
+        lexer->track_indents = 0;
+        _lexer_add_token(lexer, token_start, token_end - token_start, PYCO_TOKEN_TYPE_SPECIAL, 0, operator_id);
+        return;
+    }
+
+    if (_token_type_is_number(kind & PYCO_TOKEN_TYPE_MASK))
+    {
+        _lexer_add_number(lexer, state, token_start, token_end);
+        return;
+    }
+
+    if (kind)
+    {
+        lexer->track_indents = 0;
+        _lexer_add_token(lexer, token_start, token_end - token_start, kind & PYCO_TOKEN_TYPE_MASK, kind & ~PYCO_TOKEN_TYPE_MASK, 0);
+        return;
+    }
+
+    switch (state)
+    {
+    case PYCO_LEXER_STATE_LINE_FEED:
+    case PYCO_LEXER_STATE_CARRIAGE_RETURN:
+        _lexer_add_line(lexer, token_end);
+        lexer->track_indents = 1;
+        lexer->line_start = 1;
+        return;
+    case PYCO_LEXER_STATE_SPACES:
+    case PYCO_LEXER_STATE_TABS:
+        if (lexer->track_indents)
+        {
+            _lexer_add_token(lexer, token_start, token_end - token_start, state == PYCO_LEXER_STATE_TABS ? PYCO_TOKEN_TYPE_INDENT_TAB : PYCO_TOKEN_TYPE_INDENT_SPACE, 0, 0);
+        }
+        return;
+    case PYCO_LEXER_STATE_STRING:
+    case PYCO_LEXER_STATE_STRING_CLOSED:
+    case PYCO_LEXER_STATE_TEMPLATE:
+    case PYCO_LEXER_STATE_TEMPLATE_CLOSED:
+        lexer->track_indents = 0;
+        _lexer_add_string(lexer, state, token_start, token_end);
+        return;
+    }
+}
+
+pyco_lexer_options lexer_initialize_options()
+{
+    return (pyco_lexer_options){
+        .token_block_initial_size = 1000,
+        .line_index_initial_size = 256,
+        .source_initial_size = 64 * 1024,
+        .token_window_size = 0,
+        .scanner = PYCO_SCANNER_AUTO,
+        .copy_source = 1,
+        .symbols = PYCO_NULL,
+        .symbol_table_initial_size = 256,
+        .allocators = {
+            .malloc = PYCO_NULL,
+            .realloc = PYCO_NULL,
+            .free = PYCO_NULL,
+        }};
+}
+
+pyco_lexer *lexer_create(pyco_lexer_options options)
+{
+    if (!options.allocators.malloc || !options.allocators.realloc || !options.allocators.free)
+    {
+        return PYCO_NULL;
+    }
+
+    if (!options.token_block_initial_size || !options.line_index_initial_size || !options.source_initial_size)
+    {
+        return PYCO_NULL;
+    }
+
+    pyco_lexer *lexer = _pyco_malloc(&options.allocators, sizeof(pyco_lexer));
+
+    if (!lexer)
+    {
+        return PYCO_NULL;
+    }
+
+    lexer->options = options;
+    lexer->scanner = scanner_select(options.scanner);
+    lexer->symbols = options.symbols;
+    lexer->owns_symbols = !options.symbols;
+
+    if (lexer->owns_symbols && !(lexer->symbols = pyco_symbol_table_create(options.allocators, options.symbol_table_initial_size)))
+    {
+        _pyco_free(&options.allocators, lexer);
+        return PYCO_NULL;
+    }
+
+    lexer->track_indents = 1;
+    lexer->line_start = 1;
+    lexer->source = PYCO_NULL;
+    lexer->source_copy = PYCO_NULL;
+    lexer->source_size = 0;
+    lexer->source_allocated = 0;
+    lexer->scan_offset = 0;
+    lexer->scan_token_start = 0;
+    lexer->scan_state = PYCO_LEXER_STATE_START;
+    lexer->tokens_count = 0;
+    lexer->token_block_first = PYCO_NULL;
+    lexer->token_block_last = PYCO_NULL;
+    lexer->token_ring = PYCO_NULL;
+    lexer->scan_token_limit = ~0ull;
+    lexer->previous_token_end = PYCO_LEXER_NO_TOKEN_END;
+    lexer->line_offsets = PYCO_NULL;
+    lexer->lines_allocated = 0;
+    lexer->lines_count = 0;
+    lexer->numeric_locale = (pyco_locale)0;
+    lexer->counters = (pyco_allocation_counters){0};
+    _count_allocation(&lexer->counters, sizeof(pyco_lexer), false);
+
+    return lexer;
+}
+
+bool lexer_free(pyco_lexer *lexer)
+{
+    if (lexer && lexer->options.allocators.free)
+    {
+        if (lexer->source_copy)
+        {
+            _pyco_free(&lexer->options.allocators, lexer->source_copy);
+        }
+
+        if (lexer->line_offsets)
+        {
+            _pyco_free(&lexer->options.allocators, lexer->line_offsets);
+        }
+
+        if (lexer->owns_symbols)
+        {
+            pyco_symbol_table_free(lexer->symbols);
+        }
+
+        for (pyco_token_block *block = lexer->token_block_first; block;)
+        {
+            pyco_token_block *next_block = block->next;
+            _token_block_free(block, &lexer->options.allocators);
+            block = next_block;
+        }
+
+        if (lexer->numeric_locale)
+        {
+#if defined(_WIN32)
+            _free_locale(lexer->numeric_locale);
+#else
+            freelocale(lexer->numeric_locale);
+#endif
+        }
+
+        _pyco_free(&lexer->options.allocators, lexer);
+
+        return true;
+    }
+
+    return false;
+}
+
+// gets the lexer ready for the next source while keeping the token blocks, the line index, the source copy
+// and an owned symbol table at the size they grew to, so lexing a similar source again allocates nothing
+void lexer_reset(pyco_lexer *lexer)
+{
+    for (pyco_token_block *block = lexer->token_block_first; block; block = block->next)
+    {
+        block->count = 0;
+        block->literals_count = 0;
+    }
+
+    // a ring is the only block and stays attached, the next buffer is lexed into it again
+    lexer->token_block_last = lexer->token_block_first;
+
+    if (lexer->owns_symbols)
+    {
+        pyco_symbol_table_reset(lexer->symbols);
+    }
+
+    lexer->track_indents = 1;
+    lexer->line_start = 1;
+    lexer->source = PYCO_NULL;
+    lexer->source_size = 0;
+    lexer->scan_offset = 0;
+    lexer->scan_token_start = 0;
+    lexer->scan_state = PYCO_LEXER_STATE_START;
+    lexer->tokens_count = 0;
+    lexer->scan_token_limit = ~0ull;
+    lexer->previous_token_end = PYCO_LEXER_NO_TOKEN_END;
+    lexer->lines_count = 0;
+}
+
+// runs the automaton over the source received so far, unless the input is final a token that
+// reaches the end of it is left open so the next chunk can continue it
+void _lexer_scan(pyco_lexer *lexer, bool final)
+{
+    const pyco_uint8 *data = lexer->source;
+    const pyco_uint64 size = lexer->source_size;
+    pyco_uint64 offset = lexer->scan_offset;
+    pyco_uint64 token_start = lexer->scan_token_start;
+    pyco_uint8 state = lexer->scan_state;
+
+    while (true)
+    {
+        if (state == PYCO_LEXER_STATE_START)
+        {
+            // in pull mode the scan pauses once the ring is full
+            if (offset == size || lexer->tokens_count >= lexer->scan_token_limit)
+            {
+                break;
+            }
+
+            // every byte has a transition out of the start state, so each token consumes at least one byte
+            token_start = offset;
+            state = PYCO_LEXER_TRANSITIONS[PYCO_LEXER_STATE_START][PYCO_LEXER_CHAR_CLASSES[data[offset++]]];
+        }
+
+        pyco_uint8 next_state;
+
+        while (true)
+        {
+            if (state <= PYCO_LEXER_STATE_LAST_RUN)
+            {
+                offset = _lexer_skip_run(lexer, state, data, offset, size);
+            }
+
+            if (offset == size || !(next_state = PYCO_LEXER_TRANSITIONS[state][PYCO_LEXER_CHAR_CLASSES[data[offset]]]))
+            {
+                break;
+            }
+
+            state = next_state;
+            offset++;
+        }
+
+        if (offset == size && !final)
+        {
+            break;
+        }
+
+        _lexer_accept(lexer, state, token_start, offset);
+        state = PYCO_LEXER_STATE_START;
+    }
+
+    lexer->scan_offset = offset;
+    lexer->scan_token_start = token_start;
+    lexer->scan_state = state;
+}
+
+bool lexer_process_buffer(pyco_lexer *lexer, const pyco_buffer *buffer)
+{
+    pyco_buffer_reader reader = create_buffer_reader(buffer);
+
+    // token offsets and lengths are stored as 32 bit values
+    if (!is_buffer_reader_valid(&reader) || buffer->size > 0xFFFFFFFF)
+    {
+        return false;
+    }
+
+    lexer->source = buffer->data;
+    lexer->source_size = buffer->size;
+
+    // when the source does not outlive the compile the tokens point into a single copy of it
+    if (lexer->options.copy_source)
+    {
+        // a copy left by a reset is reused when the source fits into it
+        if (buffer->size > lexer->source_allocated || !lexer->source_copy)
+        {
+            if (lexer->source_copy)
+            {
+                _pyco_free(&lexer->options.allocators, lexer->source_copy);
+            }
+
+            lexer->source_allocated = 0;
+
+            if (!(lexer->source_copy = _pyco_malloc(&lexer->options.allocators, buffer->size)))
+            {
+                return false;
+            }
+
+            _count_allocation(&lexer->counters, buffer->size, false);
+            lexer->source_allocated = buffer->size;
+        }
+
+        memcpy(lexer->source_copy, buffer->data, buffer->size);
+        lexer->source = lexer->source_copy;
+    }
+
+    // pull mode, the buffer is only attached and tokens are lexed as the parser asks for them
+    if (lexer->options.token_window_size)
+    {
+        pyco_uint64 ring_size = 2;
+
+        while (ring_size < lexer->options.token_window_size)
+        {
+            ring_size *= 2;
+        }
+
+        if (!lexer->token_ring && !(lexer->token_ring = _lexer_add_token_block(lexer, ring_size)))
+        {
+            return false;
+        }
+
+        if (!_token_block_reserve_literals(lexer->token_ring, &lexer->options.allocators, &lexer->counters, lexer->token_ring->allocated))
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    _lexer_scan(lexer, true);
+
+    return true;
+}
+
+// push mode, the chunks are appended to a source buffer owned by the lexer and lexed as they arrive,
+// tokens, strings and indents that cross a chunk boundary are resumed with the next chunk
+bool lexer_push_chunk(pyco_lexer *lexer, const pyco_buffer *chunk)
+{
+    if (!chunk || (!chunk->data && chunk->size) || lexer->options.token_window_size)
+    {
+        return false;
+    }
+
+    const pyco_uint64 source_size = lexer->source_size + chunk->size;
+
+    // token offsets and lengths are stored as 32 bit values
+    if (source_size > 0xFFFFFFFF || (lexer->source && lexer->source != lexer->source_copy))
+    {
+        return false;
+    }
+
+    if (source_size > lexer->source_allocated)
+    {
+        pyco_uint64 source_allocated = lexer->source_allocated ? lexer->source_allocated * 2 : lexer->options.source_initial_size;
+
+        while (source_allocated < source_size)
+        {
+            source_allocated *= 2;
+        }
+
+        pyco_uint8 *source_copy = _pyco_realloc(&lexer->options.allocators, lexer->source_copy, lexer->source_allocated, source_allocated);
+
+        if (!source_copy)
+        {
+            return false;
+        }
+
+        _count_allocation(&lexer->counters, source_allocated, true);
+        lexer->source = lexer->source_copy = source_copy;
+        lexer->source_allocated = source_allocated;
+    }
+
+    if (chunk->size)
+    {
+        memcpy(lexer->source_copy + lexer->source_size, chunk->data, chunk->size);
+    }
+
+    lexer->source_size = source_size;
+
+    _lexer_scan(lexer, false);
+
+    return true;
+}
+
+bool lexer_finish(pyco_lexer *lexer)
+{
+    _lexer_scan(lexer, true);
+
+    return true;
+}
+
+// resolves the line and column of a source offset with a binary search over the line index
+token_location lexer_get_location(pyco_lexer *lexer, pyco_uint64 offset)
+{
+    pyco_uint64 low = 0;
+    pyco_uint64 high = lexer->lines_count;
+
+    while (low < high)
+    {
+        const pyco_uint64 middle = low + (high - low) / 2;
+
+        if (lexer->line_offsets[middle] <= offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    const pyco_uint64 line_offset = low ? lexer->line_offsets[low - 1] : 0;
+
+    return (token_location){
+        .line = low + 1,
+        .column = offset - line_offset + 1,
+        .offset = offset,
+    };
+}
+
+static inline pyco_token _token_block_make_token(const pyco_token_block *block, pyco_uint64 index, const pyco_uint8 *source)
+{
+    const pyco_uint8 kind = block->kinds[index];
+    pyco_token token = {
+        .type = kind & PYCO_TOKEN_TYPE_MASK,
+        .flags = kind & ~PYCO_TOKEN_TYPE_MASK,
+        .offset = block->offsets[index],
+        .length = block->lengths[index],
+        .payload = block->payloads[index],
+        .value = (const char *)source + block->offsets[index],
+    };
+
+    if (_token_type_is_number(token.type))
+    {
+        const pyco_literal *literal = &block->literals[token.payload];
+
+        token.payload = literal->flags;
+        token.literal = literal->value;
+    }
+
+    return token;
+}
+
+static inline pyco_token _token_block_token_at(const pyco_token_block *block, pyco_uint64 index, const pyco_uint8 *source)
+{
+    if (!block || index >= block->count)
+    {
+        return (pyco_token){.type = PYCO_TOKEN_TYPE_NONE, .value = ""};
+    }
+
+    return _token_block_make_token(block, index, source);
+}
+
+static inline bool token_valid(pyco_token token)
+{
+    return token.type != PYCO_TOKEN_TYPE_NONE;
+}
+
+static inline bool token_is_indent(pyco_token token)
+{
+    return token.type == PYCO_TOKEN_TYPE_INDENT_SPACE || token.type == PYCO_TOKEN_TYPE_INDENT_TAB;
+}
+
+static inline bool token_is_special(pyco_token token, char special)
+{
+    return token.type == PYCO_TOKEN_TYPE_SPECIAL && token.length == 1 && token.value[0] == special;
+}
+
+static inline bool token_is_keyword(pyco_token token, pyco_uint32 keyword)
+{
+    return token.type == PYCO_TOKEN_TYPE_KEYWORD && token.payload == keyword;
+}
+
+static inline const pyco_operator_info *token_operator(pyco_token token)
+{
+    return &PYCO_OPERATORS[token.type == PYCO_TOKEN_TYPE_SPECIAL ? token.payload : PYCO_OPERATOR_ID_NONE];
+}
+
+static inline bool token_equals(pyco_token token, const char *text)
+{
+    const pyco_uint64 length = strlen(text);
+
+    return token.length == length && memcmp(token.value, text, length) == 0;
+}
+
+// where a parser is in the token stream. the parser only moves its cursor, the tokens and the text are read
+// through const pointers so several cursors can share one lexer. in pull mode the cursor is the only reader
+// and lexes the tokens it reaches into the ring of its lexer
+typedef struct pyco_token_cursor
+{
+    const pyco_uint8 *source;
+    const pyco_token_block *block;
+    pyco_uint64 index; // in block, or the absolute position in pull mode
+    pyco_lexer *pull;  // the lexer of the ring in pull mode, PYCO_NULL otherwise
+} pyco_token_cursor;
+
+// a cursor at the first token the lexer has, or will have in pull mode
+static inline pyco_token_cursor lexer_cursor(pyco_lexer *lexer)
+{
+    return (pyco_token_cursor){
+        .source = lexer->source,
+        .block = lexer->token_block_first,
+        .pull = lexer->token_ring ? lexer : PYCO_NULL,
+    };
+}
+
+// lexes until the token at the absolute index is in the ring, or the source ends
+static inline pyco_token _cursor_ring_token_at(pyco_token_cursor *cursor, pyco_uint64 index)
+{
+    pyco_lexer *lexer = cursor->pull;
+
+    while (index >= lexer->tokens_count)
+    {
+        if (lexer->scan_offset == lexer->source_size && lexer->scan_state == PYCO_LEXER_STATE_START)
+        {
+            return _token_block_token_at(PYCO_NULL, 0, PYCO_NULL);
+        }
+
+        // the tokens from the cursor on have to stay in the ring
+        lexer->scan_token_limit = cursor->index + lexer->token_ring->allocated;
+        _lexer_scan(lexer, true);
+    }
+
+    return _token_block_make_token(lexer->token_ring, index & (lexer->token_ring->allocated - 1), lexer->source);
+}
+
+// position of the current token in the stream
+static inline pyco_uint64 _cursor_position(const pyco_token_cursor *cursor)
+{
+    return cursor->block ? cursor->block->first + cursor->index : 0;
+}
+
+pyco_token cursor_get_current_token(pyco_token_cursor *cursor)
+{
+    if (cursor->pull)
+    {
+        return _cursor_ring_token_at(cursor, cursor->index);
+    }
+
+    return _token_block_token_at(cursor->block, cursor->index, cursor->source);
+}
+
+pyco_token cursor_get_next_token(pyco_token_cursor *cursor)
+{
+    if (cursor->pull)
+    {
+        return _cursor_ring_token_at(cursor, ++cursor->index);
+    }
+
+    if (!cursor->block)
+    {
+        return _token_block_token_at(PYCO_NULL, 0, PYCO_NULL);
+    }
+
+    if (++cursor->index >= cursor->block->count && cursor->block->next)
+    {
+        cursor->block = cursor->block->next;
+        cursor->index = 0;
+    }
+
+    return _token_block_token_at(cursor->block, cursor->index, cursor->source);
+}
+
+pyco_token cursor_peek_next_token(pyco_token_cursor *cursor)
+{
+    if (cursor->pull)
+    {
+        return _cursor_ring_token_at(cursor, cursor->index + 1);
+    }
+
+    if (!cursor->block)
+    {
+        return _token_block_token_at(PYCO_NULL, 0, PYCO_NULL);
+    }
+
+    if (cursor->index + 1 >= cursor->block->count)
+    {
+        return _token_block_token_at(cursor->block->next, 0, cursor->source);
+    }
+
+    return _token_block_token_at(cursor->block, cursor->index + 1, cursor->source);
+}
+
+// MARK: AST TREE BUILDER
+
+typedef struct pyco_ast_node
+{
+    struct pyco_ast_node *parent;
+    struct pyco_ast_node *child_first;
+    struct pyco_ast_node *child_last;
+    struct pyco_ast_node *next;
+    void *data;
+    pyco_uint32 data_size; // bytes of the typed payload in data, see NODE DATA STRUCTS
+    pyco_uint32 index;     // position in the flat tree, set while flattening
+    pyco_uint32 offset;    // source span of the token the node was made from
+    pyco_uint32 length;
+    pyco_uint32 symbol; // interned name of identifier nodes, 0 for everything else
+    pyco_uint32 type;
+    pyco_uint32 flags;
+    pyco_uint8 label;
+    pyco_uint8 operator; // PYCO_OPERATOR_ID of nodes made from special tokens
+} pyco_ast_node;
+
+typedef struct pyco_ast_options
+{
+    pyco_allocators allocators;
+    // nodes are allocated from this arena, when PYCO_NULL the tree creates and owns one sized from arena_size_hint
+    pyco_arena *arena;
+    pyco_uint64 arena_size_hint;
+} pyco_ast_options;
+
+typedef struct pyco_ast
+{
+    pyco_ast_options options;
+    pyco_ast_node *root_node;
+    pyco_arena *arena;
+    pyco_uint8 owns_arena;
+    pyco_uint64 nodes_count;
+    pyco_uint64 data_words; // payloads of all nodes in 8 byte words
+    pyco_uint64 arena_peak; // the most bytes the arena held before a rewind, 0 when it was never rewound
+    bool failed;            // a node could not be allocated, the tree is missing parts of the file
+    // trees of a parallel parse whose nodes were moved into this one, their arenas go away with it
+    struct pyco_ast *parts;
+    pyco_uint32 parts_count;
+} pyco_ast;
+
+pyco_ast_node *pyco_ast_node_create(pyco_ast *ast, pyco_uint8 label, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size);
+
+pyco_ast initialize_tree(pyco_ast_options options)
+{
+    pyco_ast tree = {
+        .options = options,
+    };
+
+    tree.arena = options.arena;
+    tree.owns_arena = !options.arena;
+
+    if (tree.owns_arena && !(tree.arena = pyco_arena_create(options.allocators, options.arena_size_hint)))
+    {
+        return tree;
+    }
+
+    tree.root_node = pyco_ast_node_create(&tree, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_ROOT, PYCO_NULL, 0);
+
+    return tree;
+}
+
+pyco_ast_node *pyco_ast_node_create(pyco_ast *ast, pyco_uint8 label, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
+{
+    // the node data starts on the arena alignment, like the node itself
+    const pyco_uint64 node_size = _arena_align(sizeof(pyco_ast_node));
+    pyco_uint8 *offset = pyco_arena_alloc(ast->arena, node_size + data_size);
+
+    if (!offset)
+    {
+        ast->failed = true;
+        return PYCO_NULL;
+    }
+
+    pyco_ast_node *node = (pyco_ast_node *)offset;
+    node->data = PYCO_NULL;
+    node->data_size = (pyco_uint32)data_size;
+    node->index = 0;
+    node->offset = 0;
+    node->length = 0;
+    node->symbol = 0;
+    node->label = label;
+    node->operator = PYCO_OPERATOR_ID_NONE;
+    node->type = type;
+    node->flags = flags;
+    node->parent = PYCO_NULL;
+    node->child_first = PYCO_NULL;
+    node->child_last = PYCO_NULL;
+    node->next = PYCO_NULL;
+
+    if (data_size)
+    {
+        node->data = offset + node_size;
+        memset(node->data, 0, data_size);
+    }
+
+    ast->nodes_count++;
+    ast->data_words += (data_size + sizeof(pyco_uint64) - 1) / sizeof(pyco_uint64);
+
+    return node;
+}
+
+// returns root_node when there is nothing to append or nothing to append to, a node made after a failed one is dropped
+static inline pyco_ast_node *pyco_ast_node_append(pyco_ast_node *root_node, pyco_ast_node *node_to_append)
+{
+    if (node_to_append == PYCO_NULL || root_node == PYCO_NULL)
+    {
+        return root_node;
+    }
+
+    if (root_node->child_first == PYCO_NULL)
+    {
+        root_node->child_first = node_to_append;
+        root_node->child_last = node_to_append;
+    }
+    else
+    {
+        root_node->child_last->next = node_to_append;
+        root_node->child_last = node_to_append;
+    }
+
+    node_to_append->parent = root_node;
+
+    return node_to_append;
+}
+
+pyco_ast_node *pyco_ast_node_create_from_token(pyco_ast *ast, pyco_token token, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
+{
+    pyco_ast_node *node = pyco_ast_node_create(ast, PYCO_AST_LABEL_TOKEN, type, flags, data_size);
+
+    if (!node)
+    {
+        return PYCO_NULL;
+    }
+
+    node->offset = token.offset;
+    node->length = token.length;
+    node->symbol = token.type == PYCO_TOKEN_TYPE_IDENTIFIER ? token.payload : 0;
+    node->operator = token.type == PYCO_TOKEN_TYPE_SPECIAL ? token.payload : PYCO_OPERATOR_ID_NONE;
+
+    return node;
+}
+
+pyco_ast_node *pyco_ast_node_add(pyco_ast *ast, pyco_ast_node *root_node, pyco_uint8 label, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
+{
+    return pyco_ast_node_append(root_node, pyco_ast_node_create(ast, label, type, flags, data_size));
+}
+
+pyco_ast_node *pyco_ast_node_add_from_token(pyco_ast *ast, pyco_ast_node *root_node, pyco_token token, pyco_uint32 type, pyco_uint32 flags, pyco_uint64 data_size)
+{
+    return pyco_ast_node_append(root_node, pyco_ast_node_create_from_token(ast, token, type, flags, data_size));
+}
+
+void pyco_ast_free(pyco_ast *ast, pyco_ast_node *root_node)
+{
+    // a borrowed arena is reset by its owner, which can then reuse it for the next tree
+    if (ast->owns_arena)
+    {
+        pyco_arena_free(ast->arena);
+    }
+
+    for (pyco_uint32 i = 0; i < ast->parts_count; i++)
+    {
+        pyco_ast_free(&ast->parts[i], ast->parts[i].root_node);
+    }
+
+    if (ast->parts)
+    {
+        _pyco_free(&ast->options.allocators, ast->parts);
+    }
+
+    ast->arena = PYCO_NULL;
+    ast->root_node = PYCO_NULL;
+    ast->parts = PYCO_NULL;
+    ast->parts_count = 0;
+}
+
+// MARK: NODE DATA STRUCTS
+
+enum PYCO_VAR_TYPE
+{
+    PYCO_VAR_TYPE_INT8,
+    PYCO_VAR_TYPE_INT16,
+    PYCO_VAR_TYPE_INT32,
+    PYCO_VAR_TYPE_INT64,
+    PYCO_VAR_TYPE_UINT8,
+    PYCO_VAR_TYPE_UINT16,
+    PYCO_VAR_TYPE_UINT32,
+    PYCO_VAR_TYPE_UINT64,
+    PYCO_VAR_TYPE_F32,
+    PYCO_VAR_TYPE_F64,
+    PYCO_VAR_TYPE_BYTE,
+    PYCO_VAR_TYPE_RUNE,
+    PYCO_VAR_TYPE_STRING,
+    PYCO_VAR_TYPE_ARRAY,
+    PYCO_VAR_TYPE_MAP,
+    PYCO_VAR_TYPE_NAMED, // a user type, its name is in type_symbol
+    PYCO_VAR_TYPE_COUNT,
+};
+
+// spelling of the builtin types, indexed by PYCO_VAR_TYPE
+static const char *PYCO_VAR_TYPE_NAMES[PYCO_VAR_TYPE_ARRAY] = {
+    "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64", "f32", "f64", "byte", "rune", "string"};
+
+// payloads are plain integer fields, so the flat tree can copy them as they are. the control flow
+// payload is the only one with pointers, flattening turns them into node indices
+
+// PYCO_AST_NODE_TYPE_LITERAL made from a number, the value was decoded by the lexer
+typedef struct ast_data_literal
+{
+    pyco_literal_value value;
+    pyco_uint32 flags; // PYCO_LITERAL_FLAG
+} ast_data_literal;
+
+// PYCO_AST_NODE_TYPE_STRUCT
+typedef struct ast_data_struct
+{
+    pyco_uint32 flags;
+    pyco_uint32 fields_count;
+} ast_data_struct;
+
+// PYCO_AST_NODE_TYPE_STRUCT_FIELD
+typedef struct ast_data_struct_field
+{
+    pyco_uint32 type;
+    pyco_uint32 flags;
+    pyco_uint32 type_symbol; // interned type name of PYCO_VAR_TYPE_NAMED fields
+} ast_data_struct_field;
+
+// PYCO_AST_NODE_TYPE_FUNCTION declarations, not their arguments
+typedef struct ast_data_function
+{
+    pyco_uint32 arity;
+} ast_data_function;
+
+// PYCO_AST_NODE_TYPE_CALL
+typedef struct ast_data_call
+{
+    pyco_uint32 arguments_count;
+} ast_data_call;
+
+// PYCO_AST_NODE_TYPE_EXPRESSION, the operator itself is in the node
+typedef struct ast_data_expression
+{
+    pyco_uint32 arity; // 1 for prefix, postfix and grouping, 2 for binary and index, 3 for the ternary
+} ast_data_expression;
+
+// PYCO_AST_NODE_TYPE_IF, FOR, WHILE and DO_WHILE. the slots point into the subtree of the node,
+// PYCO_NULL when the statement has no such part
+typedef struct ast_data_control_flow
+{
+    struct pyco_ast_node *condition;
+    struct pyco_ast_node *body;
+    struct pyco_ast_node *else_body; // a scope, or the if statement of an `else if`
+    struct pyco_ast_node *initializer;
+    struct pyco_ast_node *step;
+} ast_data_control_flow;
+
+// the control flow payload in the flat tree, node indices with 0 for a missing part, the root is never one
+typedef struct pyco_flat_control_flow
+{
+    pyco_uint32 condition;
+    pyco_uint32 body;
+    pyco_uint32 else_body;
+    pyco_uint32 initializer;
+    pyco_uint32 step;
+} pyco_flat_control_flow;
+
+static inline bool ast_node_is_control_flow(pyco_uint32 type)
+{
+    return type == PYCO_AST_NODE_TYPE_IF || type == PYCO_AST_NODE_TYPE_FOR || type == PYCO_AST_NODE_TYPE_WHILE || type == PYCO_AST_NODE_TYPE_DO_WHILE;
+}
+
+pyco_uint32 ast_var_type_from_token(pyco_token token)
+{
+    for (pyco_uint32 type = 0; type < PYCO_VAR_TYPE_ARRAY; type++)
+    {
+        if (token_equals(token, PYCO_VAR_TYPE_NAMES[type]))
+        {
+            return type;
+        }
+    }
+
+    return PYCO_VAR_TYPE_NAMED;
+}
+
+// MARK: FLAT AST
+
+// the tree in pre-order in one array, the children of a node follow it directly and its next sibling
+// is `size` nodes further. nothing in it is a pointer, so it can be copied or written out as it is
+typedef struct pyco_flat_node
+{
+    pyco_uint8 type;
+    pyco_uint8 label;
+    pyco_uint8 operator;
+    pyco_uint8 flags;
+    pyco_uint32 symbol;
+    pyco_uint32 offset; // source span of the token the node was made from
+    pyco_uint32 length;
+    pyco_uint32 size; // nodes in the subtree, the node itself included
+    pyco_uint32 data; // first word of the payload in pyco_flat_ast.data, 0 when the node has none
+} pyco_flat_node;
+
+// payloads are copied in whole words so the 64 bit fields stay aligned
+#define PYCO_FLAT_AST_WORDS(size) (((size) + sizeof(pyco_uint64) - 1) / sizeof(pyco_uint64))
+
+typedef struct pyco_flat_ast
+{
+    pyco_allocators allocators;
+    pyco_flat_node *nodes;
+    pyco_uint32 count;
+    pyco_uint64 *data; // payloads of all nodes, word 0 is unused
+    pyco_uint32 data_count;
+    pyco_uint64 nodes_allocated;
+    pyco_uint64 data_allocated;
+    pyco_allocation_counters counters;
+    const pyco_uint8 *source; // the token spans point into it
+} pyco_flat_ast;
+
+static inline pyco_uint32 pyco_flat_ast_next_sibling(const pyco_flat_ast *flat, pyco_uint32 index)
+{
+    return index + flat->nodes[index].size;
+}
+
+static inline const void *pyco_flat_ast_data(const pyco_flat_ast *flat, pyco_uint32 index)
+{
+    return flat->nodes[index].data ? flat->data + flat->nodes[index].data : PYCO_NULL;
+}
+
+static inline pyco_uint32 _flat_ast_slot(const pyco_ast_node *node)
+{
+    return node ? node->index : 0;
+}
+
+// the slots of a control flow node point into its subtree, so they are known once the subtree is done
+static inline void _flat_ast_resolve_control_flow(pyco_flat_ast *flat, pyco_ast_node *node)
+{
+    const ast_data_control_flow *data = node->data;
+    pyco_flat_control_flow *flat_data = (pyco_flat_control_flow *)(flat->data + flat->nodes[node->index].data);
+
+    flat_data->condition = _flat_ast_slot(data->condition);
+    flat_data->body = _flat_ast_slot(data->body);
+    flat_data->else_body = _flat_ast_slot(data->else_body);
+    flat_data->initializer = _flat_ast_slot(data->initializer);
+    flat_data->step = _flat_ast_slot(data->step);
+}
+
+void pyco_flat_ast_free(pyco_flat_ast *flat);
+
+// grows one of the arrays of the flat tree, what it held is not kept
+static inline bool _flat_ast_reserve(pyco_flat_ast *flat, void **array, pyco_uint64 *allocated, pyco_uint64 size)
+{
+    if (size <= *allocated && *array)
+    {
+        return true;
+    }
+
+    if (*array)
+    {
+        _pyco_free(&flat->allocators, *array);
+    }
+
+    *allocated = 0;
+
+    if (!(*array = _pyco_malloc(&flat->allocators, size)))
+    {
+        return false;
+    }
+
+    _count_allocation(&flat->counters, size, false);
+    *allocated = size;
+
+    return true;
+}
+
+// grows one of the arrays of the flat tree and keeps what it held, for trees flattened a subtree at a time
+static inline bool _flat_ast_grow(pyco_flat_ast *flat, void **array, pyco_uint64 *allocated, pyco_uint64 size)
+{
+    if (size <= *allocated && *array)
+    {
+        return true;
+    }
+
+    const pyco_uint64 grown = *allocated * 2 > size ? *allocated * 2 : size;
+    void *resized = _pyco_realloc(&flat->allocators, *array, *allocated, grown);
+
+    if (!resized)
+    {
+        return false;
+    }
+
+    _count_allocation(&flat->counters, grown, *allocated != 0);
+    *array = resized;
+    *allocated = grown;
+
+    return true;
+}
+
+// appends the subtree after the nodes the flat tree has, the arrays must have room for it.
+// walks the subtree without recursion, the parent links lead back up once a subtree is done
+static void _flat_ast_add_subtree(pyco_flat_ast *flat, pyco_ast_node *root_node)
+{
+    // until its subtree is done a node keeps the index of its parent in its size
+    pyco_uint32 parent_index = ~0u;
+
+    for (pyco_ast_node *node = root_node; node;)
+    {
+        const pyco_uint32 index = flat->count++;
+        pyco_flat_node *flat_node = &flat->nodes[index];
+
+        flat_node->type = (pyco_uint8)node->type;
+        flat_node->label = node->label;
+        flat_node->operator = node->operator;
+        flat_node->flags = (pyco_uint8)node->flags;
+        flat_node->symbol = node->symbol;
+        flat_node->offset = node->offset;
+        flat_node->length = node->length;
+        flat_node->data = 0;
+        node->index = index;
+
+        if (node->data_size)
+        {
+            flat_node->data = flat->data_count;
+
+            if (ast_node_is_control_flow(node->type))
+            {
+                // the slots are filled in once the subtree has its indices
+                memset(flat->data + flat->data_count, 0, sizeof(pyco_flat_control_flow));
+                flat->data_count += PYCO_FLAT_AST_WORDS(sizeof(pyco_flat_control_flow));
+            }
+            else
+            {
+                memcpy(flat->data + flat->data_count, node->data, node->data_size);
+                flat->data_count += PYCO_FLAT_AST_WORDS(node->data_size);
+            }
+        }
+
+        if (node->child_first)
+        {
+            flat_node->size = parent_index;
+            parent_index = index;
+            node = node->child_first;
+            continue;
+        }
+
+        flat_node->size = 1;
+
+        while (node != root_node && !node->next)
+        {
+            const pyco_uint32 grandparent_index = flat->nodes[parent_index].size;
+
+            flat->nodes[parent_index].size = flat->count - parent_index;
+            parent_index = grandparent_index;
+            node = node->parent;
+
+            if (node->data_size && ast_node_is_control_flow(node->type))
+            {
+                _flat_ast_resolve_control_flow(flat, node);
+            }
+        }
+
+        node = node == root_node ? PYCO_NULL : node->next;
+    }
+}
+
+// the arrays the flat tree already has are reused when the tree fits into them
+bool pyco_ast_flatten_into(pyco_ast *ast, const pyco_uint8 *source, pyco_flat_ast *flat)
+{
+    flat->source = source;
+    flat->count = 0;
+    flat->data_count = 0;
+
+    // nodes_count includes nodes the parser dropped, so it is an upper bound of what is reachable.
+    // the same goes for data_size, and no flat payload takes more words than the one it is made from
+    if (!ast->root_node || ast->failed || !_flat_ast_reserve(flat, (void **)&flat->nodes, &flat->nodes_allocated, sizeof(pyco_flat_node) * ast->nodes_count))
+    {
+        return false;
+    }
+
+    if (!_flat_ast_reserve(flat, (void **)&flat->data, &flat->data_allocated, sizeof(pyco_uint64) * (1 + ast->data_words)))
+    {
+        return false;
+    }
+
+    flat->data_count = 1;
+    _flat_ast_add_subtree(flat, ast->root_node);
+
+    return true;
+}
+
+pyco_flat_ast pyco_ast_flatten(pyco_ast *ast, const pyco_uint8 *source, pyco_allocators allocators)
+{
+    pyco_flat_ast flat = {
+        .allocators = allocators,
+    };
+
+    pyco_ast_flatten_into(ast, source, &flat);
+
+    return flat;
+}
+
+void pyco_flat_ast_free(pyco_flat_ast *flat)
+{
+    if (flat->nodes)
+    {
+        _pyco_free(&flat->allocators, flat->nodes);
+    }
+
+    if (flat->data)
+    {
+        _pyco_free(&flat->allocators, flat->data);
+    }
+
+    flat->nodes = PYCO_NULL;
+    flat->data = PYCO_NULL;
+    flat->count = 0;
+    flat->data_count = 0;
+    flat->nodes_allocated = 0;
+    flat->data_allocated = 0;
+}
+
+// MARK: AST TREE PRINTER
+
+#define PYCO_OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+// output is gathered in memory and written in large blocks, a failed allocation falls back to a small stack buffer
+typedef struct pyco_output_buffer
+{
+    FILE *file;
+    pyco_uint8 *data;
+    pyco_uint64 size;
+    pyco_uint64 used;
+    pyco_uint8 failed;
+} pyco_output_buffer;
+
+static inline void _output_flush(pyco_output_buffer *output)
+{
+    if (output->used && fwrite(output->data, 1, output->used, output->file) != output->used)
+    {
+        output->failed = 1;
+    }
+
+    output->used = 0;
+}
+
+static inline void _output_write(pyco_output_buffer *output, const void *data, pyco_uint64 size)
+{
+    if (output->used + size > output->size)
+    {
+        _output_flush(output);
+
+        // too large to be worth buffering
+        if (size > output->size)
+        {
+            if (fwrite(data, 1, size, output->file) != size)
+            {
+                output->failed = 1;
+            }
+
+            return;
+        }
+    }
+
+    memcpy(output->data + output->used, data, size);
+    output->used += size;
+}
+
+static inline void _output_write_string(pyco_output_buffer *output, const char *string)
+{
+    _output_write(output, string, strlen(string));
+}
+
+static inline void _pyco_ast_node_print_json_indent(pyco_output_buffer *output, pyco_uint32 indent)
+{
+    static const char spaces[] = "                                                                ";
+    const pyco_uint32 indent_per_write = (sizeof(spaces) - 1) / 4;
+
+    for (; indent > indent_per_write; indent -= indent_per_write)
+    {
+        _output_write(output, spaces, sizeof(spaces) - 1);
+    }
+
+    _output_write(output, spaces, indent * 4);
+}
+
+const char *_pyco_ast_node_get_node_type(pyco_uint32 type)
+{
+    switch (type)
+    {
+    case PYCO_AST_NODE_TYPE_NONE:
+        return PYCO_AST_NODE_TYPE_NAME_NONE;
+    case PYCO_AST_NODE_TYPE_ROOT:
+        return PYCO_AST_NODE_TYPE_NAME_ROOT;
+    case PYCO_AST_NODE_TYPE_LITERAL:
+        return PYCO_AST_NODE_TYPE_NAME_LITERAL;
+    case PYCO_AST_NODE_TYPE_STRUCT:
+        return PYCO_AST_NODE_TYPE_NAME_STRUCT;
+    case PYCO_AST_NODE_TYPE_STRUCT_FIELD:
+        return PYCO_AST_NODE_TYPE_NAME_STRUCT_FIELD;
+    case PYCO_AST_NODE_TYPE_FUNCTION:
+        return PYCO_AST_NODE_TYPE_NAME_FUNCTION;
+    case PYCO_AST_NODE_TYPE_ARGUMENTS:
+        return PYCO_AST_NODE_TYPE_NAME_ARGUMENTS;
+    case PYCO_AST_NODE_TYPE_STATEMENT:
+        return PYCO_AST_NODE_TYPE_NAME_STATEMENT;
+    case PYCO_AST_NODE_TYPE_EXPRESSION:
+        return PYCO_AST_NODE_TYPE_NAME_EXPRESSION;
+    case PYCO_AST_NODE_TYPE_CALL:
+        return PYCO_AST_NODE_TYPE_NAME_CALL;
+    case PYCO_AST_NODE_TYPE_IF:
+        return PYCO_AST_NODE_TYPE_NAME_IF;
+    case PYCO_AST_NODE_TYPE_FOR:
+        return PYCO_AST_NODE_TYPE_NAME_FOR;
+    case PYCO_AST_NODE_TYPE_WHILE:
+        return PYCO_AST_NODE_TYPE_NAME_WHILE;
+    case PYCO_AST_NODE_TYPE_DO_WHILE:
+        return PYCO_AST_NODE_TYPE_NAME_DO_WHILE;
+    case PYCO_AST_NODE_TYPE_CONTINUE:
+        return PYCO_AST_NODE_TYPE_NAME_CONTINUE;
+    case PYCO_AST_NODE_TYPE_BREAK:
+        return PYCO_AST_NODE_TYPE_NAME_BREAK;
+    case PYCO_AST_NODE_TYPE_SCOPE:
+        return PYCO_AST_NODE_TYPE_NAME_SCOPE;
+    case PYCO_AST_NODE_TYPE_RETURN:
+        return PYCO_AST_NODE_TYPE_NAME_RETURN;
+    }
+
+    return PYCO_AST_NODE_TYPE_NAME_UNKNOWN;
+}
+
+void _pyco_flat_ast_print_json(pyco_output_buffer *output, const pyco_flat_ast *flat)
+{
+    // the nodes whose children are being printed, each one is closed once the walk reaches the end of its subtree
+    pyco_uint32 *open_nodes = PYCO_NULL;
+    pyco_uint32 open_allocated = 0;
+    pyco_uint32 depth = 0;
+
+    for (pyco_uint32 index = 0; index < flat->count; index++)
+    {
+        const pyco_flat_node *node = &flat->nodes[index];
+        const pyco_uint32 indent = depth * 2;
+
+        _pyco_ast_node_print_json_indent(output, indent);
+        _output_write_string(output, "{\n");
+
+        _pyco_ast_node_print_json_indent(output, indent + 1);
+        _output_write_string(output, "type: \"");
+        _output_write_string(output, _pyco_ast_node_get_node_type(node->type));
+        _output_write_string(output, "\",\n");
+
+        if (node->label == PYCO_AST_LABEL_TOKEN)
+        {
+            _pyco_ast_node_print_json_indent(output, indent + 1);
+            _output_write_string(output, "name: \"");
+            _output_write(output, flat->source + node->offset, node->length);
+            _output_write_string(output, "\",\n");
+        }
+        else if (node->label)
+        {
+            _pyco_ast_node_print_json_indent(output, indent + 1);
+            _output_write_string(output, "name: \"");
+            _output_write_string(output, PYCO_AST_LABEL_NAMES[node->label]);
+            _output_write_string(output, "\",\n");
+        }
+
+        if (node->size > 1)
+        {
+            if (depth == open_allocated)
+            {
+                const pyco_uint32 allocated = open_allocated ? open_allocated * 2 : 64;
+                pyco_uint32 *nodes = _pyco_realloc(&flat->allocators, open_nodes, sizeof(pyco_uint32) * open_allocated, sizeof(pyco_uint32) * allocated);
+
+                if (!nodes)
+                {
+                    break;
+                }
+
+                open_nodes = nodes;
+                open_allocated = allocated;
+            }
+
+            _pyco_ast_node_print_json_indent(output, indent + 1);
+            _output_write_string(output, "children: [\n");
+
+            open_nodes[depth++] = index;
+            continue;
+        }
+
+        // a leaf can end the subtrees of any number of its parents
+        for (pyco_uint32 closing = index;;)
+        {
+            const pyco_uint32 parent = depth ? open_nodes[depth - 1] : 0;
+            const bool last = !depth || pyco_flat_ast_next_sibling(flat, closing) == pyco_flat_ast_next_sibling(flat, parent);
+
+            _pyco_ast_node_print_json_indent(output, depth * 2);
+            _output_write_string(output, last ? "}\n" : "},\n");
+
+            if (!last || !depth)
+            {
+                break;
+            }
+
+            closing = open_nodes[--depth];
+
+            _pyco_ast_node_print_json_indent(output, depth * 2 + 1);
+            _output_write_string(output, "]\n");
+        }
+    }
+
+    if (open_nodes)
+    {
+        _pyco_free(&flat->allocators, open_nodes);
+    }
+}
+
+static inline pyco_output_buffer _output_begin(FILE *file, const pyco_allocators *allocators, pyco_uint8 *fallback, pyco_uint64 fallback_size)
+{
+    pyco_output_buffer output = {
+        .file = file,
+        .data = _pyco_malloc(allocators, PYCO_OUTPUT_BUFFER_SIZE),
+        .size = PYCO_OUTPUT_BUFFER_SIZE,
+    };
+
+    if (!output.data)
+    {
+        output.data = fallback;
+        output.size = fallback_size;
+    }
+
+    return output;
+}
+
+static inline bool _output_end(pyco_output_buffer *output, const pyco_allocators *allocators, pyco_uint8 *fallback)
+{
+    _output_flush(output);
+
+    if (output->data != fallback)
+    {
+        _pyco_free(allocators, output->data);
+    }
+
+    return !output->failed;
+}
+
+bool pyco_flat_ast_print_json(FILE *file, const pyco_flat_ast *flat)
+{
+    pyco_uint8 fallback[4096];
+    pyco_output_buffer output = _output_begin(file, &flat->allocators, fallback, sizeof(fallback));
+
+    _pyco_flat_ast_print_json(&output, flat);
+
+    return _output_end(&output, &flat->allocators, fallback);
+}
+
+bool pyco_flat_ast_to_json_file(const char *filename, const pyco_flat_ast *flat, const char *extra)
+{
+    if (!flat->count)
+    {
+        return false;
+    }
+
+    FILE *file = fopen(filename, "w");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    pyco_uint8 fallback[4096];
+    pyco_output_buffer output = _output_begin(file, &flat->allocators, fallback, sizeof(fallback));
+
+    if (extra)
+    {
+        _output_write_string(&output, "/*\n");
+        _output_write_string(&output, extra);
+        _output_write_string(&output, "\n*/\n\n");
+    }
+
+    _output_write_string(&output, "export const AST = ");
+    _pyco_flat_ast_print_json(&output, flat);
+
+    const bool written = _output_end(&output, &flat->allocators, fallback);
+
+    return fclose(file) == 0 && written;
+}
+
+// MARK: BINARY AST DUMP
+
+// the flat tree as it is in memory, followed by the part of the source its spans point into.
+// the values are in host byte order and node_size changes with the node layout, so readers can reject
+// a dump they do not understand instead of misreading it
+#define PYCO_AST_DUMP_MAGIC 0x54534150u // "PAST"
+#define PYCO_AST_DUMP_VERSION 1
+
+typedef struct pyco_ast_dump_header
+{
+    pyco_uint32 magic;
+    pyco_uint32 version;
+    pyco_uint32 node_size;
+    pyco_uint32 nodes_count;
+    pyco_uint32 data_count; // 8 byte payload words, the unused word 0 included
+    pyco_uint32 source_size;
+} pyco_ast_dump_header;
+
+bool pyco_flat_ast_write_binary(FILE *file, const pyco_flat_ast *flat)
+{
+    pyco_ast_dump_header header = {
+        .magic = PYCO_AST_DUMP_MAGIC,
+        .version = PYCO_AST_DUMP_VERSION,
+        .node_size = sizeof(pyco_flat_node),
+        .nodes_count = flat->count,
+        .data_count = flat->data_count,
+    };
+
+    for (pyco_uint32 index = 0; index < flat->count; index++)
+    {
+        const pyco_uint32 span_end = flat->nodes[index].offset + flat->nodes[index].length;
+
+        if (span_end > header.source_size)
+        {
+            header.source_size = span_end;
+        }
+    }
+
+    // the three parts are already contiguous, buffering would only add a copy
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(flat->nodes, sizeof(pyco_flat_node), flat->count, file) == flat->count &&
+           fwrite(flat->data, sizeof(pyco_uint64), flat->data_count, file) == flat->data_count &&
+           fwrite(flat->source, 1, header.source_size, file) == header.source_size;
+}
+
+bool pyco_flat_ast_to_binary_file(const char *filename, const pyco_flat_ast *flat)
+{
+    if (!flat->count)
+    {
+        return false;
+    }
+
+    FILE *file = fopen(filename, "wb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    const bool written = pyco_flat_ast_write_binary(file, flat);
+
+    return fclose(file) == 0 && written;
+}
+
+// MARK: PARSER
+
+pyco_ast_node *_parse_scope(pyco_ast *ast, pyco_token_cursor *cursor);
+pyco_ast_node *_parse_expression(pyco_ast *ast, pyco_token_cursor *cursor, pyco_uint32 flags, pyco_uint8 minimum_binding_power);
+
+pyco_ast_node *_parser_create_expression(pyco_ast *ast, pyco_token operator_token, pyco_uint32 arity)
+{
+    pyco_ast_node *node = pyco_ast_node_create_from_token(ast, operator_token, PYCO_AST_NODE_TYPE_EXPRESSION, 0, sizeof(ast_data_expression));
+
+    if (node)
+    {
+        ((ast_data_expression *)node->data)->arity = arity;
+    }
+
+    return node;
+}
+
+pyco_ast_node *_parser_handle_function_arguments(pyco_ast *ast, pyco_token_cursor *cursor, ast_data_function *function_data)
+{
+    pyco_ast_node *arguments_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_ARGUMENTS, PYCO_NULL, 0);
+
+    pyco_token arguments_start_token = cursor_get_next_token(cursor);
+
+    if (!token_is_special(arguments_start_token, '('))
+    {
+        return false;
+    }
+
+    pyco_token argument_name = {PYCO_TOKEN_TYPE_NONE};
+
+    // an argument is a name and an optional type, ended by a comma or the closing bracket
+    while (token_valid(cursor_get_next_token(cursor)))
+    {
+        pyco_token current_token = cursor_get_current_token(cursor);
+        const bool closed = token_is_special(current_token, ')');
+
+        if (closed || token_is_special(current_token, ','))
+        {
+            if (token_valid(argument_name))
+            {
+                pyco_ast_node_add_from_token(ast, arguments_node, argument_name, PYCO_AST_NODE_TYPE_FUNCTION, PYCO_NULL, 0);
+                function_data->arity++;
+                argument_name.type = PYCO_TOKEN_TYPE_NONE;
+            }
+
+            if (closed)
+            {
+                cursor_get_next_token(cursor);
+                break;
+            }
+
+            continue;
+        }
+
+        if (!token_valid(argument_name))
+        {
+            argument_name = current_token;
+        }
+    }
+
+    return arguments_node;
+}
+
+pyco_ast_node *_parser_handle_function_body(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    return _parse_scope(ast, cursor);
+}
+
+// `=> value` is a body that returns the value
+pyco_ast_node *_parser_handle_function_arrow_body(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    pyco_ast_node *scope_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0);
+    pyco_ast_node *return_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_RETURN, PYCO_NULL, 0);
+
+    if (!scope_node || !return_node)
+    {
+        return PYCO_NULL;
+    }
+
+    if (token_is_special(cursor_get_next_token(cursor), '>'))
+    {
+        cursor_get_next_token(cursor);
+    }
+
+    pyco_ast_node_append(return_node, _parse_expression(ast, cursor, 0, 0));
+    pyco_ast_node_append(scope_node, return_node);
+
+    return scope_node;
+}
+
+pyco_ast_node *_parser_handle_function_declaration(pyco_ast *ast, pyco_token_cursor *cursor, pyco_token identifier_token)
+{
+    pyco_ast_node *function_node = pyco_ast_node_create_from_token(ast, identifier_token, PYCO_AST_NODE_TYPE_FUNCTION, PYCO_NULL, sizeof(ast_data_function));
+
+    if (!function_node)
+    {
+        return PYCO_NULL;
+    }
+
+    pyco_ast_node *function_arguments_node = _parser_handle_function_arguments(ast, cursor, function_node->data);
+
+    pyco_ast_node *function_body_node = PYCO_NULL;
+
+    if (token_is_special(cursor_get_current_token(cursor), '='))
+    {
+        function_body_node = _parser_handle_function_arrow_body(ast, cursor);
+    }
+    else
+    {
+        // the return type is the one token between the arguments and the body
+        if (!token_is_special(cursor_get_current_token(cursor), '{'))
+        {
+            cursor_get_next_token(cursor);
+        }
+
+        function_body_node = _parser_handle_function_body(ast, cursor);
+    }
+
+    if (function_arguments_node)
+    {
+        pyco_ast_node_append(function_node, function_arguments_node);
+    }
+
+    if (function_body_node)
+    {
+        pyco_ast_node_append(function_node, function_body_node);
+    }
+
+    return function_node;
+}
+
+// MARK: parse struct
+pyco_ast_node *_parser_handle_struct_declaration(pyco_ast *ast, pyco_token_cursor *cursor, pyco_token identifier_token)
+{
+    pyco_ast_node *struct_node = pyco_ast_node_create_from_token(ast, identifier_token, PYCO_AST_NODE_TYPE_STRUCT, PYCO_NULL, sizeof(ast_data_struct));
+
+    if (!struct_node)
+    {
+        return PYCO_NULL;
+    }
+
+    ast_data_struct *struct_data = struct_node->data;
+
+    pyco_token definition_start = cursor_get_next_token(cursor);
+
+    if (!token_is_special(definition_start, '{'))
+    {
+        return false;
+    }
+
+    pyco_token field_name = {PYCO_TOKEN_TYPE_NONE};
+    pyco_token field_type = {PYCO_TOKEN_TYPE_NONE};
+    bool invalid = false;
+    bool ready_to_parse = true;
+
+    while (token_valid(cursor_get_next_token(cursor)))
+    {
+        pyco_token current_token = cursor_get_current_token(cursor);
+
+        bool is_field_completed = token_valid(field_name) && token_valid(field_type);
+
+        if (!token_valid(current_token))
+        {
+            invalid = true;
+            break;
+        }
+
+        if (token_is_indent(current_token))
+        {
+            ready_to_parse = true;
+            continue;
+        }
+
+        if (current_token.type == PYCO_TOKEN_TYPE_SPECIAL)
+        {
+            if (current_token.value[0] == ';')
+            {
+                if (token_valid(field_name) && !token_valid(field_type))
+                {
+                    break;
+                }
+
+                ready_to_parse = true;
+                continue;
+            }
+
+            if (current_token.value[0] == '}')
+            {
+                cursor_get_next_token(cursor);
+                break;
+            }
+
+            break;
+        }
+
+        if (ready_to_parse)
+        {
+            if (!token_valid(field_name))
+            {
+                field_name = current_token;
+            }
+            else if (!token_valid(field_type))
+            {
+                field_type = current_token;
+            }
+            else
+            {
+                invalid = true;
+                break;
+            }
+
+            if (token_valid(field_name) && token_valid(field_type))
+            {
+                if (field_type.flags & PYCO_TOKEN_FLAG_LINE_START)
+                {
+                    invalid = true;
+                    break;
+                }
+
+                pyco_ast_node *field_node = pyco_ast_node_add_from_token(ast, struct_node, field_name, PYCO_AST_NODE_TYPE_STRUCT_FIELD, PYCO_NULL, sizeof(ast_data_struct_field));
+
+                if (field_node != struct_node)
+                {
+                    ast_data_struct_field *field_data = field_node->data;
+
+                    field_data->type = ast_var_type_from_token(field_type);
+                    field_data->type_symbol = field_data->type == PYCO_VAR_TYPE_NAMED && field_type.type == PYCO_TOKEN_TYPE_IDENTIFIER ? field_type.payload : 0;
+                    struct_data->fields_count++;
+                }
+
+                field_name.type = PYCO_TOKEN_TYPE_NONE;
+                field_type.type = PYCO_TOKEN_TYPE_NONE;
+                ready_to_parse = false;
+            }
+        }
+    }
+
+    return struct_node;
+}
+
+// MARK: parse var declaration
+pyco_ast_node *_parser_handle_variable_declaration(pyco_ast *ast, pyco_token_cursor *cursor, pyco_token identifier_token)
+{
+    pyco_ast_node *declaration_node = pyco_ast_node_create_from_token(ast, identifier_token, PYCO_AST_NODE_TYPE_STATEMENT, PYCO_NULL, 0);
+    pyco_ast_node *expression_node = _parse_expression(ast, cursor, PYCO_NULL, 0);
+
+    pyco_ast_node_append(declaration_node, expression_node);
+
+    return declaration_node;
+}
+
+// MARK: parse declaration
+pyco_ast_node *_parser_handle_declaration(pyco_ast *ast, pyco_token_cursor *cursor, pyco_token identifier_token)
+{
+    pyco_token declaration_token = cursor_get_current_token(cursor);
+
+    pyco_token next_token = cursor_get_next_token(cursor);
+
+    if (!token_valid(next_token) || token_is_indent(next_token))
+    {
+        return false;
+    }
+
+    if (token_equals(declaration_token, "::") && next_token.type == PYCO_TOKEN_TYPE_KEYWORD)
+    {
+        if (next_token.payload == PYCO_KEYWORD_FUNCTION)
+        {
+            return _parser_handle_function_declaration(ast, cursor, identifier_token);
+        }
+
+        if (next_token.payload == PYCO_KEYWORD_STRUCT)
+        {
+            return _parser_handle_struct_declaration(ast, cursor, identifier_token);
+        }
+    }
+
+    return _parser_handle_variable_declaration(ast, cursor, identifier_token);
+}
+
+pyco_uint32 get_control_flow_type(pyco_token token)
+{
+    if (token.type != PYCO_TOKEN_TYPE_KEYWORD)
+    {
+        return PYCO_AST_NODE_TYPE_NONE;
+    }
+
+    switch (token.payload)
+    {
+    case PYCO_KEYWORD_IF:
+        return PYCO_AST_NODE_TYPE_IF;
+    case PYCO_KEYWORD_FOR:
+        return PYCO_AST_NODE_TYPE_FOR;
+    case PYCO_KEYWORD_DO:
+        return PYCO_AST_NODE_TYPE_DO_WHILE;
+    case PYCO_KEYWORD_WHILE:
+        return PYCO_AST_NODE_TYPE_WHILE;
+    case PYCO_KEYWORD_CONTINUE:
+        return PYCO_AST_NODE_TYPE_CONTINUE;
+    case PYCO_KEYWORD_BREAK:
+        return PYCO_AST_NODE_TYPE_BREAK;
+    case PYCO_KEYWORD_RETURN:
+        return PYCO_AST_NODE_TYPE_RETURN;
+    }
+
+    return PYCO_AST_NODE_TYPE_NONE;
+}
+
+// MARK: parse control flow
+pyco_ast_node *_parse_control_flow(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    pyco_token token = cursor_get_current_token(cursor);
+
+    pyco_uint32 control_flow_type = get_control_flow_type(token);
+
+    if (!token_valid(cursor_get_next_token(cursor)))
+    {
+        return PYCO_NULL;
+    }
+
+    // break, continue and return have no parts
+    const pyco_uint64 data_size = ast_node_is_control_flow(control_flow_type) ? sizeof(ast_data_control_flow) : 0;
+    pyco_ast_node *control_flow_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, control_flow_type, PYCO_NULL, data_size);
+
+    if (!control_flow_node)
+    {
+        return PYCO_NULL;
+    }
+
+    ast_data_control_flow *control_flow_data = control_flow_node->data;
+
+    if (control_flow_type == PYCO_AST_NODE_TYPE_IF)
+    {
+        pyco_ast_node *true_path_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_IF_TRUE, control_flow_type, PYCO_NULL, 0);
+        pyco_ast_node *condition_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_CONDITION, control_flow_type, PYCO_NULL, 0);
+        pyco_ast_node *expression_node = _parse_expression(ast, cursor, 0, 0);
+        pyco_ast_node *body_node = _parse_scope(ast, cursor);
+
+        pyco_ast_node_append(condition_node, expression_node);
+        pyco_ast_node_append(true_path_node, condition_node);
+        pyco_ast_node_append(true_path_node, body_node);
+        pyco_ast_node_append(control_flow_node, true_path_node);
+
+        control_flow_data->condition = expression_node;
+        control_flow_data->body = body_node;
+
+        pyco_token current_token = cursor_get_current_token(cursor);
+
+        if (token_is_keyword(current_token, PYCO_KEYWORD_ELSE))
+        {
+            pyco_token else_token = cursor_get_next_token(cursor);
+
+            if (!token_valid(else_token))
+            {
+                return PYCO_NULL;
+            }
+
+            pyco_ast_node *else_path_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_ELSE, control_flow_type, PYCO_NULL, 0);
+
+            if (token_is_special(else_token, '{'))
+            {
+                pyco_ast_node *else_body_node = _parse_scope(ast, cursor);
+                pyco_ast_node_append(else_path_node, else_body_node);
+                control_flow_data->else_body = else_body_node;
+            }
+
+            if (token_is_keyword(else_token, PYCO_KEYWORD_IF))
+            {
+                pyco_ast_node *else_body_node = _parse_control_flow(ast, cursor);
+                pyco_ast_node_append(else_path_node, else_body_node);
+                control_flow_data->else_body = else_body_node;
+            }
+
+            pyco_ast_node_append(control_flow_node, else_path_node);
+        }
+    }
+
+    if (control_flow_type == PYCO_AST_NODE_TYPE_WHILE)
+    {
+        pyco_ast_node *condition_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_CONDITION, control_flow_type, PYCO_NULL, 0);
+        pyco_ast_node *expression_node = _parse_expression(ast, cursor, 0, 0);
+        pyco_ast_node *body_node = _parse_scope(ast, cursor);
+
+        pyco_ast_node_append(control_flow_node, condition_node);
+        pyco_ast_node_append(condition_node, expression_node);
+        pyco_ast_node_append(control_flow_node, body_node);
+
+        control_flow_data->condition = expression_node;
+        control_flow_data->body = body_node;
+    }
+
+    if (control_flow_type == PYCO_AST_NODE_TYPE_DO_WHILE)
+    {
+        pyco_token current_token = cursor_get_current_token(cursor);
+
+        if (!token_is_special(current_token, '{'))
+        {
+            return PYCO_NULL;
+        }
+
+        pyco_ast_node *body_node = _parse_scope(ast, cursor);
+
+        current_token = cursor_get_current_token(cursor);
+
+        if (!token_is_keyword(current_token, PYCO_KEYWORD_WHILE) || !token_valid(cursor_get_next_token(cursor)))
+        {
+            return PYCO_NULL;
+        }
+
+        pyco_ast_node *condition_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_CONDITION, control_flow_type, PYCO_NULL, 0);
+        pyco_ast_node *expression_node = _parse_expression(ast, cursor, 0, 0);
+
+        pyco_ast_node_append(control_flow_node, condition_node);
+        pyco_ast_node_append(condition_node, expression_node);
+        pyco_ast_node_append(control_flow_node, body_node);
+
+        control_flow_data->condition = expression_node;
+        control_flow_data->body = body_node;
+    }
+
+    if (control_flow_type == PYCO_AST_NODE_TYPE_FOR)
+    {
+        pyco_token current_token = cursor_get_current_token(cursor);
+
+        if (!token_is_special(current_token, '{'))
+        {
+            pyco_ast_node *arguments_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_ARGUMENTS, control_flow_type, PYCO_NULL, 0);
+            pyco_ast_node *expression_node = PYCO_NULL;
+            // `for condition` or `for initializer; condition; step`, an empty part is PYCO_NULL
+            pyco_ast_node *parts[3] = {PYCO_NULL};
+            pyco_uint32 parts_count = 0;
+            do
+            {
+                current_token = cursor_get_current_token(cursor);
+
+                if (token_is_special(current_token, ';'))
+                {
+                    if (expression_node == PYCO_NULL)
+                    {
+                        pyco_ast_node *empty_argument_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_ARGUMENT_PART_EMPTY, control_flow_type, PYCO_NULL, 0);
+                        pyco_ast_node_append(arguments_node, empty_argument_node);
+
+                        if (parts_count < 3)
+                        {
+                            parts[parts_count++] = PYCO_NULL;
+                        }
+                    }
+                    continue;
+                }
+
+                if (expression_node = _parse_expression(ast, cursor, 0, 0))
+                {
+                    pyco_ast_node *argument_expression_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_ARGUMENT_EXPRESSION, control_flow_type, PYCO_NULL, 0);
+                    pyco_ast_node_append(argument_expression_node, expression_node);
+                    pyco_ast_node_append(arguments_node, argument_expression_node);
+
+                    if (parts_count < 3)
+                    {
+                        parts[parts_count++] = expression_node;
+                    }
+                }
+
+                current_token = cursor_get_current_token(cursor);
+
+                if (token_is_special(current_token, '{'))
+                {
+                    break;
+                }
+            } while (token_valid(cursor_get_next_token(cursor)));
+
+            pyco_ast_node_append(control_flow_node, arguments_node);
+
+            if (parts_count == 1)
+            {
+                control_flow_data->condition = parts[0];
+            }
+            else
+            {
+                control_flow_data->initializer = parts[0];
+                control_flow_data->condition = parts[1];
+                control_flow_data->step = parts[2];
+            }
+        }
+
+        pyco_ast_node *body_node = _parse_scope(ast, cursor);
+
+        pyco_ast_node_append(control_flow_node, body_node);
+        control_flow_data->body = body_node;
+    }
+
+    if (control_flow_type == PYCO_AST_NODE_TYPE_RETURN)
+    {
+        pyco_token current_token = cursor_get_current_token(cursor);
+
+        // the value is on the line of the return, without one the function returns nothing
+        if (!(current_token.flags & PYCO_TOKEN_FLAG_LINE_START) && !token_is_indent(current_token) && !token_is_special(current_token, '}') &&
+            !token_is_special(current_token, ';'))
+        {
+            pyco_ast_node_append(control_flow_node, _parse_expression(ast, cursor, 0, 0));
+        }
+    }
+
+    return control_flow_node;
+}
+
+// MARK: parse scope
+// parses the statement at the current token into the scope and leaves the token after it current,
+// false when the statement closed the scope
+static inline bool _parse_scope_statement(pyco_ast *ast, pyco_token_cursor *cursor, pyco_ast_node *scope_node)
+{
+    pyco_token token = cursor_get_current_token(cursor);
+
+    if (token_is_indent(token) || token_is_special(token, ';'))
+    {
+        cursor_get_next_token(cursor);
+        return true;
+    }
+
+    if (token_is_special(token, '{'))
+    {
+        pyco_ast_node_append(scope_node, _parse_scope(ast, cursor));
+        return true;
+    }
+
+    if (get_control_flow_type(token))
+    {
+        pyco_ast_node_append(scope_node, _parse_control_flow(ast, cursor));
+        return true;
+    }
+
+    pyco_ast_node *expression_node = _parse_expression(ast, cursor, 0, 0);
+
+    if (expression_node)
+    {
+        pyco_ast_node_append(scope_node, expression_node);
+    }
+
+    token = cursor_get_current_token(cursor);
+
+    if (token_is_special(token, '}'))
+    {
+        cursor_get_next_token(cursor);
+        return false;
+    }
+
+    return true;
+}
+
+pyco_ast_node *_parse_scope_body(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    pyco_ast_node *scope_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0);
+
+    do
+    {
+        if (!_parse_scope_statement(ast, cursor, scope_node))
+        {
+            break;
+        }
+    } while (token_valid(cursor_get_current_token(cursor)));
+
+    return scope_node;
+}
+
+pyco_ast_node *_parse_scope(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    if (!token_valid(cursor_get_next_token(cursor)))
+    {
+        return PYCO_NULL;
+    }
+
+    return _parse_scope_body(ast, cursor);
+}
+
+// MARK: parse expression
+pyco_ast_node *_parse_expression(pyco_ast *ast, pyco_token_cursor *cursor, pyco_uint32 flags, pyco_uint8 minimum_binding_power)
+{
+    pyco_token left_hand_token = cursor_get_current_token(cursor);
+    pyco_ast_node *left_hand_side = PYCO_NULL;
+
+    const pyco_operator_info *prefix_operator = token_operator(left_hand_token);
+
+    if (token_is_special(left_hand_token, '{') || token_is_special(left_hand_token, '}'))
+    {
+        return left_hand_side;
+    }
+
+    cursor_get_next_token(cursor);
+
+    if (prefix_operator->prefix_power)
+    {
+        pyco_ast_node *right_hand_side = _parse_expression(ast, cursor, flags, prefix_operator->prefix_power);
+        left_hand_side = _parser_create_expression(ast, left_hand_token, 1);
+        pyco_ast_node_append(left_hand_side, right_hand_side);
+    }
+    else if (prefix_operator->operator == PYCO_OPERATOR_GROUPING)
+    {
+        pyco_ast_node *expression = _parse_expression(ast, cursor, flags, 0);
+        left_hand_side = _parser_create_expression(ast, left_hand_token, 1);
+        pyco_ast_node_append(left_hand_side, expression);
+        cursor_get_next_token(cursor);
+    }
+    else if (prefix_operator->operator == PYCO_OPERATOR_ARRAY_INDEX)
+    {
+        // `[size]element`, the element type binds like a postfix operator so `[2][3]int32` nests
+        pyco_ast_node *size_node = _parse_expression(ast, cursor, flags, 0);
+        cursor_get_next_token(cursor);
+        pyco_ast_node *element_node = _parse_expression(ast, cursor, flags, prefix_operator->postfix_power);
+
+        if (!(left_hand_side = _parser_create_expression(ast, left_hand_token, 2)))
+        {
+            return PYCO_NULL;
+        }
+
+        left_hand_side->label = PYCO_AST_LABEL_ARRAY_TYPE;
+        pyco_ast_node_append(left_hand_side, size_node);
+        pyco_ast_node_append(left_hand_side, element_node);
+    }
+    else
+    {
+        const bool is_number = _token_type_is_number(left_hand_token.type);
+        const bool is_string = left_hand_token.type == PYCO_TOKEN_TYPE_STRING || left_hand_token.type == PYCO_TOKEN_TYPE_STRING_TEMPLATE_LITERAL;
+        const pyco_uint32 literal_flags = (is_string ? PYCO_AST_LITERAL_FLAG_STRING : 0) |
+                                          (is_number && left_hand_token.type != PYCO_TOKEN_TYPE_INTEGER ? PYCO_AST_LITERAL_FLAG_REAL : 0);
+
+        left_hand_side = pyco_ast_node_create_from_token(ast, left_hand_token, PYCO_AST_NODE_TYPE_LITERAL, literal_flags, is_number ? sizeof(ast_data_literal) : 0);
+
+        if (is_number && left_hand_side)
+        {
+            ast_data_literal *literal_data = left_hand_side->data;
+
+            literal_data->value = left_hand_token.literal;
+            literal_data->flags = left_hand_token.payload | (left_hand_token.flags & PYCO_TOKEN_FLAG_ERROR_MALFORMED ? PYCO_LITERAL_FLAG_MALFORMED : 0);
+        }
+    }
+
+    do
+    {
+        pyco_token operator_token = cursor_get_current_token(cursor);
+        const pyco_operator_info *info = token_operator(operator_token);
+        const pyco_uint32 operator = info->operator;
+
+        if (!operator)
+        {
+            break;
+        }
+
+        if (info->postfix_power)
+        {
+            if (info->postfix_power < minimum_binding_power)
+            {
+                break;
+            }
+
+            cursor_get_next_token(cursor);
+
+            if (operator == PYCO_OPERATOR_ARRAY_INDEX)
+            {
+                pyco_ast_node *right_hand_side = _parse_expression(ast, cursor, flags, 0);
+                pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, PYCO_AST_LABEL_INDEX_OPERATOR, PYCO_AST_NODE_TYPE_EXPRESSION, 0, sizeof(ast_data_expression));
+
+                if (!new_left_hand_side)
+                {
+                    return PYCO_NULL;
+                }
+
+                new_left_hand_side->operator = PYCO_OPERATOR_ID_ARRAY_INDEX;
+                ((ast_data_expression *)new_left_hand_side->data)->arity = 2;
+
+                pyco_ast_node_append(new_left_hand_side, left_hand_side);
+                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+
+                left_hand_side = new_left_hand_side;
+
+                cursor_get_next_token(cursor);
+            }
+            else
+            {
+                pyco_ast_node *new_left_hand_side = _parser_create_expression(ast, operator_token, 1);
+                pyco_ast_node_append(new_left_hand_side, left_hand_side);
+                left_hand_side = new_left_hand_side;
+            }
+
+            continue;
+        }
+
+        if (flags & PYCO_OPERATOR_FUNCTION_CALL && token_is_special(operator_token, ','))
+        {
+            break;
+        }
+
+        if (operator == PYCO_OPERATOR_INVALID)
+        {
+            // throw error: invalid operator found "operation"
+            return PYCO_NULL;
+        }
+
+        if (operator & PYCO_OPERATOR_ASSIGN_TYPE && (operator & PYCO_OPERATOR_ASSIGN || operator & PYCO_OPERATOR_ASSIGN_CONST))
+        {
+            left_hand_side = _parser_handle_declaration(ast, cursor, left_hand_token);
+            break;
+        }
+
+        if (left_hand_token.type == PYCO_TOKEN_TYPE_IDENTIFIER && operator == PYCO_OPERATOR_GROUPING)
+        {
+            pyco_ast_node *new_left_hand_side = pyco_ast_node_create_from_token(ast, left_hand_token, PYCO_AST_NODE_TYPE_CALL, 0, sizeof(ast_data_call));
+
+            if (!new_left_hand_side)
+            {
+                return PYCO_NULL;
+            }
+
+            ast_data_call *call_data = new_left_hand_side->data;
+
+            cursor_get_next_token(cursor);
+
+            do
+            {
+                pyco_token current_token = cursor_get_current_token(cursor);
+
+                if (!token_valid(current_token) || token_is_special(current_token, ')'))
+                {
+                    break;
+                }
+
+                if (token_is_special(current_token, ','))
+                {
+                    cursor_get_next_token(cursor);
+                    continue;
+                }
+
+                pyco_ast_node *expression = _parse_expression(ast, cursor, flags | PYCO_OPERATOR_FUNCTION_CALL, 0);
+
+                // a bracket where an argument should be ends the call, it is not moved past
+                if (!expression)
+                {
+                    break;
+                }
+
+                pyco_ast_node_append(new_left_hand_side, expression);
+                call_data->arguments_count++;
+            } while (true);
+
+            cursor_get_next_token(cursor);
+            pyco_ast_node_append(left_hand_side, new_left_hand_side);
+            left_hand_side = new_left_hand_side;
+
+            continue;
+        }
+
+        if (info->infix_powers)
+        {
+            pyco_uint8 left_binding_power = (info->infix_powers >> 8) & 0xFF;
+            pyco_uint8 right_binding_power = info->infix_powers & 0xFF;
+
+            if (left_binding_power < minimum_binding_power)
+            {
+                break;
+            }
+
+            cursor_get_next_token(cursor);
+
+            if (info->operator == PYCO_OPERATOR_TERNARY)
+            {
+                pyco_ast_node *middle_hand_side = _parse_expression(ast, cursor, flags, 0);
+
+                if (token_is_special(cursor_get_current_token(cursor), ':'))
+                {
+                    cursor_get_next_token(cursor);
+                }
+
+                pyco_ast_node *right_hand_side = _parse_expression(ast, cursor, flags, right_binding_power);
+                pyco_ast_node *new_left_hand_side = _parser_create_expression(ast, operator_token, 3);
+
+                pyco_ast_node_append(new_left_hand_side, left_hand_side);
+                pyco_ast_node_append(new_left_hand_side, middle_hand_side);
+                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+
+                left_hand_side = new_left_hand_side;
+            }
+            else
+            {
+                pyco_ast_node *right_hand_side = _parse_expression(ast, cursor, flags, right_binding_power);
+                pyco_ast_node *new_left_hand_side = _parser_create_expression(ast, operator_token, 2);
+
+                pyco_ast_node_append(new_left_hand_side, left_hand_side);
+                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+
+                left_hand_side = new_left_hand_side;
+            }
+
+            continue;
+        }
+
+        break;
+    } while (true);
+
+    return left_hand_side;
+}
+
+bool _parser_handle_file(pyco_ast *ast, pyco_token_cursor *cursor)
+{
+    // the file is a scope without braces, it starts at the first token
+    if (!token_valid(cursor_get_current_token(cursor)) || !(ast->root_node = _parse_scope_body(ast, cursor)))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// MARK: parse in parallel
+
+// below this many tokens starting the threads costs more than the parse
+#define PYCO_PARSER_PARALLEL_MIN_TOKENS (32 * 1024)
+
+// a run of top-level statements from its first token up to the first token of the next slice
+typedef struct pyco_parse_slice
+{
+    const pyco_token_block *block;
+    pyco_uint64 index;
+    pyco_uint64 end; // stream position where the next slice starts, ~0 for the last slice
+    pyco_ast_node *scope_node;
+    bool valid;
+} pyco_parse_slice;
+
+typedef struct pyco_parse_job
+{
+    const pyco_uint8 *source; // of the tokens, the workers only get cursors and never see the lexer
+    pyco_ast_options tree_options;
+    pyco_parse_slice *slices;
+    pyco_uint32 slices_count;
+    pyco_uint32 next_slice;
+    bool failed; // a slice did not land on the next one, the rest are not worth parsing
+    pyco_mutex mutex;
+} pyco_parse_job;
+
+typedef struct pyco_parse_worker
+{
+    pyco_parse_job *job;
+    pyco_ast ast;
+} pyco_parse_worker;
+
+// splits the tokens before top-level `name ::` declarations into slices of about slice_size tokens.
+// 0 when the file has a closing bracket too many, the serial parse stops at it
+pyco_uint32 _parser_split_file(const pyco_lexer *lexer, pyco_parse_slice *slices, pyco_uint32 max_slices, pyco_uint64 slice_size)
+{
+    pyco_uint32 count = 1;
+    pyco_uint64 depth = 0;
+    pyco_uint64 slice_tokens = 0;
+    const pyco_token_block *previous_block = PYCO_NULL;
+    pyco_uint64 previous_index = 0;
+    bool previous_starts_line = false;
+
+    slices[0] = (pyco_parse_slice){.block = lexer->token_block_first, .end = ~0ull};
+
+    for (const pyco_token_block *block = lexer->token_block_first; block; block = block->next)
+    {
+        for (pyco_uint64 i = 0; i < block->count; i++, slice_tokens++)
+        {
+            const pyco_uint8 kind = block->kinds[i];
+            const pyco_uint8 type = kind & PYCO_TOKEN_TYPE_MASK;
+
+            if (type == PYCO_TOKEN_TYPE_SPECIAL && block->lengths[i] == 1)
+            {
+                const pyco_uint8 ch = lexer->source[block->offsets[i]];
+
+                if (ch == '{' || ch == '(' || ch == '[')
+                {
+                    depth++;
+                }
+                else if (ch == '}' || ch == ')' || ch == ']')
+                {
+                    if (!depth--)
+                    {
+                        return 0;
+                    }
+                }
+            }
+            else if (type == PYCO_TOKEN_TYPE_SPECIAL && block->payloads[i] == PYCO_OPERATOR_ID_DECLARE_CONST && previous_starts_line && !depth &&
+                     slice_tokens >= slice_size && count < max_slices)
+            {
+                slices[count - 1].end = previous_block->first + previous_index;
+                slices[count++] = (pyco_parse_slice){.block = previous_block, .index = previous_index, .end = ~0ull};
+                slice_tokens = 1;
+            }
+
+            previous_block = block;
+            previous_index = i;
+            previous_starts_line = type == PYCO_TOKEN_TYPE_IDENTIFIER && (kind & PYCO_TOKEN_FLAG_LINE_START);
+        }
+    }
+
+    return count;
+}
+
+static void _parser_parse_worker_run(void *argument)
+{
+    pyco_parse_worker *worker = argument;
+    pyco_parse_job *job = worker->job;
+
+    // slices left unparsed stay invalid and the file is parsed again on the calling thread
+    if (!(worker->ast = initialize_tree(job->tree_options)).root_node)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        _pyco_mutex_lock(&job->mutex);
+        const pyco_uint32 index = job->failed ? job->slices_count : job->next_slice++;
+        _pyco_mutex_unlock(&job->mutex);
+
+        if (index >= job->slices_count)
+        {
+            break;
+        }
+
+        pyco_parse_slice *slice = &job->slices[index];
+
+        // the slice gets a cursor of its own over the shared tokens. it sees the tokens past its end as well,
+        // so its statements are parsed exactly like in the serial parse
+        pyco_token_cursor cursor = {
+            .source = job->source,
+            .block = slice->block,
+            .index = slice->index,
+        };
+
+        pyco_ast_node *scope_node = pyco_ast_node_create(&worker->ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0);
+        bool open = true;
+        bool more = true;
+
+        do
+        {
+            open = _parse_scope_statement(&worker->ast, &cursor, scope_node);
+        } while (open && (more = token_valid(cursor_get_current_token(&cursor))) && _cursor_position(&cursor) < slice->end);
+
+        // the serial parse would start a statement at the first token of the next slice only when this one lands on it
+        slice->scope_node = scope_node;
+        slice->valid = slice->end == ~0ull || (open && more && _cursor_position(&cursor) == slice->end);
+
+        if (!slice->valid)
+        {
+            _pyco_mutex_lock(&job->mutex);
+            job->failed = true;
+            _pyco_mutex_unlock(&job->mutex);
+        }
+    }
+}
+
+// parses the top-level statements of the file on several threads into trees of their own and moves them into one scope in
+// source order. false when the file could not be split or a slice was not parsed the way the serial parse would do it
+bool _parser_handle_file_parallel(pyco_ast *ast, pyco_lexer *lexer, pyco_uint32 threads)
+{
+    const pyco_allocators *allocators = &ast->options.allocators;
+    const pyco_uint32 max_slices = threads * 4;
+
+    pyco_parse_job job = {
+        .source = lexer->source,
+        .tree_options = {
+            .allocators = ast->options.allocators,
+            .arena_size_hint = lexer->tokens_count / threads * _arena_align(sizeof(pyco_ast_node)),
+        },
+    };
+
+    if (!(job.slices = _pyco_malloc(allocators, sizeof(pyco_parse_slice) * max_slices)))
+    {
+        return false;
+    }
+
+    job.slices_count = _parser_split_file(lexer, job.slices, max_slices, lexer->tokens_count / max_slices);
+
+    const pyco_uint32 workers_count = job.slices_count < threads ? job.slices_count : threads;
+    pyco_parse_worker *workers = workers_count > 1 ? _pyco_malloc(allocators, sizeof(pyco_parse_worker) * workers_count) : PYCO_NULL;
+
+    if (!workers)
+    {
+        _pyco_free(allocators, job.slices);
+        return false;
+    }
+
+    for (pyco_uint32 i = 0; i < workers_count; i++)
+    {
+        workers[i] = (pyco_parse_worker){.job = &job};
+    }
+
+    _pyco_mutex_init(&job.mutex);
+    _pyco_run_parallel(_parser_parse_worker_run, workers, sizeof(pyco_parse_worker), workers_count, allocators);
+    _pyco_mutex_destroy(&job.mutex);
+
+    bool valid = !job.failed;
+
+    for (pyco_uint32 i = 0; i < job.slices_count; i++)
+    {
+        valid = valid && job.slices[i].valid;
+    }
+
+    // the trees of the workers stay alive as parts of this one, their nodes are linked into it
+    pyco_ast *parts = valid ? _pyco_malloc(allocators, sizeof(pyco_ast) * workers_count) : PYCO_NULL;
+    pyco_ast_node *scope_node = parts ? pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0) : PYCO_NULL;
+
+    if (scope_node)
+    {
+        for (pyco_uint32 i = 0; i < job.slices_count; i++)
+        {
+            for (pyco_ast_node *node = job.slices[i].scope_node->child_first; node;)
+            {
+                pyco_ast_node *next_node = node->next;
+                node->next = PYCO_NULL;
+                pyco_ast_node_append(scope_node, node);
+                node = next_node;
+            }
+        }
+
+        for (pyco_uint32 i = 0; i < workers_count; i++)
+        {
+            parts[i] = workers[i].ast;
+            ast->nodes_count += parts[i].nodes_count;
+            ast->data_words += parts[i].data_words;
+            ast->failed |= parts[i].failed;
+        }
+
+        ast->root_node = scope_node;
+        ast->parts = parts;
+        ast->parts_count = workers_count;
+    }
+    else
+    {
+        for (pyco_uint32 i = 0; i < workers_count; i++)
+        {
+            pyco_ast_free(&workers[i].ast, workers[i].ast.root_node);
+        }
+
+        if (parts)
+        {
+            _pyco_free(allocators, parts);
+        }
+    }
+
+    _pyco_free(allocators, job.slices);
+    _pyco_free(allocators, workers);
+
+    return scope_node != PYCO_NULL;
+}
+
+typedef struct build_ast_options
+{
+    pyco_allocators allocators;
+    pyco_arena *arena;
+    bool indent_based;
+    pyco_uint32 threads; // top-level statements of large files are parsed on this many threads
+    bool shared_arena;   // the arena holds more than the tree, parser_build_flat_ast does not rewind it
+} build_ast_options;
+
+// the linked tree of a statement is dropped once it is flattened, the arena only ever holds one or two of them
+#define PYCO_PARSER_STATEMENT_ARENA_SIZE (64 * 1024)
+
+// in pull mode the token count is not known yet and is estimated from the source size
+static inline pyco_uint64 _parser_tokens_count(pyco_lexer *lexer)
+{
+    return lexer->token_ring ? lexer->source_size / 4 : lexer->tokens_count;
+}
+
+// scripts build less than one node per token, so the token count bounds the arena size
+static inline pyco_uint64 _parser_arena_size_hint(pyco_lexer *lexer)
+{
+    return _parser_tokens_count(lexer) * _arena_align(sizeof(pyco_ast_node));
+}
+
+// pull mode lexes while parsing, so the tokens can not be split upfront
+static inline bool _parser_parallel(pyco_lexer *lexer, build_ast_options options)
+{
+    return options.threads > 1 && !lexer->token_ring && lexer->tokens_count >= PYCO_PARSER_PARALLEL_MIN_TOKENS;
+}
+
+pyco_ast parser_build_ast(pyco_lexer *lexer, build_ast_options options)
+{
+    pyco_ast_options tree_options = {
+        .allocators = options.allocators,
+        .arena = options.arena,
+        .arena_size_hint = _parser_arena_size_hint(lexer),
+    };
+
+    pyco_ast ast = initialize_tree(tree_options);
+
+    // without an arena or a root there is nothing to parse into, the tree stays empty and the compile fails
+    if (!ast.arena || !ast.root_node)
+    {
+        return ast;
+    }
+
+    if (_parser_parallel(lexer, options) && _parser_handle_file_parallel(&ast, lexer, options.threads))
+    {
+        return ast;
+    }
+
+    pyco_token_cursor cursor = lexer_cursor(lexer);
+
+    _parser_handle_file(&ast, &cursor);
+
+    return ast;
+}
+
+// parses the file like _parser_handle_file but flattens every top-level statement as soon as it is parsed.
+// the linked nodes of the statement are not needed after that and the arena is rewound to where they start
+bool _parser_flatten_file(pyco_ast *ast, pyco_token_cursor *cursor, pyco_flat_ast *flat, bool rewind)
+{
+    // an empty file stays a lone root
+    if (token_valid(cursor_get_current_token(cursor)) &&
+        !(ast->root_node = pyco_ast_node_create(ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0)))
+    {
+        return false;
+    }
+
+    pyco_ast_node *scope_node = ast->root_node;
+    const pyco_arena_mark mark = _arena_mark(ast->arena);
+
+    _flat_ast_add_subtree(flat, scope_node);
+
+    for (bool open = scope_node->type == PYCO_AST_NODE_TYPE_SCOPE; open;)
+    {
+        const pyco_uint64 nodes_count = ast->nodes_count;
+        const pyco_uint64 data_words = ast->data_words;
+
+        open = _parse_scope_statement(ast, cursor, scope_node) && token_valid(cursor_get_current_token(cursor));
+
+        // a statement adds one child to the scope at most, the nodes made since the last one bound its size
+        if (scope_node->child_first)
+        {
+            if (!_flat_ast_grow(flat, (void **)&flat->nodes, &flat->nodes_allocated, sizeof(pyco_flat_node) * (flat->count + ast->nodes_count - nodes_count)) ||
+                !_flat_ast_grow(flat, (void **)&flat->data, &flat->data_allocated, sizeof(pyco_uint64) * (flat->data_count + ast->data_words - data_words)))
+            {
+                return false;
+            }
+
+            _flat_ast_add_subtree(flat, scope_node->child_first);
+            scope_node->child_first = PYCO_NULL;
+            scope_node->child_last = PYCO_NULL;
+        }
+
+        if (rewind)
+        {
+            const pyco_uint64 used = _arena_used(ast->arena);
+
+            ast->arena_peak = used > ast->arena_peak ? used : ast->arena_peak;
+            _arena_rewind(ast->arena, mark);
+        }
+    }
+
+    flat->nodes[0].size = flat->count;
+
+    return !ast->failed;
+}
+
+// builds the flat tree of the file without holding the linked tree of all of it. the tree that is returned only has
+// the root left, the caller frees it. a file parsed on several threads is linked in full and flattened once joined
+pyco_ast parser_build_flat_ast(pyco_lexer *lexer, build_ast_options options, pyco_flat_ast *flat)
+{
+    if (_parser_parallel(lexer, options))
+    {
+        pyco_ast ast = parser_build_ast(lexer, options);
+        pyco_ast_flatten_into(&ast, lexer->source, flat);
+
+        return ast;
+    }
+
+    pyco_ast_options tree_options = {
+        .allocators = options.allocators,
+        .arena = options.arena,
+        .arena_size_hint = PYCO_PARSER_STATEMENT_ARENA_SIZE,
+    };
+
+    pyco_ast ast = initialize_tree(tree_options);
+
+    flat->source = lexer->source;
+    flat->count = 0;
+    flat->data_count = 0;
+
+    // scripts build about one node and half a payload word per token, the arrays start there and grow when a file needs more
+    const pyco_uint64 tokens_count = _parser_tokens_count(lexer);
+
+    if (!ast.arena || !ast.root_node ||
+        !_flat_ast_grow(flat, (void **)&flat->nodes, &flat->nodes_allocated, sizeof(pyco_flat_node) * (tokens_count + 16)) ||
+        !_flat_ast_grow(flat, (void **)&flat->data, &flat->data_allocated, sizeof(pyco_uint64) * (tokens_count / 2 + 16)))
+    {
+        return ast;
+    }
+
+    flat->data_count = 1;
+
+    pyco_token_cursor cursor = lexer_cursor(lexer);
+
+    if (!_parser_flatten_file(&ast, &cursor, flat, !options.shared_arena))
+    {
+        flat->count = 0;
+    }
+
+    return ast;
+}
+
+pyco_compile_options pyco_initialize_compile_options()
+{
+    pyco_compile_options options;
+
+    options.allocators.malloc = PYCO_NULL;
+    options.allocators.realloc = PYCO_NULL;
+    options.allocators.free = PYCO_NULL;
+    options.allocators.context = PYCO_NULL;
+
+    options.copy_buffer = 0;
+    options.token_window = 0;
+    options.indent_based = 0;
+    options.symbols = PYCO_NULL;
+    options.arena = PYCO_NULL;
+    options.collect_stats = 0;
+    options.phase_callback = PYCO_NULL;
+    options.phase_callback_data = PYCO_NULL;
+    options.ast_json_path = PYCO_NULL;
+    options.ast_binary_path = PYCO_NULL;
+    options.linear_allocation = 0;
+    options.linear_initial_size = 0;
+    options.parse_threads = 0;
+    options.cache_directory = PYCO_NULL;
+
+    return options;
+}
+
+// MARK: COMPILE CACHE
+
+// a compiled program is kept in the cache directory in a file named after a hash of its source, the compiler
+// version and the options that change the program. files are written under a name of their own and renamed
+// into place, so a process that opens one sees either no file or a whole one
+#define PYCO_CACHE_MAGIC 0x48434150u // "PACH"
+#define PYCO_CACHE_VERSION 2
+
+#define PYCO_HASH_PRIME_1 0x9E3779B185EBCA87ull
+#define PYCO_HASH_PRIME_2 0xC2B2AE3D27D4EB4Full
+
+typedef struct pyco_cache_header
+{
+    pyco_uint32 magic;
+    pyco_uint32 version;
+    pyco_uint64 key;
+    pyco_uint64 source_hash;
+    pyco_uint64 source_size;
+    pyco_uint64 data_size;
+    pyco_uint32 valid;
+    pyco_uint32 errors;
+} pyco_cache_header;
+
+typedef struct pyco_cache_key
+{
+    pyco_uint64 key; // names the file
+    pyco_uint64 source_hash;
+    pyco_uint64 source_size;
+} pyco_cache_key;
+
+static inline pyco_uint64 _pyco_hash_round(pyco_uint64 hash, pyco_uint64 word)
+{
+    hash += word * PYCO_HASH_PRIME_2;
+    hash = (hash << 31) | (hash >> 33);
+
+    return hash * PYCO_HASH_PRIME_1;
+}
+
+// four lanes over 32 byte stripes keep several multiplies in flight, hashing a script costs little next to lexing it
+pyco_uint64 _pyco_hash(const pyco_uint8 *data, pyco_uint64 size, pyco_uint64 seed)
+{
+    pyco_uint64 lanes[4] = {seed + PYCO_HASH_PRIME_1 + PYCO_HASH_PRIME_2, seed + PYCO_HASH_PRIME_2, seed, seed - PYCO_HASH_PRIME_1};
+    pyco_uint64 offset = 0;
+
+    for (; offset + 32 <= size; offset += 32)
+    {
+        lanes[0] = _pyco_hash_round(lanes[0], _symbol_load64(data + offset));
+        lanes[1] = _pyco_hash_round(lanes[1], _symbol_load64(data + offset + 8));
+        lanes[2] = _pyco_hash_round(lanes[2], _symbol_load64(data + offset + 16));
+        lanes[3] = _pyco_hash_round(lanes[3], _symbol_load64(data + offset + 24));
+    }
+
+    pyco_uint64 hash = _pyco_hash_round(_pyco_hash_round(_pyco_hash_round(_pyco_hash_round(size, lanes[0]), lanes[1]), lanes[2]), lanes[3]);
+
+    for (; offset + 8 <= size; offset += 8)
+    {
+        hash = _pyco_hash_round(hash, _symbol_load64(data + offset));
+    }
+
+    if (offset < size)
+    {
+        pyco_uint64 word = 0;
+        memcpy(&word, data + offset, size - offset);
+        hash = _pyco_hash_round(hash, word);
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+// false when the compile does not use the cache. the dumps are made from the tree, so a compile that writes them
+// has to parse
+static inline bool _pyco_cache_key(const pyco_compile_options *options, const pyco_uint8 *data, pyco_uint64 size, pyco_cache_key *key)
+{
+    if (!options->cache_directory || options->ast_json_path || options->ast_binary_path)
+    {
+        return false;
+    }
+
+    // only the options that change the program, the others change how it is compiled
+    const pyco_uint64 options_word = (pyco_uint64)!!options->indent_based;
+
+    key->source_hash = _pyco_hash(data, size, 0);
+    key->source_size = size;
+    key->key = _pyco_hash((const pyco_uint8 *)PYCO_VERSION, strlen(PYCO_VERSION), _pyco_hash_round(key->source_hash, options_word + PYCO_CACHE_VERSION));
+
+    return true;
+}
+
+// the file of the key, or a temporary one next to it when unique is not 0
+static char *_pyco_cache_path(const pyco_compile_options *options, const pyco_cache_key *key, pyco_uint64 unique)
+{
+    const pyco_uint64 size = strlen(options->cache_directory) + 64;
+    char *path = _pyco_malloc(&options->allocators, size);
+
+    if (!path)
+    {
+        return PYCO_NULL;
+    }
+
+    if (unique)
+    {
+        snprintf(path, size, "%s/%016llx.%llx.tmp", options->cache_directory, key->key, unique);
+    }
+    else
+    {
+        snprintf(path, size, "%s/%016llx.pyco-cache", options->cache_directory, key->key);
+    }
+
+    return path;
+}
+
+bool _pyco_cache_load(const pyco_compile_options *options, const pyco_cache_key *key, pyco_compiled_program *program)
+{
+    char *path = _pyco_cache_path(options, key, 0);
+    FILE *file = path ? fopen(path, "rb") : PYCO_NULL;
+
+    if (path)
+    {
+        _pyco_free(&options->allocators, path);
+    }
+
+    if (!file)
+    {
+        return false;
+    }
+
+    pyco_cache_header header;
+    pyco_uint8 *data = PYCO_NULL;
+
+    // the key only names the file, the hash and size of the source tell apart two scripts whose keys collide
+    bool loaded = fread(&header, sizeof(header), 1, file) == 1 && header.magic == PYCO_CACHE_MAGIC && header.version == PYCO_CACHE_VERSION &&
+                  header.key == key->key && header.source_hash == key->source_hash && header.source_size == key->source_size;
+
+    // the program size is checked against the file before anything is allocated for it, so a truncated or
+    // damaged file is a miss rather than a huge allocation. programs address themselves with 32 bits
+    long file_size = -1;
+
+    if (loaded && fseek(file, 0, SEEK_END) == 0)
+    {
+        file_size = ftell(file);
+        loaded = fseek(file, sizeof(header), SEEK_SET) == 0;
+    }
+
+    loaded = loaded && file_size >= (long)sizeof(header) && header.data_size <= 0xFFFFFFFFull &&
+             header.data_size == (pyco_uint64)file_size - sizeof(header);
+
+    if (loaded && header.data_size)
+    {
+        loaded = (data = _pyco_malloc(&options->allocators, header.data_size)) && fread(data, 1, header.data_size, file) == header.data_size;
+    }
+
+    // anything after the program means the file is not one this version wrote
+    loaded = loaded && fgetc(file) == EOF;
+    fclose(file);
+
+    if (!loaded)
+    {
+        if (data)
+        {
+            _pyco_free(&options->allocators, data);
+        }
+
+        return false;
+    }
+
+    program->data = data;
+    program->size = header.data_size;
+    program->valid = header.valid;
+    program->errors = header.errors;
+    program->cached = 1;
+
+    return true;
+}
+
+static inline bool _pyco_rename_over(const char *from, const char *to)
+{
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+static inline pyco_uint64 _pyco_process_id()
+{
+#if defined(_WIN32)
+    return GetCurrentProcessId();
+#else
+    return (pyco_uint64)getpid();
+#endif
+}
+
+// a failed write leaves no file behind, the script is then compiled again next time
+void _pyco_cache_store(const pyco_compile_options *options, const pyco_cache_key *key, const pyco_compiled_program *program)
+{
+    pyco_cache_header header = {
+        .magic = PYCO_CACHE_MAGIC,
+        .version = PYCO_CACHE_VERSION,
+        .key = key->key,
+        .source_hash = key->source_hash,
+        .source_size = key->source_size,
+        .data_size = program->data ? program->size : 0,
+        .valid = program->valid,
+        .errors = program->errors,
+    };
+
+    // the process id keeps processes apart, and the stack address threads writing the same key at the same time
+    char *path = _pyco_cache_path(options, key, 0);
+    char *temporary_path = _pyco_cache_path(options, key, (_pyco_process_id() << 32) ^ (pyco_uint64)(size_t)&header);
+    FILE *file = path && temporary_path ? fopen(temporary_path, "wb") : PYCO_NULL;
+
+    if (file)
+    {
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 && (!header.data_size || fwrite(program->data, 1, header.data_size, file) == header.data_size);
+        written = fclose(file) == 0 && written;
+
+        if (!written || !_pyco_rename_over(temporary_path, path))
+        {
+            remove(temporary_path);
+        }
+    }
+
+    if (path)
+    {
+        _pyco_free(&options->allocators, path);
+    }
+
+    if (temporary_path)
+    {
+        _pyco_free(&options->allocators, temporary_path);
+    }
+}
+
+// MARK: CODEGEN
+
+// lowers the flat tree into the bytecode of pyco_bytecode.h. every function has a window of registers, its arguments
+// and locals take the bottom ones in the order they are declared and the temporaries of a statement go above them
+#define PYCO_CODEGEN_MAX_REGISTERS 250
+#define PYCO_CODEGEN_NO_TARGET (~0u)
+
+enum PYCO_BINDING
+{
+    PYCO_BINDING_NONE = 0,
+    PYCO_BINDING_LOCAL,
+    PYCO_BINDING_GLOBAL,
+    // functions and structs are constants, they are loaded by index wherever their name is used
+    PYCO_BINDING_FUNCTION,
+    PYCO_BINDING_STRUCT,
+};
+
+// what a name stands for at the point being compiled
+typedef struct pyco_binding
+{
+    pyco_uint16 kind;
+    pyco_uint16 depth; // function a local belongs to, functions do not capture the locals of the ones around them
+    pyco_uint32 index; // register, global, function or struct
+} pyco_binding;
+
+// the binding a declaration hid, put back when the scope of the declaration ends
+typedef struct pyco_binding_shadow
+{
+    pyco_uint32 symbol;
+    pyco_binding binding;
+} pyco_binding_shadow;
+
+// a function being compiled, the ones it is nested in wait below it with the code they have so far
+typedef struct pyco_codegen_function
+{
+    pyco_uint32 *code;
+    pyco_uint64 code_count;
+    pyco_uint64 code_allocated;
+    pyco_uint32 index;
+    pyco_uint32 locals;    // registers below hold declared locals, at the start of a statement nothing else is taken
+    pyco_uint32 registers; // first free register
+    pyco_uint32 registers_peak;
+    pyco_uint32 loops_base; // the loops of the functions around it can not be left from inside it
+} pyco_codegen_function;
+
+// a break or continue waiting for the end of its loop
+typedef struct pyco_codegen_jump
+{
+    pyco_uint32 at;
+    pyco_uint32 is_continue;
+} pyco_codegen_jump;
+
+typedef struct pyco_codegen
+{
+    pyco_allocators allocators;
+    pyco_allocation_counters counters;
+    const pyco_flat_ast *flat;
+    pyco_symbol_table *symbols;
+    pyco_uint32 errors;
+
+    pyco_binding *bindings; // by symbol
+    pyco_uint64 bindings_allocated;
+    pyco_binding_shadow *shadows;
+    pyco_uint32 shadows_count;
+    pyco_uint64 shadows_allocated;
+    pyco_codegen_function *functions;
+    pyco_uint32 depth; // functions being compiled, the current one is the last
+    pyco_uint64 functions_allocated;
+    pyco_uint32 functions_count; // depths whose code array has been set up
+    pyco_uint32 *loops; // first jump of every loop being compiled
+    pyco_uint32 loops_count;
+    pyco_uint64 loops_allocated;
+    pyco_codegen_jump *jumps;
+    pyco_uint32 jumps_count;
+    pyco_uint64 jumps_allocated;
+
+    // the sections of the program
+    pyco_bytecode_constant *constants;
+    pyco_uint32 constants_count;
+    pyco_uint64 constants_allocated;
+    pyco_uint32 *constant_slots; // open addressing over the constants, index + 1 and 0 for a free slot
+    pyco_uint32 constant_slots_mask;
+    pyco_uint64 constant_slots_allocated;
+    pyco_bytecode_function *function_table;
+    pyco_uint32 function_table_count;
+    pyco_uint64 function_table_allocated;
+    pyco_bytecode_global *globals;
+    pyco_uint32 globals_count;
+    pyco_uint64 globals_allocated;
+    pyco_bytecode_struct *structs;
+    pyco_uint32 structs_count;
+    pyco_uint64 structs_allocated;
+    pyco_bytecode_field *fields;
+    pyco_uint32 fields_count;
+    pyco_uint64 fields_allocated;
+    pyco_uint32 *code;
+    pyco_uint32 code_count;
+    pyco_uint64 code_allocated;
+    pyco_uint8 *names;
+    pyco_uint32 names_size;
+    pyco_uint64 names_allocated;
+} pyco_codegen;
+
+static void _codegen_expression(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target);
+static void _codegen_statement(pyco_codegen *codegen, pyco_uint32 node);
+static void _codegen_scope(pyco_codegen *codegen, pyco_uint32 node, bool root);
+
+static inline void _codegen_error(pyco_codegen *codegen)
+{
+    codegen->errors++;
+}
+
+// grows one of the arrays to size bytes, running out of memory fails the program like any other error
+static bool _codegen_reserve(pyco_codegen *codegen, void **array, pyco_uint64 *allocated, pyco_uint64 size)
+{
+    if (size <= *allocated)
+    {
+        return true;
+    }
+
+    const pyco_uint64 grown = *allocated * 2 > size ? *allocated * 2 : (size < 256 ? 256 : size);
+    void *resized = _pyco_realloc(&codegen->allocators, *array, *allocated, grown);
+
+    if (!resized)
+    {
+        _codegen_error(codegen);
+        return false;
+    }
+
+    _count_allocation(&codegen->counters, grown, *allocated != 0);
+    *array = resized;
+    *allocated = grown;
+
+    return true;
+}
+
+static inline pyco_codegen_function *_codegen_current(pyco_codegen *codegen)
+{
+    return &codegen->functions[codegen->depth - 1];
+}
+
+static inline pyco_uint32 _codegen_child(const pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 n)
+{
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        if (!n--)
+        {
+            return child;
+        }
+    }
+
+    return 0;
+}
+
+static inline pyco_uint32 _codegen_children_count(const pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+    pyco_uint32 count = 0;
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        count++;
+    }
+
+    return count;
+}
+
+// the operands of an expression node, 0 and an error when the parser did not give it all of them
+static inline pyco_uint32 _codegen_arity(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const ast_data_expression *data = pyco_flat_ast_data(codegen->flat, node);
+
+    if (!data || !data->arity || _codegen_children_count(codegen, node) != data->arity)
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    return data->arity;
+}
+
+static inline const pyco_uint8 *_codegen_node_name(const pyco_codegen *codegen, pyco_uint32 node)
+{
+    return codegen->flat->source + codegen->flat->nodes[node].offset;
+}
+
+static pyco_uint32 _codegen_name(pyco_codegen *codegen, const pyco_uint8 *name, pyco_uint64 length)
+{
+    const pyco_uint32 offset = codegen->names_size;
+
+    if (!length || !_codegen_reserve(codegen, (void **)&codegen->names, &codegen->names_allocated, (pyco_uint64)codegen->names_size + length))
+    {
+        return offset;
+    }
+
+    memcpy(codegen->names + codegen->names_size, name, length);
+    codegen->names_size += (pyco_uint32)length;
+
+    return offset;
+}
+
+// MARK: emit
+
+static pyco_uint32 _codegen_emit(pyco_codegen *codegen, pyco_uint32 instruction)
+{
+    pyco_codegen_function *function = _codegen_current(codegen);
+
+    if (!_codegen_reserve(codegen, (void **)&function->code, &function->code_allocated, sizeof(pyco_uint32) * (function->code_count + 1)))
+    {
+        return 0;
+    }
+
+    function->code[function->code_count] = instruction;
+
+    return (pyco_uint32)function->code_count++;
+}
+
+static inline pyco_uint32 _codegen_here(pyco_codegen *codegen)
+{
+    return (pyco_uint32)_codegen_current(codegen)->code_count;
+}
+
+// a jump whose target is patched in once it is known
+static inline pyco_uint32 _codegen_emit_jump(pyco_codegen *codegen, pyco_uint32 op, pyco_uint32 a)
+{
+    return _codegen_emit(codegen, PYCO_INSTRUCTION_ASBX(op, a, 0));
+}
+
+static void _codegen_patch(pyco_codegen *codegen, pyco_uint32 at, pyco_uint32 target)
+{
+    pyco_codegen_function *function = _codegen_current(codegen);
+    const long long offset = (long long)target - at - 1;
+
+    if (at >= function->code_count || offset < PYCO_INSTRUCTION_SBX_MIN || offset > PYCO_INSTRUCTION_SBX_MAX)
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    function->code[at] = (function->code[at] & 0xFFFF) | ((pyco_uint32)(offset + PYCO_INSTRUCTION_SBX_BIAS) << 16);
+}
+
+static pyco_uint32 _codegen_register(pyco_codegen *codegen)
+{
+    pyco_codegen_function *function = _codegen_current(codegen);
+
+    // the program is thrown away, the register only has to be a valid one
+    if (function->registers >= PYCO_CODEGEN_MAX_REGISTERS)
+    {
+        _codegen_error(codegen);
+        return PYCO_CODEGEN_MAX_REGISTERS - 1;
+    }
+
+    if (++function->registers > function->registers_peak)
+    {
+        function->registers_peak = function->registers;
+    }
+
+    return function->registers - 1;
+}
+
+// equal constants share a slot of the pool, strings are compared by their bytes
+static pyco_uint32 _codegen_constant(pyco_codegen *codegen, pyco_uint32 type, pyco_uint64 bits, const pyco_uint8 *string, pyco_uint32 length)
+{
+    if (codegen->constants_count * 2 >= codegen->constant_slots_mask)
+    {
+        const pyco_uint32 slots_count = codegen->constant_slots_mask ? (codegen->constant_slots_mask + 1) * 2 : 64;
+
+        if (!_codegen_reserve(codegen, (void **)&codegen->constant_slots, &codegen->constant_slots_allocated, sizeof(pyco_uint32) * slots_count))
+        {
+            return 0;
+        }
+
+        codegen->constant_slots_mask = slots_count - 1;
+        memset(codegen->constant_slots, 0, sizeof(pyco_uint32) * slots_count);
+
+        for (pyco_uint32 i = 0; i < codegen->constants_count; i++)
+        {
+            const pyco_bytecode_constant *constant = &codegen->constants[i];
+            pyco_uint64 hash = constant->type == PYCO_CONSTANT_STRING ? _pyco_hash(codegen->names + constant->value.string, constant->length, constant->type)
+                                                                       : _pyco_hash_round(constant->type + 1, constant->value.integer);
+
+            while (codegen->constant_slots[hash & codegen->constant_slots_mask])
+            {
+                hash++;
+            }
+
+            codegen->constant_slots[hash & codegen->constant_slots_mask] = i + 1;
+        }
+    }
+
+    pyco_uint64 hash = type == PYCO_CONSTANT_STRING ? _pyco_hash(string, length, type) : _pyco_hash_round(type + 1, bits);
+
+    for (;; hash++)
+    {
+        const pyco_uint32 slot = codegen->constant_slots[hash & codegen->constant_slots_mask];
+
+        if (!slot)
+        {
+            break;
+        }
+
+        const pyco_bytecode_constant *constant = &codegen->constants[slot - 1];
+
+        if (constant->type == type && (type == PYCO_CONSTANT_STRING ? constant->length == length && memcmp(codegen->names + constant->value.string, string, length) == 0
+                                                                    : constant->value.integer == bits))
+        {
+            return slot - 1;
+        }
+    }
+
+    // a constant is loaded with a 16 bit index
+    if (codegen->constants_count > 0xFFFF ||
+        !_codegen_reserve(codegen, (void **)&codegen->constants, &codegen->constants_allocated, sizeof(pyco_bytecode_constant) * (codegen->constants_count + 1)))
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    pyco_bytecode_constant *constant = &codegen->constants[codegen->constants_count];
+
+    constant->type = type;
+    constant->length = length;
+    constant->value.integer = type == PYCO_CONSTANT_STRING ? _codegen_name(codegen, string, length) : bits;
+    codegen->constant_slots[hash & codegen->constant_slots_mask] = codegen->constants_count + 1;
+
+    return codegen->constants_count++;
+}
+
+// MARK: bindings
+
+static void _codegen_bind(pyco_codegen *codegen, pyco_uint32 symbol, pyco_uint32 kind, pyco_uint32 index)
+{
+    if (!symbol || !_codegen_reserve(codegen, (void **)&codegen->shadows, &codegen->shadows_allocated, sizeof(pyco_binding_shadow) * (codegen->shadows_count + 1)))
+    {
+        return;
+    }
+
+    codegen->shadows[codegen->shadows_count++] = (pyco_binding_shadow){
+        .symbol = symbol,
+        .binding = codegen->bindings[symbol],
+    };
+
+    codegen->bindings[symbol] = (pyco_binding){
+        .kind = (pyco_uint16)kind,
+        .depth = (pyco_uint16)codegen->depth,
+        .index = index,
+    };
+}
+
+// puts back what the declarations since the mark hid
+static void _codegen_unbind(pyco_codegen *codegen, pyco_uint32 shadows)
+{
+    while (codegen->shadows_count > shadows)
+    {
+        const pyco_binding_shadow *shadow = &codegen->shadows[--codegen->shadows_count];
+        codegen->bindings[shadow->symbol] = shadow->binding;
+    }
+}
+
+static pyco_uint32 _codegen_add_global(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 kind, pyco_uint32 index)
+{
+    if (codegen->globals_count > 0xFFFF ||
+        !_codegen_reserve(codegen, (void **)&codegen->globals, &codegen->globals_allocated, sizeof(pyco_bytecode_global) * (codegen->globals_count + 1)))
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    codegen->globals[codegen->globals_count] = (pyco_bytecode_global){
+        .name = _codegen_name(codegen, _codegen_node_name(codegen, node), codegen->flat->nodes[node].length),
+        .name_length = codegen->flat->nodes[node].length,
+        .kind = kind,
+        .index = index,
+    };
+
+    return codegen->globals_count++;
+}
+
+// the binding of an identifier node, a name nothing declared is a global the host provides
+static pyco_binding _codegen_resolve(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_uint32 symbol = codegen->flat->nodes[node].symbol;
+
+    if (!symbol)
+    {
+        _codegen_error(codegen);
+        return (pyco_binding){PYCO_BINDING_NONE};
+    }
+
+    // bound for the rest of the program, not only for the scope it is first used in
+    if (codegen->bindings[symbol].kind == PYCO_BINDING_NONE)
+    {
+        codegen->bindings[symbol] = (pyco_binding){
+            .kind = PYCO_BINDING_GLOBAL,
+            .index = _codegen_add_global(codegen, node, PYCO_GLOBAL_EXTERN, 0),
+        };
+    }
+
+    const pyco_binding binding = codegen->bindings[symbol];
+
+    if (binding.kind == PYCO_BINDING_LOCAL && binding.depth != codegen->depth)
+    {
+        _codegen_error(codegen);
+        return (pyco_binding){PYCO_BINDING_NONE};
+    }
+
+    return binding;
+}
+
+static void _codegen_load_name(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_binding binding = _codegen_resolve(codegen, node);
+
+    switch (binding.kind)
+    {
+    case PYCO_BINDING_LOCAL:
+        if (binding.index != target)
+        {
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, binding.index, 0));
+        }
+        break;
+    case PYCO_BINDING_GLOBAL:
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_GET_GLOBAL, target, binding.index));
+        break;
+    case PYCO_BINDING_FUNCTION:
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_FUNCTION, target, binding.index));
+        break;
+    case PYCO_BINDING_STRUCT:
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_STRUCT, target, binding.index));
+        break;
+    }
+}
+
+// MARK: expressions
+
+// the register holding the value of the node, a local is used where it is and anything else goes into a new temporary
+static pyco_uint32 _codegen_operand(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+
+    if (flat_node->type == PYCO_AST_NODE_TYPE_LITERAL && flat_node->symbol)
+    {
+        const pyco_binding binding = codegen->bindings[flat_node->symbol];
+
+        if (binding.kind == PYCO_BINDING_LOCAL && binding.depth == codegen->depth)
+        {
+            return binding.index;
+        }
+    }
+
+    const pyco_uint32 target = _codegen_register(codegen);
+    _codegen_expression(codegen, node, target);
+
+    return target;
+}
+
+// the value of an integer literal that fits into the signed byte of an instruction, false for anything else
+static inline bool _codegen_small_integer(const pyco_codegen *codegen, pyco_uint32 node, int *value)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    const ast_data_literal *literal = pyco_flat_ast_data(codegen->flat, node);
+
+    if (flat_node->type != PYCO_AST_NODE_TYPE_LITERAL || !literal || flat_node->flags & PYCO_AST_LITERAL_FLAG_REAL || literal->flags & (PYCO_LITERAL_FLAG_OVERFLOW | PYCO_LITERAL_FLAG_MALFORMED) ||
+        literal->value.integer > 127)
+    {
+        return false;
+    }
+
+    *value = (int)literal->value.integer;
+
+    return true;
+}
+
+// true and false are the integers 1 and 0, unless the script declares the names
+static inline bool _codegen_boolean(const pyco_codegen *codegen, pyco_uint32 node, int *value)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    const char *name = (const char *)_codegen_node_name(codegen, node);
+
+    if (codegen->bindings[flat_node->symbol].kind != PYCO_BINDING_NONE || (flat_node->length != 4 && flat_node->length != 5))
+    {
+        return false;
+    }
+
+    *value = flat_node->length == 4;
+
+    return memcmp(name, *value ? "true" : "false", flat_node->length) == 0;
+}
+
+static void _codegen_literal(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    const ast_data_literal *literal = pyco_flat_ast_data(codegen->flat, node);
+    int boolean;
+
+    if (flat_node->symbol && _codegen_boolean(codegen, node, &boolean))
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ASBX(PYCO_OP_LOAD_INT, target, boolean));
+    }
+    else if (flat_node->symbol)
+    {
+        _codegen_load_name(codegen, node, target);
+    }
+    else if (flat_node->flags & PYCO_AST_LITERAL_FLAG_STRING)
+    {
+        const pyco_uint32 constant = _codegen_constant(codegen, PYCO_CONSTANT_STRING, 0, _codegen_node_name(codegen, node), flat_node->length);
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_CONST, target, constant));
+    }
+    else if (literal && literal->flags & (PYCO_LITERAL_FLAG_OVERFLOW | PYCO_LITERAL_FLAG_MALFORMED))
+    {
+        // the lexer could not give the number a value, compiling a clamped or empty one would hide that
+        _codegen_error(codegen);
+    }
+    else if (literal && flat_node->flags & PYCO_AST_LITERAL_FLAG_REAL)
+    {
+        const pyco_uint32 constant = _codegen_constant(codegen, PYCO_CONSTANT_REAL, literal->value.integer, PYCO_NULL, 0);
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_CONST, target, constant));
+    }
+    else if (literal && literal->value.integer <= PYCO_INSTRUCTION_SBX_MAX)
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ASBX(PYCO_OP_LOAD_INT, target, (int)literal->value.integer));
+    }
+    else if (literal)
+    {
+        const pyco_uint32 constant = _codegen_constant(codegen, PYCO_CONSTANT_INTEGER, literal->value.integer, PYCO_NULL, 0);
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_CONST, target, constant));
+    }
+    else
+    {
+        // a keyword or a stray bracket the parser left in place of a value
+        _codegen_error(codegen);
+    }
+}
+
+// target = left op right with the value of left already in a register, adding a small integer needs no register for it
+static void _codegen_arithmetic(pyco_codegen *codegen, pyco_uint32 op, pyco_uint32 target, pyco_uint32 left, pyco_uint32 right_node)
+{
+    int value;
+
+    if ((op == PYCO_OP_ADD || op == PYCO_OP_SUBTRACT) && _codegen_small_integer(codegen, right_node, &value))
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_ADD_INT, target, left, op == PYCO_OP_ADD ? value : -value));
+        return;
+    }
+
+    const pyco_uint32 right = _codegen_operand(codegen, right_node);
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(op, target, left, right));
+}
+
+static inline pyco_uint32 _codegen_arithmetic_op(pyco_uint32 operator)
+{
+    switch (operator)
+    {
+    case PYCO_OPERATOR_ID_PLUS:
+    case PYCO_OPERATOR_ID_PLUS_ASSIGN:
+        return PYCO_OP_ADD;
+    case PYCO_OPERATOR_ID_MINUS:
+    case PYCO_OPERATOR_ID_MINUS_ASSIGN:
+        return PYCO_OP_SUBTRACT;
+    case PYCO_OPERATOR_ID_STAR:
+    case PYCO_OPERATOR_ID_STAR_ASSIGN:
+        return PYCO_OP_MULTIPLY;
+    case PYCO_OPERATOR_ID_SLASH:
+    case PYCO_OPERATOR_ID_SLASH_ASSIGN:
+        return PYCO_OP_DIVIDE;
+    }
+
+    return PYCO_OP_NOP;
+}
+
+// the key of `value.name` is the name as a string
+static pyco_uint32 _codegen_field_key(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    const pyco_uint32 key = _codegen_register(codegen);
+
+    if (flat_node->type != PYCO_AST_NODE_TYPE_LITERAL || !flat_node->symbol)
+    {
+        _codegen_error(codegen);
+        return key;
+    }
+
+    const pyco_uint32 constant = _codegen_constant(codegen, PYCO_CONSTANT_STRING, 0, _codegen_node_name(codegen, node), flat_node->length);
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_LOAD_CONST, key, constant));
+
+    return key;
+}
+
+static inline pyco_uint32 _codegen_unwrap(const pyco_codegen *codegen, pyco_uint32 node)
+{
+    while (codegen->flat->nodes[node].type == PYCO_AST_NODE_TYPE_EXPRESSION && codegen->flat->nodes[node].operator == PYCO_OPERATOR_ID_GROUPING &&
+           codegen->flat->nodes[node].size == 2)
+    {
+        node++;
+    }
+
+    return node;
+}
+
+// the two registers `value[key]` and `value.name` are read from and written to, false when the node is neither
+static bool _codegen_element(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 *value, pyco_uint32 *key)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    const bool index = flat_node->operator == PYCO_OPERATOR_ID_ARRAY_INDEX && flat_node->label == PYCO_AST_LABEL_INDEX_OPERATOR;
+
+    if (flat_node->type != PYCO_AST_NODE_TYPE_EXPRESSION || !(index || flat_node->operator == PYCO_OPERATOR_ID_MEMBER_ACCESS) || _codegen_arity(codegen, node) != 2)
+    {
+        return false;
+    }
+
+    *value = _codegen_operand(codegen, node + 1);
+    *key = index ? _codegen_operand(codegen, pyco_flat_ast_next_sibling(codegen->flat, node + 1)) : _codegen_field_key(codegen, pyco_flat_ast_next_sibling(codegen->flat, node + 1));
+
+    return true;
+}
+
+// `a = b` and `a += b`, the value assigned also goes into target unless it is PYCO_CODEGEN_NO_TARGET
+static void _codegen_assign(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    if (_codegen_arity(codegen, node) != 2)
+    {
+        return;
+    }
+
+    const pyco_uint32 op = _codegen_arithmetic_op(codegen->flat->nodes[node].operator);
+    const pyco_uint32 left = _codegen_unwrap(codegen, node + 1);
+    const pyco_uint32 right = pyco_flat_ast_next_sibling(codegen->flat, node + 1);
+    pyco_uint32 value;
+    pyco_uint32 key;
+
+    if (codegen->flat->nodes[left].type == PYCO_AST_NODE_TYPE_LITERAL && codegen->flat->nodes[left].symbol)
+    {
+        const pyco_binding binding = _codegen_resolve(codegen, left);
+
+        if (binding.kind == PYCO_BINDING_LOCAL)
+        {
+            if (op)
+            {
+                _codegen_arithmetic(codegen, op, binding.index, binding.index, right);
+            }
+            else
+            {
+                _codegen_expression(codegen, right, binding.index);
+            }
+
+            if (target != PYCO_CODEGEN_NO_TARGET && target != binding.index)
+            {
+                _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, binding.index, 0));
+            }
+        }
+        else if (binding.kind == PYCO_BINDING_GLOBAL)
+        {
+            value = target != PYCO_CODEGEN_NO_TARGET ? target : _codegen_register(codegen);
+
+            if (op)
+            {
+                _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_GET_GLOBAL, value, binding.index));
+                _codegen_arithmetic(codegen, op, value, value, right);
+            }
+            else
+            {
+                _codegen_expression(codegen, right, value);
+            }
+
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_SET_GLOBAL, value, binding.index));
+        }
+        else if (binding.kind != PYCO_BINDING_NONE)
+        {
+            // functions and structs are constants
+            _codegen_error(codegen);
+        }
+
+        return;
+    }
+
+    pyco_uint32 object;
+
+    if (!_codegen_element(codegen, left, &object, &key))
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    value = target != PYCO_CODEGEN_NO_TARGET ? target : _codegen_register(codegen);
+
+    if (op)
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_GET_INDEX, value, object, key));
+        _codegen_arithmetic(codegen, op, value, value, right);
+    }
+    else
+    {
+        _codegen_expression(codegen, right, value);
+    }
+
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_SET_INDEX, object, key, value));
+}
+
+// `a++` and `a--`, target gets the value from before unless it is PYCO_CODEGEN_NO_TARGET
+static void _codegen_update(pyco_codegen *codegen, pyco_uint32 node, int delta, pyco_uint32 target)
+{
+    const pyco_uint32 operand = _codegen_unwrap(codegen, node);
+    pyco_uint32 object;
+    pyco_uint32 key;
+
+    if (codegen->flat->nodes[operand].type == PYCO_AST_NODE_TYPE_LITERAL && codegen->flat->nodes[operand].symbol)
+    {
+        const pyco_binding binding = _codegen_resolve(codegen, operand);
+
+        if (binding.kind == PYCO_BINDING_LOCAL)
+        {
+            if (target != PYCO_CODEGEN_NO_TARGET)
+            {
+                _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, binding.index, 0));
+            }
+
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_ADD_INT, binding.index, binding.index, delta));
+        }
+        else if (binding.kind == PYCO_BINDING_GLOBAL)
+        {
+            const pyco_uint32 value = _codegen_register(codegen);
+
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_GET_GLOBAL, value, binding.index));
+
+            if (target != PYCO_CODEGEN_NO_TARGET)
+            {
+                _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, value, 0));
+            }
+
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_ADD_INT, value, value, delta));
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_SET_GLOBAL, value, binding.index));
+        }
+        else if (binding.kind != PYCO_BINDING_NONE)
+        {
+            _codegen_error(codegen);
+        }
+
+        return;
+    }
+
+    if (!_codegen_element(codegen, operand, &object, &key))
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    const pyco_uint32 value = _codegen_register(codegen);
+
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_GET_INDEX, value, object, key));
+
+    if (target != PYCO_CODEGEN_NO_TARGET)
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, value, 0));
+    }
+
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_ADD_INT, value, value, delta));
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_SET_INDEX, object, key, value));
+}
+
+// the callee and its arguments go into consecutive registers, where the result comes back. a target that is the last
+// register taken holds the callee itself, unless it is a local the arguments may still read
+static void _codegen_call(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_codegen_function *function = _codegen_current(codegen);
+    const bool in_place = target != PYCO_CODEGEN_NO_TARGET && target + 1 == function->registers && target >= function->locals;
+    const pyco_uint32 base = in_place ? target : _codegen_register(codegen);
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+    pyco_uint32 arguments_count = 0;
+
+    _codegen_load_name(codegen, node, base);
+
+    for (pyco_uint32 argument = node + 1; argument < end; argument = pyco_flat_ast_next_sibling(codegen->flat, argument))
+    {
+        _codegen_expression(codegen, argument, _codegen_register(codegen));
+        arguments_count++;
+    }
+
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_CALL, base, arguments_count, 0));
+
+    if (target != PYCO_CODEGEN_NO_TARGET && target != base)
+    {
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_MOVE, target, base, 0));
+    }
+}
+
+// `[rows][columns]type` makes the whole array at once, the sizes of all dimensions go into consecutive registers.
+// the element type is not kept yet, every element starts as 0
+static void _codegen_array(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_uint32 sizes = _codegen_current(codegen)->registers;
+    pyco_uint32 dimensions = 0;
+
+    while (codegen->flat->nodes[node].type == PYCO_AST_NODE_TYPE_EXPRESSION && codegen->flat->nodes[node].label == PYCO_AST_LABEL_ARRAY_TYPE)
+    {
+        if (_codegen_arity(codegen, node) != 2)
+        {
+            return;
+        }
+
+        _codegen_expression(codegen, node + 1, _codegen_register(codegen));
+        dimensions++;
+        node = pyco_flat_ast_next_sibling(codegen->flat, node + 1);
+    }
+
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_NEW_ARRAY, target, sizes, dimensions));
+}
+
+static void _codegen_operation(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+
+    if (flat_node->label == PYCO_AST_LABEL_ARRAY_TYPE)
+    {
+        _codegen_array(codegen, node, target);
+        return;
+    }
+
+    const pyco_uint32 arity = _codegen_arity(codegen, node);
+    const pyco_uint32 first = node + 1;
+    const pyco_uint32 second = arity > 1 ? pyco_flat_ast_next_sibling(codegen->flat, first) : 0;
+    const pyco_uint32 operator = flat_node->operator;
+    pyco_uint32 value;
+    pyco_uint32 key;
+
+    if (!arity)
+    {
+        return;
+    }
+
+    switch (arity * PYCO_OPERATOR_ID_COUNT + operator)
+    {
+    case 1 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_GROUPING:
+        _codegen_expression(codegen, first, target);
+        return;
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_PLUS:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_MINUS:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_STAR:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_SLASH:
+        _codegen_arithmetic(codegen, _codegen_arithmetic_op(operator), target, _codegen_operand(codegen, first), second);
+        return;
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_EQUAL:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_LESS:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_LESS_EQUAL:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_GREATER:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_GREATER_EQUAL:
+    {
+        // the operands are evaluated in the order they are written, a > b is then b < a
+        const pyco_uint32 left = _codegen_operand(codegen, first);
+        const pyco_uint32 right = _codegen_operand(codegen, second);
+        const bool swap = operator == PYCO_OPERATOR_ID_GREATER || operator == PYCO_OPERATOR_ID_GREATER_EQUAL;
+        const pyco_uint32 op = operator == PYCO_OPERATOR_ID_EQUAL                                                     ? PYCO_OP_EQUAL
+                               : operator == PYCO_OPERATOR_ID_LESS || operator == PYCO_OPERATOR_ID_GREATER ? PYCO_OP_LESS
+                                                                                                           : PYCO_OP_LESS_EQUAL;
+
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(op, target, swap ? right : left, swap ? left : right));
+        return;
+    }
+    case 1 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_NOT:
+    case 1 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_BITWISE_NOT:
+        value = _codegen_operand(codegen, first);
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(operator == PYCO_OPERATOR_ID_NOT ? PYCO_OP_NOT : PYCO_OP_BITWISE_NOT, target, value, 0));
+        return;
+    case 1 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_INCREMENT:
+    case 1 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_DECREMENT:
+        _codegen_update(codegen, first, operator == PYCO_OPERATOR_ID_INCREMENT ? 1 : -1, target);
+        return;
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_ASSIGN:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_PLUS_ASSIGN:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_MINUS_ASSIGN:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_STAR_ASSIGN:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_SLASH_ASSIGN:
+        _codegen_assign(codegen, node, target);
+        return;
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_ARRAY_INDEX:
+    case 2 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_MEMBER_ACCESS:
+        if (_codegen_element(codegen, node, &value, &key))
+        {
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_GET_INDEX, target, value, key));
+        }
+        return;
+    case 3 * PYCO_OPERATOR_ID_COUNT + PYCO_OPERATOR_ID_TERNARY:
+    {
+        const pyco_uint32 registers = _codegen_current(codegen)->registers;
+        const pyco_uint32 skip = _codegen_emit_jump(codegen, PYCO_OP_JUMP_IF_NOT, _codegen_operand(codegen, first));
+
+        _codegen_current(codegen)->registers = registers;
+        _codegen_expression(codegen, second, target);
+
+        const pyco_uint32 end = _codegen_emit_jump(codegen, PYCO_OP_JUMP, 0);
+
+        _codegen_patch(codegen, skip, _codegen_here(codegen));
+        _codegen_expression(codegen, pyco_flat_ast_next_sibling(codegen->flat, second), target);
+        _codegen_patch(codegen, end, _codegen_here(codegen));
+        return;
+    }
+    }
+
+    _codegen_error(codegen);
+}
+
+// puts the value of the node into target, the temporaries it takes are free again afterwards
+static void _codegen_expression(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 target)
+{
+    const pyco_uint32 registers = _codegen_current(codegen)->registers;
+
+    switch (codegen->flat->nodes[node].type)
+    {
+    case PYCO_AST_NODE_TYPE_LITERAL:
+        _codegen_literal(codegen, node, target);
+        break;
+    case PYCO_AST_NODE_TYPE_EXPRESSION:
+        _codegen_operation(codegen, node, target);
+        break;
+    case PYCO_AST_NODE_TYPE_CALL:
+        _codegen_call(codegen, node, target);
+        break;
+    default:
+        _codegen_error(codegen);
+        break;
+    }
+
+    _codegen_current(codegen)->registers = registers;
+}
+
+// MARK: statements
+
+// jumps by the condition when it is true or false, the jump is patched once its target is known
+static pyco_uint32 _codegen_condition(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 op)
+{
+    if (!node)
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    const pyco_uint32 registers = _codegen_current(codegen)->registers;
+    const pyco_uint32 jump = _codegen_emit_jump(codegen, op, _codegen_operand(codegen, node));
+
+    _codegen_current(codegen)->registers = registers;
+
+    return jump;
+}
+
+static void _codegen_body(pyco_codegen *codegen, pyco_uint32 node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    if (codegen->flat->nodes[node].type == PYCO_AST_NODE_TYPE_SCOPE)
+    {
+        _codegen_scope(codegen, node, false);
+    }
+    else
+    {
+        _codegen_statement(codegen, node);
+    }
+}
+
+static inline void _codegen_loop_begin(pyco_codegen *codegen)
+{
+    if (_codegen_reserve(codegen, (void **)&codegen->loops, &codegen->loops_allocated, sizeof(pyco_uint32) * (codegen->loops_count + 1)))
+    {
+        codegen->loops[codegen->loops_count++] = codegen->jumps_count;
+    }
+}
+
+// the breaks and continues of the loop learn where they go
+static void _codegen_loop_end(pyco_codegen *codegen, pyco_uint32 continue_target, pyco_uint32 break_target)
+{
+    if (!codegen->loops_count)
+    {
+        return;
+    }
+
+    const pyco_uint32 first = codegen->loops[--codegen->loops_count];
+
+    for (pyco_uint32 i = first; i < codegen->jumps_count; i++)
+    {
+        _codegen_patch(codegen, codegen->jumps[i].at, codegen->jumps[i].is_continue ? continue_target : break_target);
+    }
+
+    codegen->jumps_count = first;
+}
+
+static void _codegen_loop_exit(pyco_codegen *codegen, bool is_continue)
+{
+    if (codegen->loops_count == _codegen_current(codegen)->loops_base ||
+        !_codegen_reserve(codegen, (void **)&codegen->jumps, &codegen->jumps_allocated, sizeof(pyco_codegen_jump) * (codegen->jumps_count + 1)))
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    codegen->jumps[codegen->jumps_count++] = (pyco_codegen_jump){
+        .at = _codegen_emit_jump(codegen, PYCO_OP_JUMP, 0),
+        .is_continue = is_continue,
+    };
+}
+
+// the condition of a loop is at its bottom, so every round takes a single jump back
+static void _codegen_control_flow(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_uint32 type = codegen->flat->nodes[node].type;
+    const pyco_flat_control_flow *data = pyco_flat_ast_data(codegen->flat, node);
+
+    if (!data)
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    if (type == PYCO_AST_NODE_TYPE_IF)
+    {
+        const pyco_uint32 skip = _codegen_condition(codegen, data->condition, PYCO_OP_JUMP_IF_NOT);
+
+        _codegen_body(codegen, data->body);
+
+        if (data->else_body)
+        {
+            const pyco_uint32 end = _codegen_emit_jump(codegen, PYCO_OP_JUMP, 0);
+
+            _codegen_patch(codegen, skip, _codegen_here(codegen));
+            _codegen_body(codegen, data->else_body);
+            _codegen_patch(codegen, end, _codegen_here(codegen));
+        }
+        else
+        {
+            _codegen_patch(codegen, skip, _codegen_here(codegen));
+        }
+
+        return;
+    }
+
+    if (type == PYCO_AST_NODE_TYPE_DO_WHILE)
+    {
+        const pyco_uint32 body = _codegen_here(codegen);
+
+        _codegen_loop_begin(codegen);
+        _codegen_body(codegen, data->body);
+
+        const pyco_uint32 condition = _codegen_here(codegen);
+
+        _codegen_patch(codegen, _codegen_condition(codegen, data->condition, PYCO_OP_JUMP_IF), body);
+        _codegen_loop_end(codegen, condition, _codegen_here(codegen));
+        return;
+    }
+
+    // while and for, the initializer of a for is declared in a scope around the loop
+    pyco_codegen_function *function = _codegen_current(codegen);
+    const pyco_uint32 shadows = codegen->shadows_count;
+    const pyco_uint32 locals = function->locals;
+
+    if (type == PYCO_AST_NODE_TYPE_FOR && data->initializer)
+    {
+        _codegen_statement(codegen, data->initializer);
+        _codegen_current(codegen)->registers = _codegen_current(codegen)->locals;
+    }
+
+    const pyco_uint32 enter = data->condition ? _codegen_emit_jump(codegen, PYCO_OP_JUMP, 0) : 0;
+    const pyco_uint32 body = _codegen_here(codegen);
+
+    _codegen_loop_begin(codegen);
+    _codegen_body(codegen, data->body);
+
+    const pyco_uint32 step = _codegen_here(codegen);
+
+    if (type == PYCO_AST_NODE_TYPE_FOR && data->step)
+    {
+        _codegen_statement(codegen, data->step);
+        _codegen_current(codegen)->registers = _codegen_current(codegen)->locals;
+    }
+
+    if (data->condition)
+    {
+        _codegen_patch(codegen, enter, _codegen_here(codegen));
+        _codegen_patch(codegen, _codegen_condition(codegen, data->condition, PYCO_OP_JUMP_IF), body);
+    }
+    else
+    {
+        _codegen_patch(codegen, _codegen_emit_jump(codegen, PYCO_OP_JUMP, 0), body);
+    }
+
+    _codegen_loop_end(codegen, step, _codegen_here(codegen));
+    _codegen_unbind(codegen, shadows);
+
+    function = _codegen_current(codegen);
+    function->locals = locals;
+    function->registers = locals;
+}
+
+static pyco_uint32 _codegen_add_function(pyco_codegen *codegen, pyco_uint32 node)
+{
+    // LOAD_FUNCTION takes a 16 bit index
+    if (codegen->function_table_count > 0xFFFF ||
+        !_codegen_reserve(codegen, (void **)&codegen->function_table, &codegen->function_table_allocated, sizeof(pyco_bytecode_function) * (codegen->function_table_count + 1)))
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    codegen->function_table[codegen->function_table_count] = (pyco_bytecode_function){
+        .name = node ? _codegen_name(codegen, _codegen_node_name(codegen, node), codegen->flat->nodes[node].length) : 0,
+        .name_length = node ? codegen->flat->nodes[node].length : 0,
+    };
+
+    return codegen->function_table_count++;
+}
+
+static pyco_uint32 _codegen_add_struct(pyco_codegen *codegen, pyco_uint32 node)
+{
+    if (codegen->structs_count > 0xFFFF ||
+        !_codegen_reserve(codegen, (void **)&codegen->structs, &codegen->structs_allocated, sizeof(pyco_bytecode_struct) * (codegen->structs_count + 1)))
+    {
+        _codegen_error(codegen);
+        return 0;
+    }
+
+    pyco_bytecode_struct declaration = {
+        .name = _codegen_name(codegen, _codegen_node_name(codegen, node), codegen->flat->nodes[node].length),
+        .name_length = codegen->flat->nodes[node].length,
+        .fields = codegen->fields_count,
+    };
+
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        const ast_data_struct_field *field = pyco_flat_ast_data(codegen->flat, child);
+
+        if (codegen->flat->nodes[child].type != PYCO_AST_NODE_TYPE_STRUCT_FIELD || !field ||
+            !_codegen_reserve(codegen, (void **)&codegen->fields, &codegen->fields_allocated, sizeof(pyco_bytecode_field) * (codegen->fields_count + 1)))
+        {
+            continue;
+        }
+
+        const pyco_uint8 *type_name = PYCO_NULL;
+        pyco_uint64 type_name_length = 0;
+
+        if (field->type < PYCO_VAR_TYPE_ARRAY)
+        {
+            type_name = (const pyco_uint8 *)PYCO_VAR_TYPE_NAMES[field->type];
+            type_name_length = strlen(PYCO_VAR_TYPE_NAMES[field->type]);
+        }
+        else if (field->type_symbol)
+        {
+            type_name = pyco_symbol_table_name(codegen->symbols, field->type_symbol, &type_name_length);
+        }
+
+        codegen->fields[codegen->fields_count++] = (pyco_bytecode_field){
+            .name = _codegen_name(codegen, _codegen_node_name(codegen, child), codegen->flat->nodes[child].length),
+            .name_length = codegen->flat->nodes[child].length,
+            .type_name = _codegen_name(codegen, type_name, type_name_length),
+            .type_name_length = (pyco_uint32)type_name_length,
+        };
+
+        declaration.fields_count++;
+    }
+
+    codegen->structs[codegen->structs_count] = declaration;
+
+    return codegen->structs_count++;
+}
+
+static bool _codegen_enter_function(pyco_codegen *codegen, pyco_uint32 index)
+{
+    if (!_codegen_reserve(codegen, (void **)&codegen->functions, &codegen->functions_allocated, sizeof(pyco_codegen_function) * (codegen->depth + 1)))
+    {
+        return false;
+    }
+
+    // the code array of a depth is kept for the next function compiled at it
+    if (codegen->depth == codegen->functions_count)
+    {
+        codegen->functions[codegen->functions_count++] = (pyco_codegen_function){0};
+    }
+
+    pyco_codegen_function *function = &codegen->functions[codegen->depth++];
+
+    function->code_count = 0;
+    function->index = index;
+    function->locals = 0;
+    function->registers = 0;
+    function->registers_peak = 0;
+    function->loops_base = codegen->loops_count;
+
+    return true;
+}
+
+// the code of the function goes to the end of the code section
+static void _codegen_leave_function(pyco_codegen *codegen)
+{
+    const pyco_codegen_function *function = _codegen_current(codegen);
+
+    if (function->index < codegen->function_table_count &&
+        _codegen_reserve(codegen, (void **)&codegen->code, &codegen->code_allocated, sizeof(pyco_uint32) * (codegen->code_count + function->code_count)))
+    {
+        pyco_bytecode_function *entry = &codegen->function_table[function->index];
+
+        entry->code = codegen->code_count;
+        entry->code_count = (pyco_uint32)function->code_count;
+        entry->registers = (pyco_uint16)function->registers_peak;
+        if (function->code_count)
+        {
+            memcpy(codegen->code + codegen->code_count, function->code, sizeof(pyco_uint32) * function->code_count);
+        }
+
+        codegen->code_count += (pyco_uint32)function->code_count;
+    }
+
+    codegen->depth--;
+}
+
+static void _codegen_function(pyco_codegen *codegen, pyco_uint32 node, pyco_uint32 index)
+{
+    if (!_codegen_enter_function(codegen, index))
+    {
+        return;
+    }
+
+    const pyco_uint32 shadows = codegen->shadows_count;
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+    pyco_codegen_function *function = _codegen_current(codegen);
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        if (codegen->flat->nodes[child].type == PYCO_AST_NODE_TYPE_ARGUMENTS)
+        {
+            const pyco_uint32 arguments_end = pyco_flat_ast_next_sibling(codegen->flat, child);
+
+            for (pyco_uint32 argument = child + 1; argument < arguments_end; argument = pyco_flat_ast_next_sibling(codegen->flat, argument))
+            {
+                _codegen_bind(codegen, codegen->flat->nodes[argument].symbol, PYCO_BINDING_LOCAL, _codegen_register(codegen));
+            }
+
+            function->locals = function->registers;
+
+            if (index < codegen->function_table_count)
+            {
+                codegen->function_table[index].arity = (pyco_uint16)function->registers;
+            }
+        }
+        else if (codegen->flat->nodes[child].type == PYCO_AST_NODE_TYPE_SCOPE)
+        {
+            _codegen_scope(codegen, child, false);
+        }
+    }
+
+    // falling off the end returns nil
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_RETURN, 0, 0, 0));
+    _codegen_unbind(codegen, shadows);
+    _codegen_leave_function(codegen);
+}
+
+// `name := value` inside a function or a block puts the value into a register of its own
+static void _codegen_declaration(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_uint32 value = _codegen_child(codegen, node, 0);
+
+    if (!value || !codegen->flat->nodes[node].symbol)
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    const pyco_uint32 target = _codegen_register(codegen);
+
+    // bound after the value, `x := x + 1` reads the x from before
+    _codegen_expression(codegen, value, target);
+    _codegen_bind(codegen, codegen->flat->nodes[node].symbol, PYCO_BINDING_LOCAL, target);
+    _codegen_current(codegen)->locals = _codegen_current(codegen)->registers;
+}
+
+// a top-level declaration sets the global hoisting made for it
+static void _codegen_global_declaration(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_uint32 value = _codegen_child(codegen, node, 0);
+    const pyco_binding binding = codegen->bindings[codegen->flat->nodes[node].symbol];
+
+    if (!value || binding.kind != PYCO_BINDING_GLOBAL)
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    const pyco_uint32 target = _codegen_register(codegen);
+
+    _codegen_expression(codegen, value, target);
+    _codegen_emit(codegen, PYCO_INSTRUCTION_ABX(PYCO_OP_SET_GLOBAL, target, binding.index));
+}
+
+static void _codegen_statement(pyco_codegen *codegen, pyco_uint32 node)
+{
+    const pyco_flat_node *flat_node = &codegen->flat->nodes[node];
+    pyco_uint32 child;
+
+    switch (flat_node->type)
+    {
+    case PYCO_AST_NODE_TYPE_STATEMENT:
+        _codegen_declaration(codegen, node);
+        return;
+    case PYCO_AST_NODE_TYPE_FUNCTION:
+    {
+        // one that is not directly in a scope, like the body of an if without braces, is declared where it is
+        const pyco_uint32 index = _codegen_add_function(codegen, node);
+
+        _codegen_bind(codegen, flat_node->symbol, PYCO_BINDING_FUNCTION, index);
+        _codegen_function(codegen, node, index);
+        return;
+    }
+    case PYCO_AST_NODE_TYPE_STRUCT:
+        _codegen_bind(codegen, flat_node->symbol, PYCO_BINDING_STRUCT, _codegen_add_struct(codegen, node));
+        return;
+    case PYCO_AST_NODE_TYPE_SCOPE:
+        _codegen_scope(codegen, node, false);
+        return;
+    case PYCO_AST_NODE_TYPE_IF:
+    case PYCO_AST_NODE_TYPE_FOR:
+    case PYCO_AST_NODE_TYPE_WHILE:
+    case PYCO_AST_NODE_TYPE_DO_WHILE:
+        _codegen_control_flow(codegen, node);
+        return;
+    case PYCO_AST_NODE_TYPE_BREAK:
+    case PYCO_AST_NODE_TYPE_CONTINUE:
+        _codegen_loop_exit(codegen, flat_node->type == PYCO_AST_NODE_TYPE_CONTINUE);
+        return;
+    case PYCO_AST_NODE_TYPE_RETURN:
+        if ((child = _codegen_child(codegen, node, 0)))
+        {
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_RETURN, _codegen_operand(codegen, child), 1, 0));
+        }
+        else
+        {
+            _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_RETURN, 0, 0, 0));
+        }
+        return;
+    case PYCO_AST_NODE_TYPE_CALL:
+        _codegen_call(codegen, node, PYCO_CODEGEN_NO_TARGET);
+        return;
+    case PYCO_AST_NODE_TYPE_EXPRESSION:
+        switch (flat_node->operator)
+        {
+        case PYCO_OPERATOR_ID_ASSIGN:
+        case PYCO_OPERATOR_ID_PLUS_ASSIGN:
+        case PYCO_OPERATOR_ID_MINUS_ASSIGN:
+        case PYCO_OPERATOR_ID_STAR_ASSIGN:
+        case PYCO_OPERATOR_ID_SLASH_ASSIGN:
+            _codegen_assign(codegen, node, PYCO_CODEGEN_NO_TARGET);
+            return;
+        case PYCO_OPERATOR_ID_INCREMENT:
+        case PYCO_OPERATOR_ID_DECREMENT:
+            if (_codegen_arity(codegen, node) == 1)
+            {
+                _codegen_update(codegen, node + 1, flat_node->operator == PYCO_OPERATOR_ID_INCREMENT ? 1 : -1, PYCO_CODEGEN_NO_TARGET);
+            }
+            return;
+        }
+        break;
+    }
+
+    // the value of anything else is computed and dropped
+    _codegen_expression(codegen, node, _codegen_register(codegen));
+}
+
+// the functions and structs of a scope can be used before they are declared, so they are bound before its statements.
+// the root scope is the script, its declarations are globals the host can reach
+static void _codegen_scope(pyco_codegen *codegen, pyco_uint32 node, bool root)
+{
+    const pyco_uint32 shadows = codegen->shadows_count;
+    const pyco_uint32 locals = _codegen_current(codegen)->locals;
+    const pyco_uint32 end = pyco_flat_ast_next_sibling(codegen->flat, node);
+    pyco_uint32 function_index = codegen->function_table_count;
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        const pyco_flat_node *flat_node = &codegen->flat->nodes[child];
+        pyco_uint32 index;
+
+        if (flat_node->type == PYCO_AST_NODE_TYPE_FUNCTION && flat_node->data)
+        {
+            index = _codegen_add_function(codegen, child);
+            _codegen_bind(codegen, flat_node->symbol, PYCO_BINDING_FUNCTION, index);
+
+            if (root)
+            {
+                _codegen_add_global(codegen, child, PYCO_GLOBAL_FUNCTION, index);
+            }
+        }
+        else if (flat_node->type == PYCO_AST_NODE_TYPE_STRUCT)
+        {
+            index = _codegen_add_struct(codegen, child);
+            _codegen_bind(codegen, flat_node->symbol, PYCO_BINDING_STRUCT, index);
+
+            if (root)
+            {
+                _codegen_add_global(codegen, child, PYCO_GLOBAL_STRUCT, index);
+            }
+        }
+        else if (root && flat_node->type == PYCO_AST_NODE_TYPE_STATEMENT && flat_node->symbol)
+        {
+            // declaring a name again at the top level sets the same global
+            if (codegen->bindings[flat_node->symbol].kind != PYCO_BINDING_GLOBAL)
+            {
+                _codegen_bind(codegen, flat_node->symbol, PYCO_BINDING_GLOBAL, _codegen_add_global(codegen, child, PYCO_GLOBAL_VARIABLE, 0));
+            }
+        }
+    }
+
+    for (pyco_uint32 child = node + 1; child < end; child = pyco_flat_ast_next_sibling(codegen->flat, child))
+    {
+        const pyco_flat_node *flat_node = &codegen->flat->nodes[child];
+
+        if (flat_node->type == PYCO_AST_NODE_TYPE_FUNCTION && flat_node->data)
+        {
+            _codegen_function(codegen, child, function_index++);
+        }
+        else if (flat_node->type == PYCO_AST_NODE_TYPE_STRUCT)
+        {
+            continue;
+        }
+        else if (root && flat_node->type == PYCO_AST_NODE_TYPE_STATEMENT)
+        {
+            _codegen_global_declaration(codegen, child);
+        }
+        else
+        {
+            _codegen_statement(codegen, child);
+        }
+
+        // the temporaries of a statement are free for the next one
+        _codegen_current(codegen)->registers = _codegen_current(codegen)->locals;
+    }
+
+    _codegen_unbind(codegen, shadows);
+    _codegen_current(codegen)->locals = locals;
+    _codegen_current(codegen)->registers = locals;
+}
+
+// lays the sections out one after the other, each aligned to 8 bytes
+static void _codegen_assemble(pyco_codegen *codegen, pyco_compiled_program *program, const pyco_allocators *allocators)
+{
+    pyco_bytecode_header header = {
+        .magic = PYCO_BYTECODE_MAGIC,
+        .version = PYCO_BYTECODE_VERSION,
+        .constants_count = codegen->constants_count,
+        .functions_count = codegen->function_table_count,
+        .globals_count = codegen->globals_count,
+        .structs_count = codegen->structs_count,
+        .fields_count = codegen->fields_count,
+        .code_count = codegen->code_count,
+        .names_size = codegen->names_size,
+    };
+
+    const struct
+    {
+        pyco_uint32 *offset;
+        const void *data;
+        pyco_uint64 size;
+    } sections[] = {
+        {&header.constants, codegen->constants, sizeof(pyco_bytecode_constant) * (pyco_uint64)codegen->constants_count},
+        {&header.functions, codegen->function_table, sizeof(pyco_bytecode_function) * (pyco_uint64)codegen->function_table_count},
+        {&header.globals, codegen->globals, sizeof(pyco_bytecode_global) * (pyco_uint64)codegen->globals_count},
+        {&header.structs, codegen->structs, sizeof(pyco_bytecode_struct) * (pyco_uint64)codegen->structs_count},
+        {&header.fields, codegen->fields, sizeof(pyco_bytecode_field) * (pyco_uint64)codegen->fields_count},
+        {&header.code, codegen->code, sizeof(pyco_uint32) * (pyco_uint64)codegen->code_count},
+        {&header.names, codegen->names, codegen->names_size},
+    };
+
+    pyco_uint64 size = (sizeof(header) + 7) & ~7ull;
+
+    for (pyco_uint32 i = 0; i < sizeof(sections) / sizeof(sections[0]); i++)
+    {
+        *sections[i].offset = (pyco_uint32)size;
+        size = (size + sections[i].size + 7) & ~7ull;
+    }
+
+    // the offsets are 32 bit
+    pyco_uint8 *data = size <= 0xFFFFFFFFull ? _pyco_malloc(allocators, size) : PYCO_NULL;
+
+    if (!data)
+    {
+        _codegen_error(codegen);
+        return;
+    }
+
+    header.size = (pyco_uint32)size;
+    memset(data, 0, size);
+    memcpy(data, &header, sizeof(header));
+
+    for (pyco_uint32 i = 0; i < sizeof(sections) / sizeof(sections[0]); i++)
+    {
+        if (sections[i].size)
+        {
+            memcpy(data + *sections[i].offset, sections[i].data, sections[i].size);
+        }
+    }
+
+    program->data = data;
+    program->size = size;
+}
+
+// frees the arrays a code generator kept
+static void _pyco_codegen_free(pyco_codegen *codegen)
+{
+    for (pyco_uint32 i = 0; i < codegen->functions_count; i++)
+    {
+        if (codegen->functions[i].code)
+        {
+            _pyco_free(&codegen->allocators, codegen->functions[i].code);
+        }
+    }
+
+    void *arrays[] = {codegen->bindings, codegen->shadows, codegen->functions, codegen->loops, codegen->jumps, codegen->constants, codegen->constant_slots,
+                      codegen->function_table, codegen->globals, codegen->structs, codegen->fields, codegen->code, codegen->names};
+
+    for (pyco_uint32 i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+    {
+        if (arrays[i])
+        {
+            _pyco_free(&codegen->allocators, arrays[i]);
+        }
+    }
+
+    *codegen = (pyco_codegen){
+        .allocators = codegen->allocators,
+    };
+}
+
+// lowers the flat tree into program->data, allocated from allocators. codegen holds the arrays the code generator
+// works in, allocated from its own allocators and kept for the next call so a warm one only allocates the program.
+// the memory it took is added to counters
+void _pyco_codegen(pyco_compiled_program *program, pyco_codegen *codegen, const pyco_flat_ast *flat, pyco_symbol_table *symbols,
+                   const pyco_allocators *allocators, pyco_allocation_counters *counters)
+{
+    // the arrays and the code array of every depth stay, only what they hold starts over
+    codegen->counters = (pyco_allocation_counters){0};
+    codegen->flat = flat;
+    codegen->symbols = symbols;
+    codegen->errors = 0;
+    codegen->shadows_count = 0;
+    codegen->depth = 0;
+    codegen->loops_count = 0;
+    codegen->jumps_count = 0;
+    codegen->constants_count = 0;
+    codegen->constant_slots_mask = 0;
+    codegen->function_table_count = 0;
+    codegen->globals_count = 0;
+    codegen->structs_count = 0;
+    codegen->fields_count = 0;
+    codegen->code_count = 0;
+    codegen->names_size = 0;
+
+    const pyco_uint64 bindings_size = sizeof(pyco_binding) * ((pyco_uint64)pyco_symbol_table_count(symbols) + 1);
+
+    if (flat->count && _codegen_reserve(codegen, (void **)&codegen->bindings, &codegen->bindings_allocated, bindings_size) && _codegen_enter_function(codegen, _codegen_add_function(codegen, 0)))
+    {
+        memset(codegen->bindings, 0, bindings_size);
+
+        // a script with no statements is a lone ROOT node
+        if (flat->nodes[0].type == PYCO_AST_NODE_TYPE_SCOPE)
+        {
+            _codegen_scope(codegen, 0, true);
+        }
+
+        _codegen_emit(codegen, PYCO_INSTRUCTION_ABC(PYCO_OP_RETURN, 0, 0, 0));
+        _codegen_leave_function(codegen);
+    }
+    else
+    {
+        _codegen_error(codegen);
+    }
+
+    if (!codegen->errors)
+    {
+        _codegen_assemble(codegen, program, allocators);
+    }
+
+    program->errors = codegen->errors;
+    program->valid = codegen->errors == 0;
+
+    if (counters)
+    {
+        counters->bytes += codegen->counters.bytes + program->size;
+        counters->reallocs += codegen->counters.reallocs;
+    }
+}
+
+// MARK: compilation
+
+static inline pyco_uint64 _pyco_clock_nanoseconds()
+{
+    struct timespec time;
+
+#if defined(_WIN32)
+    timespec_get(&time, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &time);
+#endif
+
+    return (pyco_uint64)time.tv_sec * 1000000000ull + (pyco_uint64)time.tv_nsec;
+}
+
+static inline bool _pyco_compile_tracked(const pyco_compile_options *options)
+{
+    return options->collect_stats || options->phase_callback;
+}
+
+static inline void _pyco_compile_add_counters(pyco_compile_stats *stats, pyco_allocation_counters counters, pyco_allocation_counters before)
+{
+    stats->bytes_allocated += counters.bytes - before.bytes;
+    stats->realloc_calls += counters.reallocs - before.reallocs;
+}
+
+// what a compile allocates with, and where the shared symbol table and arena stood when it started
+// so they are only charged for what the compile added to them
+typedef struct pyco_compile_state
+{
+    pyco_allocators allocators; // the region's in linear mode, otherwise the ones of the options
+    pyco_arena *region;
+    pyco_arena *tree_arena;
+    pyco_flat_ast *flat; // kept by a compiler handle, otherwise every compile flattens into its own
+    pyco_codegen *codegen; // the same for the arrays of the code generator
+    pyco_allocation_counters symbols;
+    pyco_allocation_counters arena;
+} pyco_compile_state;
+
+bool _pyco_compile_state_begin(pyco_compile_state *state, const pyco_compile_options *options, pyco_uint64 region_size)
+{
+    *state = (pyco_compile_state){
+        .allocators = options->allocators,
+        .tree_arena = options->arena,
+    };
+
+    if (options->symbols)
+    {
+        state->symbols = options->symbols->counters;
+    }
+
+    if (options->arena)
+    {
+        state->arena = options->arena->counters;
+    }
+
+    if (options->linear_allocation)
+    {
+        if (!(state->region = pyco_arena_create(options->allocators, options->linear_initial_size ? options->linear_initial_size : region_size)))
+        {
+            return false;
+        }
+
+        state->allocators = pyco_arena_allocators(state->region);
+
+        // the tree goes straight into the region rather than into an arena of its own inside it
+        if (!state->tree_arena)
+        {
+            state->tree_arena = state->region;
+        }
+    }
+
+    return true;
+}
+
+// in linear mode everything the compile allocated goes away here, no matter if it was freed before
+static inline void _pyco_compile_state_end(pyco_compile_state *state)
+{
+    pyco_arena_free(state->region);
+    state->region = PYCO_NULL;
+}
+
+// recounted from the components at the end of every phase, the tree and flat tree are PYCO_NULL until they exist
+void _pyco_compile_count(pyco_compiled_program *program, pyco_lexer *lexer, const pyco_compile_state *state, pyco_ast *ast, pyco_flat_ast *flat)
+{
+    pyco_compile_stats *stats = &program->stats;
+
+    stats->tokens_count = lexer->tokens_count;
+    stats->symbols_count = pyco_symbol_table_count(lexer->symbols);
+    stats->bytes_allocated = 0;
+    stats->realloc_calls = 0;
+
+    _pyco_compile_add_counters(stats, lexer->counters, (pyco_allocation_counters){0});
+    _pyco_compile_add_counters(stats, lexer->symbols->counters, lexer->owns_symbols ? (pyco_allocation_counters){0} : state->symbols);
+
+    if (ast && ast->arena)
+    {
+        stats->nodes_count = ast->nodes_count;
+        stats->arena_peak = _arena_used(ast->arena);
+
+        // a tree flattened while parsing rewinds its arena after every statement
+        if (ast->arena_peak > stats->arena_peak)
+        {
+            stats->arena_peak = ast->arena_peak;
+        }
+
+        // the nodes are requests to the region, like everything else in linear mode
+        if (ast->arena != state->region)
+        {
+            _pyco_compile_add_counters(stats, ast->arena->counters, ast->owns_arena ? (pyco_allocation_counters){0} : state->arena);
+        }
+
+        for (pyco_uint32 i = 0; i < ast->parts_count && ast->parts[i].arena; i++)
+        {
+            stats->arena_peak += _arena_used(ast->parts[i].arena);
+            _pyco_compile_add_counters(stats, ast->parts[i].arena->counters, (pyco_allocation_counters){0});
+        }
+    }
+
+    if (flat)
+    {
+        _pyco_compile_add_counters(stats, flat->counters, (pyco_allocation_counters){0});
+    }
+}
+
+static inline void _pyco_compile_end_phase(pyco_compiled_program *program, pyco_uint32 phase, pyco_uint64 nanoseconds)
+{
+    program->stats.phase_nanoseconds[phase] += nanoseconds;
+
+    if (program->compile_options.phase_callback)
+    {
+        program->compile_options.phase_callback(program->compile_options.phase_callback_data, phase, &program->stats);
+    }
+}
+
+void _pyco_compile_tokens(pyco_compiled_program *program, pyco_lexer *lexer, const pyco_compile_state *state, const char *source)
+{
+    const pyco_compile_options *options = &program->compile_options;
+    const bool tracked = _pyco_compile_tracked(options);
+    const pyco_uint64 parse_start = tracked ? _pyco_clock_nanoseconds() : 0;
+
+    build_ast_options ast_options = {
+        .indent_based = !!options->indent_based,
+        .allocators = state->allocators,
+        .arena = state->tree_arena,
+        // the region is not safe to allocate from on several threads
+        .threads = state->region ? 1 : options->parse_threads,
+        .shared_arena = state->region && state->tree_arena == state->region,
+    };
+
+    pyco_flat_ast local_flat = {
+        .allocators = state->allocators,
+    };
+    pyco_flat_ast *flat = state->flat ? state->flat : &local_flat;
+    pyco_codegen local_codegen = {
+        .allocators = state->allocators,
+    };
+    pyco_codegen *codegen = state->codegen ? state->codegen : &local_codegen;
+
+    // the linked nodes of a statement go away once it is flattened, what is left of the tree is only its root
+    pyco_ast ast = parser_build_flat_ast(lexer, ast_options, flat);
+
+    if (tracked)
+    {
+        // counted before the tree goes away, its arena holds the peak
+        _pyco_compile_count(program, lexer, state, &ast, flat);
+    }
+
+    pyco_ast_free(&ast, ast.root_node);
+
+    if (tracked)
+    {
+        _pyco_compile_end_phase(program, PYCO_COMPILE_PHASE_PARSE, _pyco_clock_nanoseconds() - parse_start);
+    }
+
+    if (options->ast_json_path)
+    {
+        pyco_flat_ast_to_json_file(options->ast_json_path, flat, source);
+    }
+
+    if (options->ast_binary_path)
+    {
+        pyco_flat_ast_to_binary_file(options->ast_binary_path, flat);
+    }
+
+    const pyco_uint64 codegen_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    pyco_allocation_counters codegen_counters = {0};
+
+    // only the program outlives the compile, it is the one thing not taken from the region in linear mode
+    _pyco_codegen(program, codegen, flat, lexer->symbols, &options->allocators, &codegen_counters);
+
+    if (tracked)
+    {
+        _pyco_compile_add_counters(&program->stats, codegen_counters, (pyco_allocation_counters){0});
+        _pyco_compile_end_phase(program, PYCO_COMPILE_PHASE_CODEGEN, _pyco_clock_nanoseconds() - codegen_start);
+    }
+
+    pyco_flat_ast_free(&local_flat);
+    _pyco_codegen_free(&local_codegen);
+}
+
+// capacity hints sized so an average script fits without growing
+static inline pyco_lexer_options _pyco_compile_lexer_options(const pyco_compile_options *options, pyco_allocators allocators, pyco_uint64 size)
+{
+    pyco_lexer_options lexer_options = lexer_initialize_options();
+    lexer_options.allocators = allocators;
+    lexer_options.token_block_initial_size = size / 4 + 64;
+    lexer_options.line_index_initial_size = size / 32 + 16;
+    lexer_options.copy_source = !!options->copy_buffer;
+    lexer_options.token_window_size = options->token_window;
+    lexer_options.symbols = options->symbols;
+
+    return lexer_options;
+}
+
+pyco_compiled_program pyco_compile(const pyco_uint8 *data, pyco_uint64 size, pyco_compile_options options)
+{
+    pyco_compiled_program program = {
+        .compile_options = options,
+    };
+
+    pyco_cache_key cache_key;
+    const bool cached = _pyco_cache_key(&options, data, size, &cache_key);
+
+    if (cached && _pyco_cache_load(&options, &cache_key, &program))
+    {
+        return program;
+    }
+
+    const bool tracked = _pyco_compile_tracked(&options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    pyco_compile_state state;
+
+    // the token blocks, the tree and the flat tree take about this much for every byte of source
+    if (!_pyco_compile_state_begin(&state, &options, size * 8 + 64 * 1024))
+    {
+        return program;
+    }
+
+    pyco_lexer *lexer = lexer_create(_pyco_compile_lexer_options(&options, state.allocators, size));
+
+    if (!lexer)
+    {
+        _pyco_compile_state_end(&state);
+        return program;
+    }
+
+    pyco_buffer buffer = {
+        .data = (pyco_uint8 *)data,
+        .size = size,
+    };
+
+    const bool lexed = lexer_process_buffer(lexer, &buffer);
+
+    if (tracked)
+    {
+        _pyco_compile_count(&program, lexer, &state, PYCO_NULL, PYCO_NULL);
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_LEX, _pyco_clock_nanoseconds() - lex_start);
+    }
+
+    _pyco_compile_tokens(&program, lexer, &state, (const char *)data);
+
+    lexer_free(lexer);
+    _pyco_compile_state_end(&state);
+
+    if (cached && lexed)
+    {
+        _pyco_cache_store(&options, &cache_key, &program);
+    }
+
+    return program;
+}
+
+typedef struct pyco_compile_stream
+{
+    pyco_compile_options options;
+    pyco_lexer *lexer;
+    pyco_compile_state state;
+    pyco_uint64 lex_nanoseconds; // the chunks are lexed as they are pushed
+} pyco_compile_stream;
+
+pyco_compile_stream *pyco_compile_stream_begin(pyco_compile_options options)
+{
+    if (!options.allocators.malloc || !options.allocators.free)
+    {
+        return PYCO_NULL;
+    }
+
+    pyco_compile_stream *stream = _pyco_malloc(&options.allocators, sizeof(pyco_compile_stream));
+
+    if (!stream)
+    {
+        return PYCO_NULL;
+    }
+
+    const bool tracked = _pyco_compile_tracked(&options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+
+    // the size of the script is not known up front, the region grows with the pushes
+    if (!_pyco_compile_state_begin(&stream->state, &options, 1024 * 1024))
+    {
+        _pyco_free(&options.allocators, stream);
+        return PYCO_NULL;
+    }
+
+    pyco_lexer_options lexer_options = lexer_initialize_options();
+    lexer_options.allocators = stream->state.allocators;
+    lexer_options.symbols = options.symbols;
+
+    stream->options = options;
+
+    if (!(stream->lexer = lexer_create(lexer_options)))
+    {
+        _pyco_compile_state_end(&stream->state);
+        _pyco_free(&options.allocators, stream);
+        return PYCO_NULL;
+    }
+
+    stream->lex_nanoseconds = tracked ? _pyco_clock_nanoseconds() - lex_start : 0;
+
+    return stream;
+}
+
+pyco_uint32 pyco_compile_stream_push(pyco_compile_stream *stream, const pyco_uint8 *data, pyco_uint64 size)
+{
+    pyco_buffer chunk = {
+        .data = (pyco_uint8 *)data,
+        .size = size,
+    };
+
+    if (!stream)
+    {
+        return false;
+    }
+
+    const bool tracked = _pyco_compile_tracked(&stream->options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    const bool pushed = lexer_push_chunk(stream->lexer, &chunk);
+
+    if (tracked)
+    {
+        stream->lex_nanoseconds += _pyco_clock_nanoseconds() - lex_start;
+    }
+
+    return pushed;
+}
+
+pyco_compiled_program pyco_compile_stream_finish(pyco_compile_stream *stream)
+{
+    pyco_compiled_program program = {0};
+
+    if (!stream)
+    {
+        return program;
+    }
+
+    program.compile_options = stream->options;
+
+    const bool tracked = _pyco_compile_tracked(&stream->options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+
+    lexer_finish(stream->lexer);
+
+    if (tracked)
+    {
+        _pyco_compile_count(&program, stream->lexer, &stream->state, PYCO_NULL, PYCO_NULL);
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_LEX, stream->lex_nanoseconds + _pyco_clock_nanoseconds() - lex_start);
+    }
+
+    _pyco_compile_tokens(&program, stream->lexer, &stream->state, PYCO_NULL);
+
+    lexer_free(stream->lexer);
+    _pyco_compile_state_end(&stream->state);
+    _pyco_free(&stream->options.allocators, stream);
+
+    return program;
+}
+
+typedef struct pyco_compiler
+{
+    pyco_compile_options options;
+    // created by the first compile and sized from its script, then reset by every following one
+    pyco_lexer *lexer;
+    pyco_arena *arena;
+    pyco_flat_ast flat;
+    pyco_codegen codegen;
+} pyco_compiler;
+
+pyco_compiler *pyco_compiler_create(pyco_compile_options options)
+{
+    if (!options.allocators.malloc || !options.allocators.realloc || !options.allocators.free)
+    {
+        return PYCO_NULL;
+    }
+
+    pyco_compiler *compiler = _pyco_malloc(&options.allocators, sizeof(pyco_compiler));
+
+    if (!compiler)
+    {
+        return PYCO_NULL;
+    }
+
+    // what the handle keeps has to outlive every compile, so there is no region to release at the end of one
+    options.linear_allocation = 0;
+
+    *compiler = (pyco_compiler){
+        .options = options,
+        .flat = {
+            .allocators = options.allocators,
+        },
+        .codegen = {
+            .allocators = options.allocators,
+        },
+    };
+
+    return compiler;
+}
+
+pyco_compiled_program pyco_compiler_compile(pyco_compiler *compiler, const pyco_uint8 *data, pyco_uint64 size)
+{
+    const pyco_compile_options *options = &compiler->options;
+
+    pyco_compiled_program program = {
+        .compile_options = *options,
+    };
+
+    pyco_cache_key cache_key;
+    const bool cached = _pyco_cache_key(options, data, size, &cache_key);
+
+    if (cached && _pyco_cache_load(options, &cache_key, &program))
+    {
+        return program;
+    }
+
+    const bool tracked = _pyco_compile_tracked(options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    pyco_compile_state state;
+
+    _pyco_compile_state_begin(&state, options, 0);
+
+    if (compiler->lexer)
+    {
+        lexer_reset(compiler->lexer);
+    }
+    else if (!(compiler->lexer = lexer_create(_pyco_compile_lexer_options(options, options->allocators, size))))
+    {
+        return program;
+    }
+
+    pyco_lexer *lexer = compiler->lexer;
+
+    // the counters of what is kept start over, so the stats show what this compile added on top of it
+    lexer->counters = (pyco_allocation_counters){0};
+    compiler->flat.counters = (pyco_allocation_counters){0};
+
+    if (lexer->owns_symbols)
+    {
+        lexer->symbols->counters = (pyco_allocation_counters){0};
+    }
+
+    pyco_buffer buffer = {
+        .data = (pyco_uint8 *)data,
+        .size = size,
+    };
+
+    const bool lexed = lexer_process_buffer(lexer, &buffer);
+
+    if (tracked)
+    {
+        _pyco_compile_count(&program, lexer, &state, PYCO_NULL, PYCO_NULL);
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_LEX, _pyco_clock_nanoseconds() - lex_start);
+    }
+
+    if (!state.tree_arena)
+    {
+        if (compiler->arena)
+        {
+            pyco_arena_reset(compiler->arena);
+        }
+        else if (!(compiler->arena = pyco_arena_create(options->allocators, _parser_arena_size_hint(lexer))))
+        {
+            return program;
+        }
+
+        compiler->arena->counters = (pyco_allocation_counters){0};
+        state.tree_arena = compiler->arena;
+    }
 
-inline pyco_uint32 clear_bit(pyco_uint32 N, pyco_uint32 K)
-{
-    return (N & (~(1 << (K - 1))));
-}
+    state.flat = &compiler->flat;
+    state.codegen = &compiler->codegen;
 
-inline pyco_uint16 _parser_get_infix_binding_power(pyco_uint32 operator)
-{
-    pyco_uint32 new_operator = clear_bit(operator, PYCO_OPERATOR_COMPOSITE);
+    _pyco_compile_tokens(&program, lexer, &state, (const char *)data);
 
-    switch (new_operator)
+    if (cached && lexed)
     {
-    case PYCO_OPERATOR_TERNARY:
-        return _encode_powers(4, 3);
-    case PYCO_OPERATOR_ADD:
-    case PYCO_OPERATOR_SUBTRACT:
-        return _encode_powers(5, 6);
-    case PYCO_OPERATOR_MULTIPLY:
-    case PYCO_OPERATOR_DIVIDE:
-    case PYCO_OPERATOR_EQUAL:
-    case PYCO_OPERATOR_LESS:
-    case PYCO_OPERATOR_GREATER:
-    case PYCO_OPERATOR_LEFT_SHIFT:
-    case PYCO_OPERATOR_RIGHT_SHIFT:
-        return _encode_powers(7, 8);
-    case PYCO_OPERATOR_MEMBER_ACCESS:
-        return _encode_powers(14, 13);
+        _pyco_cache_store(options, &cache_key, &program);
     }
 
-    return 0;
+    return program;
 }
 
-inline pyco_uint16 _parser_get_postfix_binding_power(pyco_uint32 operator)
+void pyco_compiler_free(pyco_compiler *compiler)
 {
-    pyco_uint32 new_operator = clear_bit(operator, PYCO_OPERATOR_COMPOSITE);
-
-    switch (new_operator)
+    if (!compiler)
     {
-    case PYCO_OPERATOR_ARRAY_INDEX:
-    case PYCO_OPERATOR_INCREMENT:
-    case PYCO_OPERATOR_DECREMENT:
-        return 11;
+        return;
     }
 
-    return PYCO_OPERATOR_NONE;
+    lexer_free(compiler->lexer);
+    pyco_arena_free(compiler->arena);
+    pyco_flat_ast_free(&compiler->flat);
+    _pyco_codegen_free(&compiler->codegen);
+    _pyco_free(&compiler->options.allocators, compiler);
 }
 
-inline bool _parser_is_infix_operator(pyco_uint32 operator)
+// MARK: incremental compile
+
+// a top-level statement of a unit, what it added to the root ends where the next statement starts
+typedef struct pyco_unit_statement
 {
-    switch (operator)
+    pyco_uint32 token; // stream position the file loop started it at
+    pyco_uint32 node;  // its first node and payload word in the flat tree
+    pyco_uint32 data;
+} pyco_unit_statement;
+
+// the sizes of the arrays the unit grows itself are in bytes
+typedef struct pyco_unit
+{
+    pyco_compile_options options;
+    pyco_uint8 *source; // NUL-terminated for the dumps
+    pyco_uint64 source_size;
+    pyco_uint64 source_allocated;
+    // symbol ids stay the same across edits, names an edit removed stay interned
+    pyco_symbol_table *symbols;
+    pyco_uint8 owns_symbols;
+    pyco_lexer *lexer; // lexes the lines an edit touched, reset by every edit
+    pyco_token_block *tokens; // every token of the source in one block
+    pyco_uint32 *lines; // line index of the whole source, like the one of a lexer
+    pyco_uint64 lines_count;
+    pyco_uint64 lines_allocated;
+    pyco_unit_statement *statements;
+    pyco_uint64 statements_count;
+    pyco_uint64 statements_allocated;
+    pyco_unit_statement *parsed; // what the last edit parsed again, before it is spliced into the statements
+    pyco_uint64 parsed_allocated;
+    pyco_flat_ast flat;
+    pyco_flat_ast scratch; // the statements parsed again, flattened on their own
+    pyco_codegen codegen;
+    pyco_arena *arena;
+    pyco_allocation_counters counters;
+    pyco_allocation_counters symbols_before; // where a shared symbol table stood when the edit started
+} pyco_unit;
+
+// grows an array of the unit to at least size bytes, unlike the arrays of a flat tree it keeps what it held
+static inline bool _unit_reserve(pyco_unit *unit, void **array, pyco_uint64 *allocated, pyco_uint64 size)
+{
+    if (size <= *allocated)
     {
-    case PYCO_OPERATOR_ADD:
-    case PYCO_OPERATOR_SUBTRACT:
-    case PYCO_OPERATOR_MULTIPLY:
-    case PYCO_OPERATOR_DIVIDE:
-    case PYCO_OPERATOR_LESS:
-    case PYCO_OPERATOR_GREATER:
-    case PYCO_OPERATOR_EQUAL:
-    case PYCO_OPERATOR_LEFT_SHIFT:
-    case PYCO_OPERATOR_RIGHT_SHIFT:
         return true;
     }
 
-    return false;
-}
-
-inline const bool _parser_is_prefix_operator(pyco_uint32 operator)
-{
-    pyco_uint32 new_operator = clear_bit(operator, PYCO_OPERATOR_COMPOSITE);
+    const pyco_uint64 grown = *allocated * 2 > size ? *allocated * 2 : size;
+    void *resized = _pyco_realloc(&unit->options.allocators, *array, *allocated, grown);
 
-    switch (new_operator)
+    if (!resized)
     {
-    case PYCO_OPERATOR_NOT:
-        return true;
+        return false;
     }
 
-    return false;
+    _count_allocation(&unit->counters, grown, *allocated != 0);
+    *array = resized;
+    *allocated = grown;
+
+    return true;
 }
 
-inline const bool _parser_is_postfix_operator(pyco_uint32 operator)
+static bool _unit_reserve_tokens(pyco_unit *unit, pyco_uint64 count)
 {
-    pyco_uint32 new_operator = clear_bit(operator, PYCO_OPERATOR_COMPOSITE);
+    pyco_token_block *tokens = unit->tokens;
 
-    switch (new_operator)
+    if (tokens && count <= tokens->allocated)
     {
-    case PYCO_OPERATOR_ARRAY_INDEX:
-    case PYCO_OPERATOR_INCREMENT:
-    case PYCO_OPERATOR_DECREMENT:
         return true;
     }
 
-    return false;
-}
+    const pyco_uint64 allocated = tokens && tokens->allocated * 2 > count ? tokens->allocated * 2 : count + 64;
+    pyco_token_block *block = _pyco_malloc(&unit->options.allocators, PYCO_TOKEN_BLOCK_BYTES(allocated));
 
-pyco_ast_node *_parse_scope(pyco_ast *ast, pyco_lexer *lexer);
-pyco_ast_node *_parse_expression(pyco_ast *ast, pyco_lexer *lexer, pyco_uint32 flags, pyco_uint8 minimum_binding_power);
+    if (!block)
+    {
+        return false;
+    }
 
-bool _parser_handle_comments(pyco_ast *ast, pyco_lexer *lexer)
-{
-    const pyco_token *start_token = lexer_get_current_token(lexer);
+    _count_allocation(&unit->counters, PYCO_TOKEN_BLOCK_BYTES(allocated), tokens != PYCO_NULL);
+    _token_block_layout(block, allocated);
+    block->first = 0;
 
-    do
+    if (tokens)
     {
-        const pyco_token *current_token = lexer_get_current_token(lexer);
+        // the literals are not in the block and move over as they are
+        block->literals = tokens->literals;
+        block->literals_count = tokens->literals_count;
+        block->literals_allocated = tokens->literals_allocated;
+        memcpy(block->offsets, tokens->offsets, sizeof(pyco_uint32) * tokens->count);
+        memcpy(block->lengths, tokens->lengths, sizeof(pyco_uint32) * tokens->count);
+        memcpy(block->payloads, tokens->payloads, sizeof(pyco_uint32) * tokens->count);
+        memcpy(block->kinds, tokens->kinds, tokens->count);
+        block->count = tokens->count;
+        _pyco_free(&unit->options.allocators, tokens);
+    }
 
-        if (current_token->start.line != start_token->start.line)
-        {
-            return true;
-        }
-    } while (lexer_get_next_token(lexer));
+    unit->tokens = block;
 
     return true;
 }
 
-pyco_ast_node *_parser_handle_function_arguments(pyco_ast *ast, pyco_lexer *lexer)
+// copies count tokens from one block into another, or inside one block when the ranges overlap. numbers from
+// another block add their literals to the ones of to, which has to have room for them
+static inline void _unit_move_tokens(pyco_token_block *to, pyco_uint64 to_index, const pyco_token_block *from, pyco_uint64 from_index, pyco_uint64 count)
 {
-    pyco_ast_node *arguments_node = pyco_ast_node_create(ast, PYCO_NULL, PYCO_AST_NODE_TYPE_ARGUMENTS, PYCO_NULL, 0);
-
-    const pyco_token *arguments_start_token = lexer_get_next_token(lexer);
-
-    if ((~arguments_start_token->flags & PYCO_TOKEN_TYPE_SPECIAL) || arguments_start_token->value[0] != '(')
-    {
-        return false;
-    }
-
-    const pyco_token *argument_name = PYCO_NULL;
-    const pyco_token *argument_type = PYCO_NULL;
+    memmove(to->offsets + to_index, from->offsets + from_index, sizeof(pyco_uint32) * count);
+    memmove(to->lengths + to_index, from->lengths + from_index, sizeof(pyco_uint32) * count);
+    memmove(to->payloads + to_index, from->payloads + from_index, sizeof(pyco_uint32) * count);
+    memmove(to->kinds + to_index, from->kinds + from_index, count);
 
-    while (lexer_get_next_token(lexer))
+    for (pyco_uint64 i = to_index; to != from && i < to_index + count; i++)
     {
-        const pyco_token *current_token = lexer_get_current_token(lexer);
-
-        if (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->value[0] == ')')
-        {
-            lexer_get_next_token(lexer);
-            break;
-        }
-
-        if (argument_name == PYCO_NULL)
-        {
-            argument_name = current_token;
-        }
-        else if (argument_type == PYCO_NULL)
-        {
-            argument_type = current_token;
-        }
-
-        if (argument_name && argument_type)
+        if (_token_type_is_number(to->kinds[i] & PYCO_TOKEN_TYPE_MASK))
         {
-            pyco_ast_node_add(ast, arguments_node, argument_name->value, PYCO_AST_NODE_TYPE_FUNCTION, PYCO_NULL, 0);
-            argument_name = PYCO_NULL;
-            argument_type = PYCO_NULL;
+            to->literals[to->literals_count] = from->literals[to->payloads[i]];
+            to->payloads[i] = (pyco_uint32)to->literals_count++;
         }
     }
-
-    return arguments_node;
-}
-
-pyco_ast_node *_parser_handle_function_body(pyco_ast *ast, pyco_lexer *lexer)
-{
-    return _parse_scope(ast, lexer);
 }
 
-pyco_ast_node *_parser_handle_function_declaration(pyco_ast *ast, pyco_lexer *lexer, const pyco_token *identifier_token)
+// makes room for count more literals in the tokens of the unit. the literals of tokens an edit replaced stay
+// behind, so before growing the ones still in use are packed to the front
+static bool _unit_reserve_literals(pyco_unit *unit, pyco_uint64 count)
 {
-    pyco_ast_node *function_node = pyco_ast_node_create(ast, identifier_token->value, PYCO_AST_NODE_TYPE_FUNCTION, PYCO_NULL, 0);
+    pyco_token_block *tokens = unit->tokens;
 
-    pyco_ast_node *function_arguments_node = _parser_handle_function_arguments(ast, lexer);
-    pyco_ast_node *function_body_node = _parser_handle_function_body(ast, lexer);
-
-    if (function_arguments_node)
+    if (tokens->literals_count + count <= tokens->literals_allocated)
     {
-        pyco_ast_node_append(function_node, function_arguments_node);
+        return true;
     }
 
-    if (function_body_node)
+    pyco_uint64 used = 0;
+
+    for (pyco_uint64 i = 0; i < tokens->count; i++)
     {
-        pyco_ast_node_append(function_node, function_body_node);
+        used += _token_type_is_number(tokens->kinds[i] & PYCO_TOKEN_TYPE_MASK);
     }
 
-    return function_node;
-}
-
-// MARK: parse struct
-pyco_ast_node *_parser_handle_struct_declaration(pyco_ast *ast, pyco_lexer *lexer, const pyco_token *identifier_token)
-{
-    pyco_ast_node *struct_node = pyco_ast_node_create(ast, identifier_token->value, PYCO_AST_NODE_TYPE_STRUCT, PYCO_NULL, 0);
-
-    const pyco_token *definition_start = lexer_get_next_token(lexer);
+    pyco_token_block packed = {
+        .literals_count = 0,
+        .literals_allocated = 0,
+    };
 
-    if (!definition_start || ~definition_start->flags & PYCO_TOKEN_TYPE_SPECIAL || definition_start->value[0] != '{')
+    if (!_token_block_reserve_literals(&packed, &unit->options.allocators, &unit->counters, (used + count) * 2))
     {
         return false;
     }
 
-    const pyco_token *field_name = PYCO_NULL;
-    const pyco_token *field_type = PYCO_NULL;
-    bool invalid = false;
-    bool ready_to_parse = true;
-
-    while (lexer_get_next_token(lexer))
+    for (pyco_uint64 i = 0; i < tokens->count; i++)
     {
-        const pyco_token *current_token = lexer_get_current_token(lexer);
-
-        bool is_field_completed = field_name && field_type;
-
-        if (!current_token)
+        if (_token_type_is_number(tokens->kinds[i] & PYCO_TOKEN_TYPE_MASK))
         {
-            invalid = true;
-            break;
+            packed.literals[packed.literals_count] = tokens->literals[tokens->payloads[i]];
+            tokens->payloads[i] = (pyco_uint32)packed.literals_count++;
         }
+    }
 
-        if (current_token->flags & PYCO_TOKEN_TYPE_INDENT)
-        {
-            ready_to_parse = true;
-            continue;
-        }
+    if (tokens->literals)
+    {
+        _pyco_free(&unit->options.allocators, tokens->literals);
+    }
 
-        if (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL)
-        {
-            if (current_token->value[0] == ';')
-            {
-                if (field_name && !field_type)
-                {
-                    break;
-                }
+    tokens->literals = packed.literals;
+    tokens->literals_count = packed.literals_count;
+    tokens->literals_allocated = packed.literals_allocated;
 
-                ready_to_parse = true;
-                continue;
-            }
+    return true;
+}
 
-            if (current_token->value[0] == '}')
-            {
-                lexer_get_next_token(lexer);
-                break;
-            }
+// position of the first token at or after the source offset
+static pyco_uint64 _unit_token_at(const pyco_unit *unit, pyco_uint64 offset)
+{
+    pyco_uint64 low = 0;
+    pyco_uint64 high = unit->tokens ? unit->tokens->count : 0;
 
-            break;
-        }
+    while (low < high)
+    {
+        const pyco_uint64 middle = (low + high) / 2;
 
-        if (ready_to_parse)
+        if (unit->tokens->offsets[middle] < offset)
         {
-            if (field_name == PYCO_NULL)
-            {
-                field_name = current_token;
-            }
-            else if (field_type == PYCO_NULL)
-            {
-                field_type = current_token;
-            }
-            else
-            {
-                invalid = true;
-                break;
-            }
-
-            if (field_name && field_type)
-            {
-                if (field_name->start.line != field_type->start.line)
-                {
-                    invalid = true;
-                    break;
-                }
-
-                pyco_ast_node *field_node = pyco_ast_node_add(ast, struct_node, field_name->value, PYCO_AST_NODE_TYPE_STRUCT_FIELD, PYCO_NULL, 0);
-
-                field_name = PYCO_NULL;
-                field_type = PYCO_NULL;
-                ready_to_parse = false;
-            }
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
         }
     }
 
-    return struct_node;
+    return low;
 }
 
-// MARK: parse var declaration
-pyco_ast_node *_parser_handle_variable_declaration(pyco_ast *ast, pyco_lexer *lexer, const pyco_token *identifier_token)
+// a line can also start inside a template string, only after a line break token does the lexer start over from scratch
+static inline bool _unit_line_is_break(const pyco_unit *unit, pyco_uint64 line_offset)
 {
-    pyco_ast_node *declaration_node = pyco_ast_node_create(ast, identifier_token->value, PYCO_AST_NODE_TYPE_STATEMENT, PYCO_NULL, 0);
-    pyco_ast_node *expression_node = _parse_expression(ast, lexer, PYCO_NULL, 0);
-
-    pyco_ast_node_append(declaration_node, expression_node);
+    const pyco_uint64 index = _unit_token_at(unit, line_offset);
 
-    return declaration_node;
+    return !index || unit->tokens->offsets[index - 1] + unit->tokens->lengths[index - 1] < line_offset;
 }
 
-// MARK: parse declaration
-pyco_ast_node *_parser_handle_declaration(pyco_ast *ast, pyco_lexer *lexer, const pyco_token *identifier_token)
+// moves a flat node by node_delta nodes and data_delta payload words, and its token span by source_delta bytes.
+// the deltas wrap around when the tree or the source shrank, so do the fields they are added to
+static inline void _unit_move_node(pyco_flat_ast *flat, pyco_uint32 index, pyco_uint32 node_delta, pyco_uint32 data_delta, pyco_uint32 source_delta)
 {
-    const pyco_token *declaration_type_token = lexer_get_current_token(lexer);
-    const pyco_token *declaration_modifier_token = lexer_get_next_token(lexer);
+    pyco_flat_node *node = &flat->nodes[index];
 
-    const pyco_token *next_token = lexer_get_next_token(lexer);
+    // nodes made from no token have an empty span at 0
+    if (node->offset || node->length)
+    {
+        node->offset += source_delta;
+    }
 
-    if (!next_token || next_token->flags & PYCO_TOKEN_TYPE_INDENT)
+    if (!node->data)
     {
-        return false;
+        return;
     }
 
-    if (declaration_modifier_token->flags & PYCO_TOKEN_TYPE_SPECIAL && declaration_modifier_token->value[0] == ':' && next_token->flags & PYCO_TOKEN_TYPE_IDENTIFIER)
+    node->data += data_delta;
+
+    if (ast_node_is_control_flow(node->type))
     {
-        if (strcmp(next_token->value, "function") == 0)
-        {
-            return _parser_handle_function_declaration(ast, lexer, identifier_token);
-        }
+        pyco_flat_control_flow *slots = (pyco_flat_control_flow *)(flat->data + node->data);
 
-        if (strcmp(next_token->value, "struct") == 0)
-        {
-            return _parser_handle_struct_declaration(ast, lexer, identifier_token);
-        }
+        slots->condition += slots->condition ? node_delta : 0;
+        slots->body += slots->body ? node_delta : 0;
+        slots->else_body += slots->else_body ? node_delta : 0;
+        slots->initializer += slots->initializer ? node_delta : 0;
+        slots->step += slots->step ? node_delta : 0;
     }
-
-    return _parser_handle_variable_declaration(ast, lexer, identifier_token);
 }
 
-pyco_uint32 get_control_flow_type(const pyco_token *token)
+// an edit that ran out of memory leaves the unit with its source alone, the next one lexes and parses all of it
+static inline void _unit_forget(pyco_unit *unit)
 {
-    if (strcmp(token->value, "if") == 0)
+    if (unit->tokens)
     {
-        return PYCO_AST_NODE_TYPE_IF;
+        unit->tokens->count = 0;
+        unit->tokens->literals_count = 0;
     }
 
-    if (strcmp(token->value, "for") == 0)
+    unit->lines_count = 0;
+    unit->statements_count = 0;
+    unit->flat.count = 0;
+    unit->flat.data_count = 0;
+}
+
+static void _unit_count(pyco_compiled_program *program, pyco_unit *unit, pyco_ast *ast)
+{
+    pyco_compile_stats *stats = &program->stats;
+
+    stats->tokens_count = unit->lexer->tokens_count;
+    stats->symbols_count = pyco_symbol_table_count(unit->symbols);
+    stats->bytes_allocated = 0;
+    stats->realloc_calls = 0;
+
+    _pyco_compile_add_counters(stats, unit->counters, (pyco_allocation_counters){0});
+    _pyco_compile_add_counters(stats, unit->lexer->counters, (pyco_allocation_counters){0});
+    _pyco_compile_add_counters(stats, unit->symbols->counters, unit->symbols_before);
+
+    if (ast)
     {
-        return PYCO_AST_NODE_TYPE_FOR;
+        stats->nodes_count = ast->nodes_count;
+        stats->arena_peak = _arena_used(unit->arena);
+        _pyco_compile_add_counters(stats, unit->arena->counters, (pyco_allocation_counters){0});
+        _pyco_compile_add_counters(stats, unit->flat.counters, (pyco_allocation_counters){0});
+        _pyco_compile_add_counters(stats, unit->scratch.counters, (pyco_allocation_counters){0});
     }
+}
 
-    if (strcmp(token->value, "do") == 0)
+void pyco_unit_free(pyco_unit *unit);
+
+pyco_unit *pyco_unit_create(pyco_compile_options options)
+{
+    if (!options.allocators.malloc || !options.allocators.realloc || !options.allocators.free)
     {
-        return PYCO_AST_NODE_TYPE_DO_WHILE;
+        return PYCO_NULL;
     }
 
-    if (strcmp(token->value, "while") == 0)
+    pyco_unit *unit = _pyco_malloc(&options.allocators, sizeof(pyco_unit));
+
+    if (!unit)
     {
-        return PYCO_AST_NODE_TYPE_WHILE;
+        return PYCO_NULL;
     }
 
-    if (strcmp(token->value, "continue") == 0)
+    // edits are spliced into what the unit keeps, so it holds its own copy of the source and all of its tokens
+    options.copy_buffer = 1;
+    options.token_window = 0;
+    options.linear_allocation = 0;
+    options.parse_threads = 0;
+
+    *unit = (pyco_unit){
+        .options = options,
+        .symbols = options.symbols,
+        .flat = {
+            .allocators = options.allocators,
+        },
+        .scratch = {
+            .allocators = options.allocators,
+        },
+        .codegen = {
+            .allocators = options.allocators,
+        },
+    };
+
+    if (!unit->symbols)
     {
-        return PYCO_AST_NODE_TYPE_CONTINUE;
+        unit->owns_symbols = 1;
+        unit->symbols = pyco_symbol_table_create(options.allocators, 256);
     }
 
-    if (strcmp(token->value, "break") == 0)
+    pyco_lexer_options lexer_options = lexer_initialize_options();
+    lexer_options.allocators = options.allocators;
+    lexer_options.symbols = unit->symbols;
+    lexer_options.copy_source = 0;
+
+    if (!unit->symbols || !(unit->lexer = lexer_create(lexer_options)) || !(unit->arena = pyco_arena_create(options.allocators, 64 * 1024)))
     {
-        return PYCO_AST_NODE_TYPE_BREAK;
+        pyco_unit_free(unit);
+        return PYCO_NULL;
     }
 
-    return PYCO_AST_NODE_TYPE_NONE;
+    return unit;
 }
 
-// MARK: parse control flow
-pyco_ast_node *_parse_control_flow(pyco_ast *ast, pyco_lexer *lexer)
+pyco_compiled_program pyco_unit_edit(pyco_unit *unit, pyco_uint64 offset, pyco_uint64 removed_size, const pyco_uint8 *text, pyco_uint64 text_size)
 {
-    const pyco_token *token = lexer_get_current_token(lexer);
+    pyco_compiled_program program = {0};
 
-    pyco_uint32 control_flow_type = get_control_flow_type(token);
-
-    if (!lexer_get_next_token(lexer))
+    if (!unit)
     {
-        return PYCO_NULL;
+        return program;
     }
 
-    pyco_ast_node *control_flow_node = pyco_ast_node_create(ast, PYCO_NULL, control_flow_type, PYCO_NULL, 0);
-
-    if (control_flow_type == PYCO_AST_NODE_TYPE_IF)
-    {
-        pyco_ast_node *true_path_node = pyco_ast_node_create(ast, "IF_TRUE", control_flow_type, PYCO_NULL, 0);
-        pyco_ast_node *condition_node = pyco_ast_node_create(ast, "CONDITION", control_flow_type, PYCO_NULL, 0);
-        pyco_ast_node *expression_node = _parse_expression(ast, lexer, 0, 0);
-        pyco_ast_node *body_node = _parse_scope(ast, lexer);
-
-        pyco_ast_node_append(condition_node, expression_node);
-        pyco_ast_node_append(true_path_node, condition_node);
-        pyco_ast_node_append(true_path_node, body_node);
-        pyco_ast_node_append(control_flow_node, true_path_node);
+    program.compile_options = unit->options;
 
-        const pyco_token *current_token = lexer_get_current_token(lexer);
+    const pyco_compile_options *options = &unit->options;
+    const pyco_uint64 old_size = unit->source_size;
 
-        if (current_token && current_token->length == 4 && strcmp(current_token->value, "else") == 0)
-        {
-            if (!current_token->next)
-            {
-                return PYCO_NULL;
-            }
+    // token offsets and lengths are stored as 32 bit values
+    if (offset > old_size || removed_size > old_size - offset || (text_size && !text) || old_size - removed_size + text_size > 0xFFFFFFFF)
+    {
+        return program;
+    }
 
-            lexer_get_next_token(lexer);
+    const bool tracked = _pyco_compile_tracked(options);
+    const pyco_uint64 lex_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    const pyco_uint64 new_size = old_size - removed_size + text_size;
+    const pyco_uint64 edit_end = offset + removed_size;
+    const pyco_uint32 source_delta = (pyco_uint32)(text_size - removed_size);
+    pyco_lexer *lexer = unit->lexer;
+
+    // the counters start over so the stats show what this edit added
+    unit->counters = (pyco_allocation_counters){0};
+    unit->flat.counters = (pyco_allocation_counters){0};
+    unit->scratch.counters = (pyco_allocation_counters){0};
+    unit->arena->counters = (pyco_allocation_counters){0};
+    lexer->counters = (pyco_allocation_counters){0};
+
+    if (unit->owns_symbols)
+    {
+        unit->symbols->counters = (pyco_allocation_counters){0};
+    }
 
-            pyco_ast_node *else_path_node = pyco_ast_node_create(ast, "ELSE", control_flow_type, PYCO_NULL, 0);
+    unit->symbols_before = unit->symbols->counters;
 
-            if (current_token->next->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->next->value[0] == '{')
-            {
-                pyco_ast_node *else_body_node = _parse_scope(ast, lexer);
-                pyco_ast_node_append(else_path_node, else_body_node);
-            }
+    if (!_unit_reserve(unit, (void **)&unit->source, &unit->source_allocated, new_size + 1))
+    {
+        return program;
+    }
 
-            if (current_token->next->length == 2 && current_token->next->value[0] == 'i' && current_token->next->value[1] == 'f')
-            {
-                pyco_ast_node *else_body_node = _parse_control_flow(ast, lexer);
-                pyco_ast_node_append(else_path_node, else_body_node);
-            }
+    memmove(unit->source + offset + text_size, unit->source + edit_end, old_size - edit_end);
 
-            pyco_ast_node_append(control_flow_node, else_path_node);
-        }
+    if (text_size)
+    {
+        memcpy(unit->source + offset, text, text_size);
     }
 
-    if (control_flow_type == PYCO_AST_NODE_TYPE_WHILE)
-    {
-        pyco_ast_node *condition_node = pyco_ast_node_create(ast, "CONDITION", control_flow_type, PYCO_NULL, 0);
-        pyco_ast_node *expression_node = _parse_expression(ast, lexer, 0, 0);
-        pyco_ast_node *body_node = _parse_scope(ast, lexer);
+    unit->source[new_size] = 0;
+    unit->source_size = new_size;
 
-        pyco_ast_node_append(control_flow_node, condition_node);
-        pyco_ast_node_append(condition_node, expression_node);
-        pyco_ast_node_append(control_flow_node, body_node);
-    }
+    // the lexer starts over after the last line break before the edit. one right at the edit is not taken,
+    // the text inserted there could turn a \r into a \r\n
+    pyco_uint64 kept_lines = 0;
 
-    if (control_flow_type == PYCO_AST_NODE_TYPE_DO_WHILE)
+    for (pyco_uint64 low = 0, high = unit->lines_count; low < high;)
     {
-        const pyco_token *current_token = lexer_get_current_token(lexer);
+        const pyco_uint64 middle = (low + high) / 2;
 
-        if (!(current_token->flags & PYCO_TOKEN_TYPE_SPECIAL) || current_token->value[0] != '{')
+        if (unit->lines[middle] < offset)
         {
-            return PYCO_NULL;
+            kept_lines = low = middle + 1;
         }
-
-        pyco_ast_node *body_node = _parse_scope(ast, lexer);
-
-        current_token = lexer_get_current_token(lexer);
-
-        if (!current_token || strcmp(current_token->value, "while"))
+        else
         {
-            return PYCO_NULL;
+            high = middle;
         }
-
-        pyco_ast_node *condition_node = pyco_ast_node_create(ast, "CONDITION", control_flow_type, PYCO_NULL, 0);
-        pyco_ast_node *expression_node = _parse_expression(ast, lexer, 0, 0);
-
-        pyco_ast_node_append(control_flow_node, condition_node);
-        pyco_ast_node_append(condition_node, expression_node);
-        pyco_ast_node_append(control_flow_node, body_node);
     }
 
-    if (control_flow_type == PYCO_AST_NODE_TYPE_FOR)
+    while (kept_lines && !_unit_line_is_break(unit, unit->lines[kept_lines - 1]))
     {
-        const pyco_token *current_token = lexer_get_current_token(lexer);
-
-        if (!(current_token->flags & PYCO_TOKEN_TYPE_SPECIAL) || current_token->value[0] != '{')
-        {
-            pyco_ast_node *arguments_node = pyco_ast_node_create(ast, "ARGUMENTS", control_flow_type, PYCO_NULL, 0);
-            pyco_ast_node *expression_node = PYCO_NULL;
-            do
-            {
-                current_token = lexer_get_current_token(lexer);
-
-                if (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->value[0] == ';')
-                {
-                    if (expression_node == PYCO_NULL)
-                    {
-                        pyco_ast_node *empty_argument_node = pyco_ast_node_create(ast, "ARGUMENT_PART_EMPTY", control_flow_type, PYCO_NULL, 0);
-                        pyco_ast_node_append(arguments_node, empty_argument_node);
-                    }
-                    continue;
-                }
-
-                if (expression_node = _parse_expression(ast, lexer, 0, 0))
-                {
-                    pyco_ast_node *argument_expression_node = pyco_ast_node_create(ast, "ARGUMENT_EXPRESSION", control_flow_type, PYCO_NULL, 0);
-                    pyco_ast_node_append(argument_expression_node, expression_node);
-                    pyco_ast_node_append(arguments_node, argument_expression_node);
-                }
-
-                current_token = lexer_get_current_token(lexer);
-
-                if (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->value[0] == '{')
-                {
-                    break;
-                }
-            } while (lexer_get_next_token(lexer));
-
-            pyco_ast_node_append(control_flow_node, arguments_node);
-        }
-
-        pyco_ast_node *body_node = _parse_scope(ast, lexer);
-
-        pyco_ast_node_append(control_flow_node, body_node);
+        kept_lines--;
     }
 
-    return control_flow_node;
-}
+    const pyco_uint64 lex_from = kept_lines ? unit->lines[kept_lines - 1] : 0;
 
-// MARK: parse scope
-pyco_ast_node *_parse_scope(pyco_ast *ast, pyco_lexer *lexer)
-{
-    if (!lexer_get_next_token(lexer))
-    {
-        return PYCO_NULL;
-    }
+    lexer_reset(lexer);
+    lexer->source = unit->source;
+    lexer->scan_offset = lex_from;
+    lexer->scan_token_start = lex_from;
 
-    pyco_ast_node *scope_node = pyco_ast_node_create(ast, PYCO_NULL, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0);
+    // past the edit the old line breaks are where the tokens can match up again. a line break lexed at one of them
+    // leaves the lexer in the state the old lexing was in there, and the text behind it did not change
+    pyco_uint64 resync_line = unit->lines_count;
 
-    do
+    for (pyco_uint64 i = kept_lines; i < unit->lines_count; i++)
     {
-        const pyco_token *token = lexer_get_current_token(lexer);
+        const pyco_uint64 line = unit->lines[i];
 
-        if (token->flags & PYCO_TOKEN_TYPE_INDENT)
+        if (line < edit_end || line - removed_size + text_size <= lexer->scan_offset || !_unit_line_is_break(unit, line))
         {
             continue;
         }
 
-        if (token->value[0] == '{')
-        {
-            pyco_ast_node_append(scope_node, _parse_scope(ast, lexer));
-            continue;
-        }
+        lexer->source_size = line - removed_size + text_size;
+        _lexer_scan(lexer, false);
 
-        if (get_control_flow_type(token))
+        // the line break reaches the end of what was scanned, so it is still open
+        if (lexer->scan_state == PYCO_LEXER_STATE_LINE_FEED)
         {
-            pyco_ast_node_append(scope_node, _parse_control_flow(ast, lexer));
-            continue;
+            _lexer_accept(lexer, lexer->scan_state, lexer->scan_token_start, lexer->source_size);
+            lexer->scan_state = PYCO_LEXER_STATE_START;
+            resync_line = i;
+            break;
         }
+    }
 
-        pyco_ast_node *expression_node = _parse_expression(ast, lexer, 0, 0);
+    if (resync_line == unit->lines_count)
+    {
+        lexer->source_size = new_size;
+        _lexer_scan(lexer, true);
+    }
 
-        if (expression_node)
-        {
-            pyco_ast_node_append(scope_node, expression_node);
-        }
+    // the tokens and lines lexed again replace the old ones in between, the ones behind them move along with the text
+    const pyco_uint64 old_tokens = unit->tokens ? unit->tokens->count : 0;
+    const pyco_uint64 first_token = _unit_token_at(unit, lex_from);
+    const pyco_uint64 old_end_token = resync_line < unit->lines_count ? _unit_token_at(unit, unit->lines[resync_line]) : old_tokens;
+    const pyco_uint64 tokens_count = old_tokens - (old_end_token - first_token) + lexer->tokens_count;
+    const pyco_uint64 kept_after = resync_line < unit->lines_count ? unit->lines_count - resync_line - 1 : 0;
+    const pyco_uint64 lines_count = kept_lines + lexer->lines_count + kept_after;
 
-        token = lexer_get_current_token(lexer);
+    pyco_uint64 literals_count = 0;
 
-        if (token && token->flags & PYCO_TOKEN_TYPE_SPECIAL && token->value[0] == '}')
-        {
-            lexer_get_next_token(lexer);
-            break;
-        }
-    } while (lexer_get_next_token(lexer));
+    for (pyco_token_block *block = lexer->token_block_first; block && block->count; block = block->next)
+    {
+        literals_count += block->literals_count;
+    }
 
-    return scope_node;
-}
+    if (!_unit_reserve_tokens(unit, tokens_count) || !_unit_reserve_literals(unit, literals_count) ||
+        !_unit_reserve(unit, (void **)&unit->lines, &unit->lines_allocated, sizeof(pyco_uint32) * lines_count))
+    {
+        _unit_forget(unit);
+        return program;
+    }
 
-// MARK: parse expression
-pyco_ast_node *_parse_expression(pyco_ast *ast, pyco_lexer *lexer, pyco_uint32 flags, pyco_uint8 minimum_binding_power)
-{
-    const pyco_token *left_hand_token = lexer_get_current_token(lexer);
-    pyco_ast_node *left_hand_side = PYCO_NULL;
+    pyco_token_block *tokens = unit->tokens;
 
-    pyco_uint32 possible_operator = _token_to_operator(left_hand_token);
+    _unit_move_tokens(tokens, first_token + lexer->tokens_count, tokens, old_end_token, old_tokens - old_end_token);
 
-    if (left_hand_token && (left_hand_token->value[0] == '{' || left_hand_token->value[0] == '}'))
+    for (pyco_uint64 i = first_token + lexer->tokens_count; i < tokens_count; i++)
     {
-        return left_hand_side;
+        tokens->offsets[i] += source_delta;
     }
 
-    if (possible_operator && (possible_operator & PYCO_OPERATOR_COMPOSITE) && left_hand_token->value[0] == '/' && left_hand_token->next->value[0] == '/')
+    pyco_uint64 index = first_token;
+
+    for (pyco_token_block *block = lexer->token_block_first; block && block->count; block = block->next)
     {
-        _parser_handle_comments(ast, lexer);
-        return left_hand_side;
+        _unit_move_tokens(tokens, index, block, 0, block->count);
+        index += block->count;
     }
 
-    lexer_get_next_token(lexer);
+    tokens->count = tokens_count;
 
-    if (_parser_is_prefix_operator(possible_operator))
-    {
-        pyco_ast_node *right_hand_side = _parse_expression(ast, lexer, flags, _parser_get_prefix_binding_power(possible_operator));
-        left_hand_side = pyco_ast_node_create(ast, left_hand_token->value, PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
-        pyco_ast_node_append(left_hand_side, right_hand_side);
-    }
-    else if (possible_operator == PYCO_OPERATOR_GROUPING)
+    memmove(unit->lines + kept_lines + lexer->lines_count, unit->lines + unit->lines_count - kept_after, sizeof(pyco_uint32) * kept_after);
+    memcpy(unit->lines + kept_lines, lexer->line_offsets, sizeof(pyco_uint32) * lexer->lines_count);
+
+    for (pyco_uint64 i = kept_lines + lexer->lines_count; i < lines_count; i++)
     {
-        pyco_ast_node *expression = _parse_expression(ast, lexer, flags, 0);
-        left_hand_side = pyco_ast_node_create(ast, left_hand_token->value, PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
-        pyco_ast_node_append(left_hand_side, expression);
-        lexer_get_next_token(lexer);
+        unit->lines[i] += source_delta;
     }
-    else
+
+    unit->lines_count = lines_count;
+
+    if (tracked)
     {
-        left_hand_side = pyco_ast_node_create(ast, left_hand_token->value, PYCO_AST_NODE_TYPE_LITERAL, 0, 0);
+        _unit_count(&program, unit, PYCO_NULL);
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_LEX, _pyco_clock_nanoseconds() - lex_start);
     }
 
-    do
+    const pyco_uint64 parse_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    const pyco_uint64 changed_end = first_token + lexer->tokens_count;
+
+    // the statement before the first token lexed again looked at the first token of the next one, so when that
+    // token is among them the parse starts over one statement earlier
+    pyco_uint64 first = 0;
+
+    for (pyco_uint64 low = 0, high = unit->statements_count; low < high;)
     {
-        const pyco_token *operator_token = lexer_get_current_token(lexer);
-        const pyco_uint32 operator = _token_to_operator(operator_token);
+        const pyco_uint64 middle = (low + high) / 2;
 
-        if (!operator)
+        if (unit->statements[middle].token <= first_token)
         {
-            break;
+            first = middle;
+            low = middle + 1;
         }
-
-        if (operator & PYCO_OPERATOR_COMPOSITE && (operator_token->value[0] == '=' || operator_token->value[0] == '+'))
+        else
         {
-            lexer_get_next_token(lexer);
+            high = middle;
         }
+    }
 
-        if ((operator & PYCO_OPERATOR_COMPOSITE) && operator_token->value[0] == '/' && operator_token->next->value[0] == '/')
-        {
-            _parser_handle_comments(ast, lexer);
-            continue;
-        }
+    while (first && first_token <= unit->statements[first].token)
+    {
+        first--;
+    }
+
+    pyco_arena_reset(unit->arena);
+
+    pyco_ast_options tree_options = {
+        .allocators = options->allocators,
+        .arena = unit->arena,
+    };
+
+    pyco_ast ast = initialize_tree(tree_options);
+    pyco_ast_node *scope_node = pyco_ast_node_create(&ast, PYCO_AST_LABEL_NONE, PYCO_AST_NODE_TYPE_SCOPE, PYCO_NULL, 0);
+
+    // a cursor over the tokens of the unit, the statements are parsed exactly like in the file loop
+    pyco_token_cursor cursor = {
+        .source = unit->source,
+        .block = tokens,
+        .index = unit->statements_count ? unit->statements[first].token : 0,
+    };
+
+    // the parse ends once a statement starts where an old one after the edit did, the ones from there on are the same
+    pyco_uint64 parsed_count = 0;
+    pyco_uint64 resync = unit->statements_count;
+    pyco_uint64 next = first;
+    bool reserved = true;
+
+    if (ast.root_node && scope_node && token_valid(cursor_get_current_token(&cursor)))
+    {
+        pyco_uint32 children = 0;
 
-        if (_parser_is_postfix_operator(operator))
+        while ((reserved = _unit_reserve(unit, (void **)&unit->parsed, &unit->parsed_allocated, sizeof(pyco_unit_statement) * (parsed_count + 1))))
         {
-            const pyco_uint16 postfix_binding_power = _parser_get_postfix_binding_power(operator);
+            // node holds the children before the statement until they are flattened
+            unit->parsed[parsed_count++] = (pyco_unit_statement){
+                .token = (pyco_uint32)_cursor_position(&cursor),
+                .node = children,
+            };
+
+            pyco_ast_node *last_child = scope_node->child_last;
+            const bool open = _parse_scope_statement(&ast, &cursor, scope_node);
 
-            if (postfix_binding_power < minimum_binding_power)
+            children += scope_node->child_last != last_child;
+
+            if (!open || !token_valid(cursor_get_current_token(&cursor)))
             {
                 break;
             }
 
-            lexer_get_next_token(lexer);
+            const pyco_uint64 position = _cursor_position(&cursor);
 
-            if (operator == PYCO_OPERATOR_ARRAY_INDEX)
+            if (position < changed_end)
             {
-                pyco_ast_node *right_hand_side = _parse_expression(ast, lexer, flags, 0);
-                pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, "INDEX_OPERATOR", PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
-
-                pyco_ast_node_append(new_left_hand_side, left_hand_side);
-                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+                continue;
+            }
 
-                left_hand_side = new_left_hand_side;
+            const pyco_uint64 old_position = position - changed_end + old_end_token;
 
-                lexer_get_next_token(lexer);
+            while (next < unit->statements_count && unit->statements[next].token < old_position)
+            {
+                next++;
             }
-            else
+
+            if (next < unit->statements_count && unit->statements[next].token == old_position)
             {
-                pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, operator_token->value, PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
-                pyco_ast_node_append(new_left_hand_side, left_hand_side);
-                left_hand_side = new_left_hand_side;
+                resync = next;
+                break;
             }
+        }
+    }
 
-            continue;
+    const bool whole = first == 0 && resync == unit->statements_count;
+
+    // an empty file stays a lone root, like in the file loop
+    if (!whole || parsed_count)
+    {
+        ast.root_node = scope_node;
+    }
+
+    if (!reserved || !ast.root_node || !pyco_ast_flatten_into(&ast, unit->source, &unit->scratch))
+    {
+        _unit_forget(unit);
+        pyco_ast_free(&ast, ast.root_node);
+        return program;
+    }
+
+    pyco_flat_ast *scratch = &unit->scratch;
+    pyco_unit_statement *parsed = unit->parsed;
+
+    // the children of the scope follow each other, a statement starts at the first one it added
+    for (pyco_uint64 i = 0, node = 1, child = 0; i < parsed_count; i++)
+    {
+        for (; child < parsed[i].node; child++)
+        {
+            node += scratch->nodes[node].size;
         }
 
-        if (flags & PYCO_OPERATOR_FUNCTION_CALL && operator_token->flags & PYCO_TOKEN_TYPE_SPECIAL && operator_token->value[0] == ',')
+        parsed[i].node = (pyco_uint32)node;
+    }
+
+    // and at the first payload word of its nodes, or where the payloads of the statements after it start
+    for (pyco_uint64 i = parsed_count, data = scratch->data_count; i-- > 0;)
+    {
+        const pyco_uint64 end = i + 1 < parsed_count ? parsed[i + 1].node : scratch->count;
+
+        for (pyco_uint64 node = parsed[i].node; node < end; node++)
         {
-            break;
+            if (scratch->nodes[node].data)
+            {
+                data = scratch->nodes[node].data;
+                break;
+            }
         }
 
-        if (operator == PYCO_OPERATOR_INVALID)
+        parsed[i].data = (pyco_uint32)data;
+    }
+
+    const pyco_uint64 base_node = whole ? 1 : unit->statements[first].node;
+    const pyco_uint64 base_data = whole ? 1 : unit->statements[first].data;
+    const pyco_uint64 end_node = resync < unit->statements_count ? unit->statements[resync].node : unit->flat.count;
+    const pyco_uint64 end_data = resync < unit->statements_count ? unit->statements[resync].data : unit->flat.data_count;
+    const pyco_uint32 node_delta = (pyco_uint32)(scratch->count - 1 - (end_node - base_node));
+    const pyco_uint32 data_delta = (pyco_uint32)(scratch->data_count - 1 - (end_data - base_data));
+    const pyco_uint64 statements_count = first + parsed_count + unit->statements_count - resync;
+
+    if (!_unit_reserve(unit, (void **)&unit->statements, &unit->statements_allocated, sizeof(pyco_unit_statement) * statements_count))
+    {
+        _unit_forget(unit);
+        pyco_ast_free(&ast, ast.root_node);
+        return program;
+    }
+
+    if (whole)
+    {
+        // nothing of the old tree is left, the new one takes its place
+        pyco_flat_ast flat = unit->flat;
+        unit->flat = unit->scratch;
+        unit->scratch = flat;
+    }
+    else
+    {
+        pyco_flat_ast *flat = &unit->flat;
+        const pyco_uint32 nodes_count = flat->count + node_delta;
+        const pyco_uint32 data_count = flat->data_count + data_delta;
+
+        if (!_unit_reserve(unit, (void **)&flat->nodes, &flat->nodes_allocated, sizeof(pyco_flat_node) * nodes_count) ||
+            !_unit_reserve(unit, (void **)&flat->data, &flat->data_allocated, sizeof(pyco_uint64) * data_count))
         {
-            // throw error: invalid operator found "operation"
-            return PYCO_NULL;
+            _unit_forget(unit);
+            pyco_ast_free(&ast, ast.root_node);
+            return program;
         }
 
-        if (operator & PYCO_OPERATOR_ASSIGN_TYPE && (operator & PYCO_OPERATOR_ASSIGN || operator & PYCO_OPERATOR_ASSIGN_CONST))
+        memmove(flat->data + base_data + scratch->data_count - 1, flat->data + end_data, sizeof(pyco_uint64) * (flat->data_count - end_data));
+        memcpy(flat->data + base_data, scratch->data + 1, sizeof(pyco_uint64) * (scratch->data_count - 1));
+        memmove(flat->nodes + base_node + scratch->count - 1, flat->nodes + end_node, sizeof(pyco_flat_node) * (flat->count - end_node));
+        memcpy(flat->nodes + base_node, scratch->nodes + 1, sizeof(pyco_flat_node) * (scratch->count - 1));
+
+        for (pyco_uint64 i = base_node; i < base_node + scratch->count - 1; i++)
         {
-            left_hand_side = _parser_handle_declaration(ast, lexer, left_hand_token);
-            break;
+            _unit_move_node(flat, (pyco_uint32)i, (pyco_uint32)(base_node - 1), (pyco_uint32)(base_data - 1), 0);
         }
 
-        if (left_hand_token->flags & PYCO_TOKEN_TYPE_IDENTIFIER && operator == PYCO_OPERATOR_GROUPING)
+        for (pyco_uint64 i = base_node + scratch->count - 1; i < nodes_count; i++)
         {
-            pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, left_hand_token->value, PYCO_AST_NODE_TYPE_CALL, 0, 0);
+            _unit_move_node(flat, (pyco_uint32)i, node_delta, data_delta, source_delta);
+        }
 
-            lexer_get_next_token(lexer);
+        flat->count = nodes_count;
+        flat->data_count = data_count;
+        flat->nodes[0].size = flat->count;
+    }
 
-            do
-            {
-                const pyco_token *current_token = lexer_get_current_token(lexer);
+    unit->flat.source = unit->source;
 
-                if (current_token == PYCO_NULL || (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->value[0] == ')'))
-                {
-                    break;
-                }
+    pyco_unit_statement *statements = unit->statements;
+    const pyco_uint32 token_delta = (pyco_uint32)(changed_end - old_end_token);
 
-                if (current_token->flags & PYCO_TOKEN_TYPE_SPECIAL && current_token->value[0] == ',')
-                {
-                    lexer_get_next_token(lexer);
-                    continue;
-                }
+    memmove(statements + first + parsed_count, statements + resync, sizeof(pyco_unit_statement) * (unit->statements_count - resync));
 
-                pyco_ast_node *expression = _parse_expression(ast, lexer, flags | PYCO_OPERATOR_FUNCTION_CALL, 0);
-                pyco_ast_node_append(new_left_hand_side, expression);
-            } while (true);
+    for (pyco_uint64 i = first + parsed_count; i < statements_count; i++)
+    {
+        statements[i].token += token_delta;
+        statements[i].node += node_delta;
+        statements[i].data += data_delta;
+    }
 
-            lexer_get_next_token(lexer);
-            pyco_ast_node_append(left_hand_side, new_left_hand_side);
-            left_hand_side = new_left_hand_side;
+    for (pyco_uint64 i = 0; i < parsed_count; i++)
+    {
+        statements[first + i] = (pyco_unit_statement){
+            .token = parsed[i].token,
+            .node = (pyco_uint32)(parsed[i].node + base_node - 1),
+            .data = (pyco_uint32)(parsed[i].data + base_data - 1),
+        };
+    }
 
-            continue;
-        }
+    unit->statements_count = statements_count;
 
-        pyco_uint16 binding_powers = _parser_get_infix_binding_power(operator);
+    if (tracked)
+    {
+        _unit_count(&program, unit, &ast);
+    }
 
-        if (binding_powers)
-        {
-            pyco_uint8 left_binding_power = (binding_powers >> 8) & 0xFF;
-            pyco_uint8 right_binding_power = binding_powers & 0xFF;
+    pyco_ast_free(&ast, ast.root_node);
 
-            if (left_binding_power < minimum_binding_power)
-            {
-                break;
-            }
+    if (tracked)
+    {
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_PARSE, _pyco_clock_nanoseconds() - parse_start);
+    }
 
-            lexer_get_next_token(lexer);
+    if (options->ast_json_path)
+    {
+        pyco_flat_ast_to_json_file(options->ast_json_path, &unit->flat, (const char *)unit->source);
+    }
 
-            possible_operator = _token_to_operator(lexer_get_current_token(lexer));
+    if (options->ast_binary_path)
+    {
+        pyco_flat_ast_to_binary_file(options->ast_binary_path, &unit->flat);
+    }
 
-            if (possible_operator == PYCO_OPERATOR_TERNARY)
-            {
-                pyco_ast_node *middle_hand_side = _parse_expression(ast, lexer, flags, 0);
+    // the code is generated again from the whole tree, it is small next to the tree and takes a fraction of the time
+    const pyco_uint64 codegen_start = tracked ? _pyco_clock_nanoseconds() : 0;
+    pyco_allocation_counters codegen_counters = {0};
 
-                lexer_get_next_token(lexer);
+    _pyco_codegen(&program, &unit->codegen, &unit->flat, unit->symbols, &options->allocators, &codegen_counters);
 
-                pyco_ast_node *right_hand_side = _parse_expression(ast, lexer, flags, right_binding_power);
-                pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, operator_token->value, PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
+    if (tracked)
+    {
+        _pyco_compile_add_counters(&program.stats, codegen_counters, (pyco_allocation_counters){0});
+        _pyco_compile_end_phase(&program, PYCO_COMPILE_PHASE_CODEGEN, _pyco_clock_nanoseconds() - codegen_start);
+    }
 
-                pyco_ast_node_append(new_left_hand_side, left_hand_side);
-                pyco_ast_node_append(new_left_hand_side, middle_hand_side);
-                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+    return program;
+}
 
-                left_hand_side = new_left_hand_side;
-            }
-            else
-            {
-                pyco_ast_node *right_hand_side = _parse_expression(ast, lexer, flags, right_binding_power);
-                pyco_ast_node *new_left_hand_side = pyco_ast_node_create(ast, operator_token->value, PYCO_AST_NODE_TYPE_EXPRESSION, 0, 0);
+pyco_compiled_program pyco_unit_compile(pyco_unit *unit, const pyco_uint8 *data, pyco_uint64 size)
+{
+    return pyco_unit_edit(unit, 0, unit ? unit->source_size : 0, data, size);
+}
 
-                pyco_ast_node_append(new_left_hand_side, left_hand_side);
-                pyco_ast_node_append(new_left_hand_side, right_hand_side);
+void pyco_unit_free(pyco_unit *unit)
+{
+    if (!unit)
+    {
+        return;
+    }
 
-                left_hand_side = new_left_hand_side;
-            }
+    const pyco_allocators *allocators = &unit->options.allocators;
 
-            continue;
-        }
+    lexer_free(unit->lexer);
+    pyco_arena_free(unit->arena);
+    pyco_flat_ast_free(&unit->flat);
+    pyco_flat_ast_free(&unit->scratch);
+    _pyco_codegen_free(&unit->codegen);
 
-        break;
-    } while (true);
+    if (unit->owns_symbols)
+    {
+        pyco_symbol_table_free(unit->symbols);
+    }
 
-    return left_hand_side;
-}
+    if (unit->tokens)
+    {
+        _token_block_free(unit->tokens, allocators);
+    }
 
-bool _parser_handle_file(pyco_ast *ast, pyco_lexer *lexer)
-{
-    if (!(ast->root_node = _parse_scope(ast, lexer)))
+    void *arrays[] = {unit->source, unit->lines, unit->statements, unit->parsed};
+
+    for (pyco_uint32 i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
     {
-        return false;
+        if (arrays[i])
+        {
+            _pyco_free(allocators, arrays[i]);
+        }
     }
 
-    return true;
+    _pyco_free(allocators, unit);
 }
 
-typedef struct build_ast_options
+typedef struct pyco_batch pyco_batch;
+
+// the sources of a worker are the range [begin, end), it takes them from the front and other workers steal from the back
+typedef struct pyco_batch_worker
 {
-    pyco_allocators allocators;
-    bool indent_based;
-} build_ast_options;
+    pyco_batch *batch;
+    pyco_uint32 index;
+    pyco_mutex mutex;
+    pyco_uint32 begin;
+    pyco_uint32 end;
+} pyco_batch_worker;
+
+typedef struct pyco_batch
+{
+    const pyco_source *sources;
+    pyco_compiled_program *programs;
+    pyco_compile_options options;
+    pyco_batch_worker *workers;
+    pyco_uint32 workers_count;
+} pyco_batch;
 
-pyco_ast parser_build_ast(pyco_lexer *lexer, build_ast_options options)
+static inline bool _batch_take(pyco_batch_worker *worker, pyco_uint32 *source)
 {
-    pyco_ast_options tree_options = {
-        .allocators = options.allocators,
-        .buffer_initial_size = 2000,
-        .buffer_increment_size = 2000,
-    };
+    _pyco_mutex_lock(&worker->mutex);
 
-    pyco_ast ast = initialize_tree(tree_options);
+    const bool taken = worker->begin < worker->end;
+
+    if (taken)
+    {
+        *source = worker->begin++;
+    }
 
-    _parser_handle_file(&ast, lexer);
+    _pyco_mutex_unlock(&worker->mutex);
 
-    return ast;
+    return taken;
 }
 
-pyco_compile_options pyco_initialize_compile_options()
+// moves the back half of what another worker has left over to this one, false once every worker is out of sources
+bool _batch_steal(pyco_batch_worker *worker)
 {
-    pyco_compile_options options;
+    pyco_batch *batch = worker->batch;
 
-    options.allocators.malloc = PYCO_NULL;
-    options.allocators.realloc = PYCO_NULL;
-    options.allocators.free = PYCO_NULL;
+    for (pyco_uint32 i = 1; i < batch->workers_count; i++)
+    {
+        pyco_batch_worker *victim = &batch->workers[(worker->index + i) % batch->workers_count];
 
-    options.copy_buffer = 0;
-    options.indent_based = 0;
+        _pyco_mutex_lock(&victim->mutex);
 
-    return options;
+        const pyco_uint32 begin = victim->end - (victim->end - victim->begin) / 2;
+        const pyco_uint32 end = victim->end;
+
+        // a single source left is stolen as well, its worker might be busy with a large one
+        const pyco_uint32 split = begin == end && victim->begin < victim->end ? victim->begin : begin;
+        victim->end = split;
+
+        _pyco_mutex_unlock(&victim->mutex);
+
+        if (split < end)
+        {
+            _pyco_mutex_lock(&worker->mutex);
+            worker->begin = split;
+            worker->end = end;
+            _pyco_mutex_unlock(&worker->mutex);
+
+            return true;
+        }
+    }
+
+    return false;
 }
 
-// MARK: compilation
-pyco_compiled_program pyco_compile(const pyco_uint8 *data, pyco_uint64 size, pyco_compile_options options)
+static void _batch_worker_run(void *argument)
 {
-    pyco_compiled_program program;
+    pyco_batch_worker *worker = argument;
+    pyco_batch *batch = worker->batch;
 
-    program.data = PYCO_NULL;
-    program.size = 0;
-    program.valid = 0;
-    program.errors = 0;
-    program.compile_options = options;
+    // the scripts of a worker are compiled one after the other, so they share one handle
+    pyco_compiler *compiler = pyco_compiler_create(batch->options);
+    pyco_uint32 source;
 
-    pyco_lexer_options lexer_options = lexer_initialize_options();
-    lexer_options.allocators = options.allocators;
+    while (_batch_take(worker, &source) || (_batch_steal(worker) && _batch_take(worker, &source)))
+    {
+        const pyco_source *input = &batch->sources[source];
 
-    pyco_lexer *lexer = lexer_create(lexer_options);
+        batch->programs[source] = compiler ? pyco_compiler_compile(compiler, input->data, input->size) : pyco_compile(input->data, input->size, batch->options);
+    }
 
-    pyco_buffer buffer = {
-        .data = (pyco_uint8 *)data,
-        .size = size,
-    };
+    pyco_compiler_free(compiler);
+}
 
-    lexer_process_buffer(lexer, &buffer);
-    // for debugging purposes, will be removed
-    printf("testing lexer - token count: %lld\n\n", lexer->tokens_count);
+pyco_uint32 pyco_compile_batch(const pyco_source *sources, pyco_uint32 count, pyco_compiled_program *programs, pyco_compile_options options, pyco_uint32 threads_count)
+{
+    if (!options.allocators.malloc || !options.allocators.realloc || !options.allocators.free || (count && (!sources || !programs)))
+    {
+        return false;
+    }
 
-    build_ast_options ast_options = {
-        .indent_based = !!options.indent_based,
-        .allocators = options.allocators,
+    // the workers can not share what is not safe to use from two threads, and would all write the same dumps
+    options.symbols = PYCO_NULL;
+    options.arena = PYCO_NULL;
+    options.ast_json_path = PYCO_NULL;
+    options.ast_binary_path = PYCO_NULL;
+    // the scripts already keep every thread busy
+    options.parse_threads = 0;
+
+    pyco_batch batch = {
+        .sources = sources,
+        .programs = programs,
+        .options = options,
+        .workers_count = threads_count ? threads_count : _pyco_cpu_count(),
     };
 
-    pyco_ast ast = parser_build_ast(lexer, ast_options);
+    if (batch.workers_count > count)
+    {
+        batch.workers_count = count;
+    }
 
-    // for debugging purposes, will be removed
-    pyco_ast_node_to_json_file("tree_output.js", ast.root_node, data);
-    pyco_ast_free(&ast, ast.root_node);
+    if (!batch.workers_count)
+    {
+        return true;
+    }
 
-    lexer_free(lexer);
+    if (!(batch.workers = _pyco_malloc(&options.allocators, sizeof(pyco_batch_worker) * batch.workers_count)))
+    {
+        return false;
+    }
 
-    return program;
+    // every worker starts with an even share of consecutive sources
+    for (pyco_uint32 i = 0; i < batch.workers_count; i++)
+    {
+        pyco_batch_worker *worker = &batch.workers[i];
+
+        worker->batch = &batch;
+        worker->index = i;
+        worker->begin = (pyco_uint32)((pyco_uint64)count * i / batch.workers_count);
+        worker->end = (pyco_uint32)((pyco_uint64)count * (i + 1) / batch.workers_count);
+        _pyco_mutex_init(&worker->mutex);
+    }
+
+    _pyco_run_parallel(_batch_worker_run, batch.workers, sizeof(pyco_batch_worker), batch.workers_count, &options.allocators);
+
+    for (pyco_uint32 i = 0; i < batch.workers_count; i++)
+    {
+        _pyco_mutex_destroy(&batch.workers[i].mutex);
+    }
+
+    _pyco_free(&options.allocators, batch.workers);
+
+    return true;
 }
 
 void pyco_free_compiled_program(pyco_compiled_program *program)
@@ -1837,14 +8279,17 @@ void pyco_free_compiled_program(pyco_compiled_program *program)
         return;
     }
 
-    if (program->compile_options.copy_buffer)
+    // the program is allocated from the allocators of the options, a cache hit included
+    if (program->data)
     {
-        program->compile_options.allocators.free(program->data);
+        _pyco_free(&program->compile_options.allocators, program->data);
     }
 
     program->data = PYCO_NULL;
     program->size = 0;
     program->valid = 0;
     program->errors = 0;
+    program->cached = 0;
+    program->stats = (pyco_compile_stats){0};
     program->compile_options = pyco_initialize_compile_options();
 }
@@ -3,36 +3,117 @@
 
 #define PYCO_NULL 0
 
+#define PYCO_VERSION "0.1.0"
+
 typedef unsigned char pyco_uint8;
 typedef unsigned short pyco_uint16;
 typedef unsigned int pyco_uint32;
 typedef unsigned long long pyco_uint64;
 typedef unsigned long long pyco_flags;
 
-typedef void *(*PYCO_FUNC_MALLOC)(size_t);
-typedef void *(*PYCO_FUNC_REALLOC)(void *, size_t);
-typedef void (*PYCO_FUNC_FREE)(void *);
+// every call gets the context of the allocators, realloc is also told the size the block had so far
+typedef void *(*PYCO_FUNC_MALLOC)(void *context, size_t size);
+typedef void *(*PYCO_FUNC_REALLOC)(void *context, void *pointer, size_t old_size, size_t size);
+typedef void (*PYCO_FUNC_FREE)(void *context, void *pointer);
 
 typedef struct pyco_allocators
 {
     PYCO_FUNC_MALLOC malloc;
     PYCO_FUNC_REALLOC realloc;
     PYCO_FUNC_FREE free;
+    void *context;
 } pyco_allocators;
 
+// malloc, realloc and free of the C library
+pyco_allocators pyco_default_allocators();
+
+// identifiers are interned into dense symbol ids, one table can be shared by many compiles so common names are interned once,
+// the compiles sharing it must not run at the same time
+typedef struct pyco_symbol_table pyco_symbol_table;
+
+pyco_symbol_table *pyco_symbol_table_create(pyco_allocators allocators, pyco_uint32 initial_size);
+
+void pyco_symbol_table_free(pyco_symbol_table *table);
+
+pyco_uint32 pyco_symbol_table_intern(pyco_symbol_table *table, const pyco_uint8 *name, pyco_uint64 length);
+
+const pyco_uint8 *pyco_symbol_table_name(pyco_symbol_table *table, pyco_uint32 symbol, pyco_uint64 *length);
+
+pyco_uint32 pyco_symbol_table_count(pyco_symbol_table *table);
+
+// forgets every name, the memory the table grew to is kept for the next names
+void pyco_symbol_table_reset(pyco_symbol_table *table);
+
+// chained block allocator the syntax tree is built in, an arena reset between compiles is reused without new allocations
+typedef struct pyco_arena pyco_arena;
+
+pyco_arena *pyco_arena_create(pyco_allocators allocators, pyco_uint64 initial_size);
+
+void *pyco_arena_alloc(pyco_arena *arena, pyco_uint64 size);
+
+void pyco_arena_reset(pyco_arena *arena);
+
+void pyco_arena_free(pyco_arena *arena);
+
+// allocators that take their memory from the arena, free does nothing and everything goes away with the arena
+pyco_allocators pyco_arena_allocators(pyco_arena *arena);
+
+enum PYCO_COMPILE_PHASE
+{
+    PYCO_COMPILE_PHASE_LEX,
+    PYCO_COMPILE_PHASE_PARSE, // building the tree and flattening it. with a token window the lexing happens here as well
+    PYCO_COMPILE_PHASE_CODEGEN,
+    PYCO_COMPILE_PHASE_COUNT,
+};
+
+typedef struct pyco_compile_stats
+{
+    pyco_uint64 phase_nanoseconds[PYCO_COMPILE_PHASE_COUNT]; // wall time
+    pyco_uint64 tokens_count;
+    pyco_uint64 nodes_count;
+    pyco_uint64 symbols_count;
+    pyco_uint64 bytes_allocated; // requested from the allocators by this compile, freed memory included
+    pyco_uint64 realloc_calls;
+    pyco_uint64 arena_peak; // bytes in use in the tree arena when parsing ends
+} pyco_compile_stats;
+
+// called when a phase ends, with the stats gathered up to that point
+typedef void (*PYCO_FUNC_PHASE_CALLBACK)(void *user_data, pyco_uint32 phase, const pyco_compile_stats *stats);
+
 typedef struct pyco_compile_options
 {
     pyco_allocators allocators;
-    pyco_uint32 copy_buffer;
+    pyco_uint32 copy_buffer; // 0 when the source outlives the compile, tokens then point into it without copying
     pyco_uint32 indent_based;
+    pyco_uint32 token_window; // 0 lexes the whole script before parsing, otherwise tokens are lexed on demand into a ring of this many slots
+    pyco_symbol_table *symbols; // shared table the identifiers are interned into, when PYCO_NULL every compile uses its own
+    pyco_arena *arena; // arena the syntax tree is allocated from, reset by the caller between compiles. when PYCO_NULL every compile uses its own
+    pyco_uint32 collect_stats; // fills pyco_compiled_program.stats, also implied by a phase callback
+    PYCO_FUNC_PHASE_CALLBACK phase_callback;
+    void *phase_callback_data;
+    const char *ast_json_path; // debug dumps of the syntax tree, nothing is written when PYCO_NULL
+    const char *ast_binary_path;
+    // the whole compile allocates from one region taken from the allocators and released at the end in one go,
+    // linear_initial_size is the size of its first block, 0 picks one from the script size
+    pyco_uint32 linear_allocation;
+    pyco_uint64 linear_initial_size;
+    // the top-level declarations of large scripts are parsed on this many threads, 0 and 1 parse on the calling thread.
+    // the allocators are then called from all of them at once. not used with a token window or linear allocation
+    pyco_uint32 parse_threads;
+    // directory of the compile cache, shared safely by any number of processes. a script compiled before with the same
+    // compiler version and options is loaded from it without lexing or parsing. pyco_compile, compiler handles and batches
+    // use it, but not while writing dumps. the directory has to exist, PYCO_NULL compiles every time
+    const char *cache_directory;
 } pyco_compile_options;
 
 typedef struct pyco_compiled_program
 {
-    pyco_uint8 *data;
+    pyco_uint8 *data; // the bytecode laid out in pyco_bytecode.h, PYCO_NULL when the script has errors
     pyco_uint64 size;
     pyco_uint32 valid;
-    pyco_uint32 errors;
+    pyco_uint32 errors; // statements the code generator could not lower, the parser recovers from its errors silently
+    pyco_uint32 cached; // loaded from the compile cache, the stats are then all zero
+    pyco_compile_stats stats; // zero unless stats were requested
 
     pyco_compile_options compile_options;
 } pyco_compiled_program;
@@ -41,6 +122,55 @@ pyco_compile_options pyco_initialize_compile_options();
 
 pyco_compiled_program pyco_compile(const pyco_uint8 *data, pyco_uint64 size, pyco_compile_options options);
 
+// push-style compile for scripts that arrive in chunks, the chunks are copied and do not need to outlive the push
+typedef struct pyco_compile_stream pyco_compile_stream;
+
+pyco_compile_stream *pyco_compile_stream_begin(pyco_compile_options options);
+
+pyco_uint32 pyco_compile_stream_push(pyco_compile_stream *stream, const pyco_uint8 *data, pyco_uint64 size);
+
+pyco_compiled_program pyco_compile_stream_finish(pyco_compile_stream *stream);
+
+// long-lived compiler for many scripts in a row. its token blocks, tree arena, symbol table and flat tree are
+// reset by every compile instead of freed, so once they have grown to the size of the scripts compiling allocates
+// next to nothing. the options are fixed when it is created, linear_allocation does not apply to it
+typedef struct pyco_compiler pyco_compiler;
+
+pyco_compiler *pyco_compiler_create(pyco_compile_options options);
+
+pyco_compiled_program pyco_compiler_compile(pyco_compiler *compiler, const pyco_uint8 *data, pyco_uint64 size);
+
+void pyco_compiler_free(pyco_compiler *compiler);
+
+// a script kept compiled across edits, for editors that recompile on every keystroke. an edit lexes again from the
+// line it starts on until the tokens match up with the old ones, and parses again the top-level statements those
+// tokens are in, the rest of the tokens and of the tree is kept and moved along. the unit keeps its own copy of the
+// source and all of its tokens, token_window, linear_allocation and parse_threads do not apply to it.
+// the stats of an edit count the tokens it lexed and the nodes it built
+typedef struct pyco_unit pyco_unit;
+
+pyco_unit *pyco_unit_create(pyco_compile_options options);
+
+// replaces the whole source of the unit
+pyco_compiled_program pyco_unit_compile(pyco_unit *unit, const pyco_uint8 *data, pyco_uint64 size);
+
+// replaces removed_size bytes at offset with text, offsets are into the source as it was before the edit
+pyco_compiled_program pyco_unit_edit(pyco_unit *unit, pyco_uint64 offset, pyco_uint64 removed_size, const pyco_uint8 *text, pyco_uint64 text_size);
+
+void pyco_unit_free(pyco_unit *unit);
+
+typedef struct pyco_source
+{
+    const pyco_uint8 *data;
+    pyco_uint64 size;
+} pyco_source;
+
+// compiles the sources on threads_count threads, 0 starts one per core, and puts the program of sources[i] into programs[i]
+// whichever thread compiled it. a thread that runs out of sources takes some from another one, so a large script does not
+// hold up the ones queued behind it. the threads do not share the symbol table and arena of the options and write no dumps,
+// the allocators and the phase callback are called from all of them at once
+pyco_uint32 pyco_compile_batch(const pyco_source *sources, pyco_uint32 count, pyco_compiled_program *programs, pyco_compile_options options, pyco_uint32 threads_count);
+
 void pyco_free_compiled_program(pyco_compiled_program *program);
 
 #endif
\ No newline at end of file
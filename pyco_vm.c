@@ -0,0 +1,1124 @@
+#ifndef PYCO_VM_INTERPRETER
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pyco_vm.h"
+
+// MARK: VM
+
+#define PYCO_VM_DEFAULT_STACK_SIZE 65536
+#define PYCO_VM_DEFAULT_FRAMES_SIZE 1024
+
+// where a call returns to, the callee's registers start right after the register of the callee itself
+typedef struct pyco_vm_frame
+{
+    const pyco_uint32 *ip;
+    pyco_value *base;
+} pyco_vm_frame;
+
+struct pyco_vm
+{
+    pyco_vm_options options;
+
+    const pyco_uint8 *program;
+    const pyco_bytecode_header *header;
+    const pyco_bytecode_function *functions;
+    const pyco_bytecode_global *globals_table;
+    const pyco_bytecode_struct *structs;
+    const pyco_bytecode_field *fields;
+    const pyco_uint32 *code;
+    const pyco_uint8 *names;
+    pyco_value *constants;
+    pyco_value *globals;
+
+    pyco_value *stack;
+    pyco_value *stack_end;
+    pyco_vm_frame *frames;
+    pyco_vm_frame *frames_end;
+
+    pyco_array *arrays;
+    pyco_object *objects;
+};
+
+static inline void *_vm_malloc(const pyco_vm *vm, pyco_uint64 size)
+{
+    return vm->options.allocators.malloc(vm->options.allocators.context, size);
+}
+
+static inline void _vm_free(const pyco_vm *vm, void *pointer)
+{
+    if (pointer)
+    {
+        vm->options.allocators.free(vm->options.allocators.context, pointer);
+    }
+}
+
+static void *_vm_default_malloc(void *context, size_t size)
+{
+    return malloc(size);
+}
+
+static void *_vm_default_realloc(void *context, void *pointer, size_t old_size, size_t size)
+{
+    return realloc(pointer, size);
+}
+
+static void _vm_default_free(void *context, void *pointer)
+{
+    free(pointer);
+}
+
+static inline bool _vm_truthy(const pyco_value *value)
+{
+    return value->type != PYCO_VALUE_NIL && !(value->type == PYCO_VALUE_INTEGER && value->as.integer == 0);
+}
+
+static inline bool _vm_number(const pyco_value *value, double *number)
+{
+    if (value->type == PYCO_VALUE_INTEGER)
+    {
+        *number = (double)value->as.integer;
+        return true;
+    }
+
+    *number = value->as.real;
+
+    return value->type == PYCO_VALUE_REAL;
+}
+
+static bool _vm_equal(const pyco_value *a, const pyco_value *b)
+{
+    double x;
+    double y;
+
+    if (a->type != b->type)
+    {
+        // 1 == 1.0
+        return _vm_number(a, &x) && _vm_number(b, &y) && x == y;
+    }
+
+    switch (a->type)
+    {
+    case PYCO_VALUE_NIL:
+        return true;
+    case PYCO_VALUE_INTEGER:
+        return a->as.integer == b->as.integer;
+    case PYCO_VALUE_REAL:
+        return a->as.real == b->as.real;
+    case PYCO_VALUE_STRING:
+        return a->length == b->length && memcmp(a->as.string, b->as.string, a->length) == 0;
+    case PYCO_VALUE_FUNCTION:
+    case PYCO_VALUE_STRUCT:
+        return a->as.index == b->as.index;
+    }
+
+    // arrays, objects and natives are the same when they are the same one
+    return a->as.array == b->as.array;
+}
+
+// an array of sizes[0] elements, each an array over the remaining sizes. the innermost elements start as 0
+static pyco_array *_vm_new_array(pyco_vm *vm, const pyco_value *sizes, pyco_uint32 dimensions, pyco_uint32 *status)
+{
+    if (sizes->type != PYCO_VALUE_INTEGER || sizes->as.integer < 0)
+    {
+        *status = PYCO_VM_TYPE_ERROR;
+        return PYCO_NULL;
+    }
+
+    const pyco_uint64 count = (pyco_uint64)sizes->as.integer;
+
+    if (count > (~0ull - sizeof(pyco_array)) / sizeof(pyco_value))
+    {
+        *status = PYCO_VM_OUT_OF_MEMORY;
+        return PYCO_NULL;
+    }
+
+    pyco_array *array = _vm_malloc(vm, sizeof(pyco_array) + sizeof(pyco_value) * count);
+
+    if (!array)
+    {
+        *status = PYCO_VM_OUT_OF_MEMORY;
+        return PYCO_NULL;
+    }
+
+    array->next = vm->arrays;
+    array->count = count;
+    vm->arrays = array;
+
+    for (pyco_uint64 i = 0; i < count; i++)
+    {
+        array->elements[i] = (pyco_value){.type = PYCO_VALUE_INTEGER};
+
+        if (dimensions > 1)
+        {
+            pyco_array *element = _vm_new_array(vm, sizes + 1, dimensions - 1, status);
+
+            if (!element)
+            {
+                return PYCO_NULL;
+            }
+
+            array->elements[i] = (pyco_value){.type = PYCO_VALUE_ARRAY, .as.array = element};
+        }
+    }
+
+    return array;
+}
+
+// the arguments fill the fields in order, the others start as 0
+static pyco_object *_vm_new_object(pyco_vm *vm, pyco_uint32 type, const pyco_value *arguments, pyco_uint32 arguments_count)
+{
+    const pyco_uint32 count = vm->structs[type].fields_count;
+    pyco_object *object = _vm_malloc(vm, sizeof(pyco_object) + sizeof(pyco_value) * count);
+
+    if (!object)
+    {
+        return PYCO_NULL;
+    }
+
+    object->next = vm->objects;
+    object->type = type;
+    object->count = count;
+    vm->objects = object;
+
+    for (pyco_uint32 i = 0; i < count; i++)
+    {
+        object->fields[i] = i < arguments_count ? arguments[i] : (pyco_value){.type = PYCO_VALUE_INTEGER};
+    }
+
+    return object;
+}
+
+// the slot of the field named by key, PYCO_NULL when the struct has no such field
+static pyco_value *_vm_field(pyco_vm *vm, pyco_object *object, const pyco_value *key)
+{
+    const pyco_bytecode_field *fields = vm->fields + vm->structs[object->type].fields;
+
+    for (pyco_uint32 i = 0; i < object->count; i++)
+    {
+        if (fields[i].name_length == key->length && memcmp(vm->names + fields[i].name, key->as.string, key->length) == 0)
+        {
+            return &object->fields[i];
+        }
+    }
+
+    return PYCO_NULL;
+}
+
+// the element R[B][R[C]] reads and R[A][R[B]] writes
+static pyco_value *_vm_element(pyco_vm *vm, const pyco_value *container, const pyco_value *key, pyco_uint32 *status)
+{
+    if (container->type == PYCO_VALUE_ARRAY && key->type == PYCO_VALUE_INTEGER)
+    {
+        if ((pyco_uint64)key->as.integer >= container->as.array->count)
+        {
+            *status = PYCO_VM_INDEX_OUT_OF_RANGE;
+            return PYCO_NULL;
+        }
+
+        return &container->as.array->elements[key->as.integer];
+    }
+
+    pyco_value *field = PYCO_NULL;
+
+    if (container->type == PYCO_VALUE_OBJECT && key->type == PYCO_VALUE_STRING)
+    {
+        field = _vm_field(vm, container->as.object, key);
+    }
+
+    if (!field)
+    {
+        *status = PYCO_VM_TYPE_ERROR;
+    }
+
+    return field;
+}
+
+// the interpreter loop is compiled from the end of this file once for every dispatch mode
+#define PYCO_VM_INTERPRETER _vm_run_switch
+#define PYCO_VM_THREADED 0
+#include __FILE__
+#undef PYCO_VM_INTERPRETER
+#undef PYCO_VM_THREADED
+
+#if PYCO_VM_COMPUTED_GOTO
+#define PYCO_VM_INTERPRETER _vm_run_threaded
+#define PYCO_VM_THREADED 1
+#include __FILE__
+#undef PYCO_VM_INTERPRETER
+#undef PYCO_VM_THREADED
+#endif
+
+// MARK: loading
+
+static inline bool _vm_section(const pyco_bytecode_header *header, pyco_uint32 offset, pyco_uint64 count, pyco_uint64 element_size)
+{
+    return offset % 8 == 0 && offset <= header->size && count <= (header->size - offset) / element_size;
+}
+
+static inline bool _vm_name(const pyco_bytecode_header *header, pyco_uint64 name, pyco_uint64 length)
+{
+    return name <= header->names_size && length <= header->names_size - name;
+}
+
+// every register, index and jump of the function in range, and no way to run past its last instruction
+static bool _vm_verify_function(const pyco_vm *vm, const pyco_bytecode_function *function)
+{
+    const pyco_bytecode_header *header = vm->header;
+    const pyco_uint32 *code = vm->code + function->code;
+    const pyco_uint32 registers = function->registers;
+
+    if (!function->code_count || function->arity > registers)
+    {
+        return false;
+    }
+
+    for (pyco_uint32 i = 0; i < function->code_count; i++)
+    {
+        const pyco_uint32 instruction = code[i];
+        const pyco_uint32 a = PYCO_INSTRUCTION_A(instruction);
+        const pyco_uint32 b = PYCO_INSTRUCTION_B(instruction);
+        const pyco_uint32 c = PYCO_INSTRUCTION_C(instruction);
+        const pyco_uint32 bx = PYCO_INSTRUCTION_BX(instruction);
+        const long long target = (long long)i + 1 + PYCO_INSTRUCTION_SBX(instruction);
+        bool valid;
+
+        switch (PYCO_INSTRUCTION_OP(instruction))
+        {
+        case PYCO_OP_NOP:
+            valid = true;
+            break;
+        case PYCO_OP_LOAD_NIL:
+        case PYCO_OP_LOAD_INT:
+            valid = a < registers;
+            break;
+        case PYCO_OP_LOAD_CONST:
+            valid = a < registers && bx < header->constants_count;
+            break;
+        case PYCO_OP_LOAD_FUNCTION:
+            valid = a < registers && bx < header->functions_count;
+            break;
+        case PYCO_OP_LOAD_STRUCT:
+            valid = a < registers && bx < header->structs_count;
+            break;
+        case PYCO_OP_GET_GLOBAL:
+        case PYCO_OP_SET_GLOBAL:
+            valid = a < registers && bx < header->globals_count;
+            break;
+        case PYCO_OP_MOVE:
+        case PYCO_OP_ADD_INT:
+        case PYCO_OP_NOT:
+        case PYCO_OP_BITWISE_NOT:
+            valid = a < registers && b < registers;
+            break;
+        case PYCO_OP_ADD:
+        case PYCO_OP_SUBTRACT:
+        case PYCO_OP_MULTIPLY:
+        case PYCO_OP_DIVIDE:
+        case PYCO_OP_EQUAL:
+        case PYCO_OP_LESS:
+        case PYCO_OP_LESS_EQUAL:
+        case PYCO_OP_GET_INDEX:
+        case PYCO_OP_SET_INDEX:
+            valid = a < registers && b < registers && c < registers;
+            break;
+        case PYCO_OP_JUMP:
+            valid = target >= 0 && target < function->code_count;
+            break;
+        case PYCO_OP_JUMP_IF:
+        case PYCO_OP_JUMP_IF_NOT:
+            valid = a < registers && target >= 0 && target < function->code_count;
+            break;
+        case PYCO_OP_NEW_ARRAY:
+            valid = a < registers && c > 0 && b + c <= registers;
+            break;
+        case PYCO_OP_CALL:
+            valid = a + b < registers;
+            break;
+        case PYCO_OP_RETURN:
+            valid = !b || a < registers;
+            break;
+        default:
+            valid = false;
+            break;
+        }
+
+        if (!valid)
+        {
+            return false;
+        }
+    }
+
+    const pyco_uint32 last = PYCO_INSTRUCTION_OP(code[function->code_count - 1]);
+
+    return last == PYCO_OP_RETURN || last == PYCO_OP_JUMP;
+}
+
+static bool _vm_verify(pyco_vm *vm, const pyco_uint8 *data, pyco_uint64 size)
+{
+    const pyco_bytecode_header *header = (const pyco_bytecode_header *)data;
+
+    // the sections are read in place, with the alignment the compiler gave them
+    if (!data || (size_t)data % 8 || size < sizeof(pyco_bytecode_header) || header->magic != PYCO_BYTECODE_MAGIC ||
+        header->version != PYCO_BYTECODE_VERSION || header->size != size)
+    {
+        return false;
+    }
+
+    if (!header->functions_count || header->globals_count > 0x10000 || header->constants_count > 0x10000 ||
+        !_vm_section(header, header->constants, header->constants_count, sizeof(pyco_bytecode_constant)) ||
+        !_vm_section(header, header->functions, header->functions_count, sizeof(pyco_bytecode_function)) ||
+        !_vm_section(header, header->globals, header->globals_count, sizeof(pyco_bytecode_global)) ||
+        !_vm_section(header, header->structs, header->structs_count, sizeof(pyco_bytecode_struct)) ||
+        !_vm_section(header, header->fields, header->fields_count, sizeof(pyco_bytecode_field)) ||
+        !_vm_section(header, header->code, header->code_count, sizeof(pyco_uint32)) ||
+        header->names > header->size || header->names_size > header->size - header->names)
+    {
+        return false;
+    }
+
+    vm->header = header;
+    vm->functions = (const pyco_bytecode_function *)(data + header->functions);
+    vm->globals_table = (const pyco_bytecode_global *)(data + header->globals);
+    vm->structs = (const pyco_bytecode_struct *)(data + header->structs);
+    vm->fields = (const pyco_bytecode_field *)(data + header->fields);
+    vm->code = (const pyco_uint32 *)(data + header->code);
+    vm->names = data + header->names;
+
+    const pyco_bytecode_constant *constants = (const pyco_bytecode_constant *)(data + header->constants);
+
+    for (pyco_uint32 i = 0; i < header->constants_count; i++)
+    {
+        if (constants[i].type > PYCO_CONSTANT_STRING ||
+            (constants[i].type == PYCO_CONSTANT_STRING && !_vm_name(header, constants[i].value.string, constants[i].length)))
+        {
+            return false;
+        }
+    }
+
+    for (pyco_uint32 i = 0; i < header->globals_count; i++)
+    {
+        const pyco_bytecode_global *global = &vm->globals_table[i];
+
+        if (global->kind > PYCO_GLOBAL_EXTERN || !_vm_name(header, global->name, global->name_length) ||
+            (global->kind == PYCO_GLOBAL_FUNCTION && global->index >= header->functions_count) ||
+            (global->kind == PYCO_GLOBAL_STRUCT && global->index >= header->structs_count))
+        {
+            return false;
+        }
+    }
+
+    for (pyco_uint32 i = 0; i < header->structs_count; i++)
+    {
+        if (vm->structs[i].fields > header->fields_count || vm->structs[i].fields_count > header->fields_count - vm->structs[i].fields)
+        {
+            return false;
+        }
+    }
+
+    for (pyco_uint32 i = 0; i < header->fields_count; i++)
+    {
+        if (!_vm_name(header, vm->fields[i].name, vm->fields[i].name_length))
+        {
+            return false;
+        }
+    }
+
+    for (pyco_uint32 i = 0; i < header->functions_count; i++)
+    {
+        const pyco_bytecode_function *function = &vm->functions[i];
+
+        if (function->code > header->code_count || function->code_count > header->code_count - function->code || !_vm_verify_function(vm, function))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// sets the first count values of the stack to nil
+static void _vm_clear_stack(pyco_vm *vm, pyco_uint64 count)
+{
+    for (pyco_value *value = vm->stack; value < vm->stack + count; value++)
+    {
+        *value = (pyco_value){PYCO_VALUE_NIL};
+    }
+}
+
+// MARK: API
+
+pyco_vm_options pyco_vm_initialize_options()
+{
+    return (pyco_vm_options){
+        .allocators = {
+            .malloc = _vm_default_malloc,
+            .realloc = _vm_default_realloc,
+            .free = _vm_default_free,
+        },
+        .stack_size = PYCO_VM_DEFAULT_STACK_SIZE,
+        .frames_size = PYCO_VM_DEFAULT_FRAMES_SIZE,
+        .dispatch = PYCO_VM_DISPATCH_DEFAULT,
+    };
+}
+
+pyco_vm *pyco_vm_create(pyco_vm_options options)
+{
+    if (!options.allocators.malloc || !options.allocators.free)
+    {
+        return PYCO_NULL;
+    }
+
+    pyco_vm *vm = options.allocators.malloc(options.allocators.context, sizeof(pyco_vm));
+
+    if (!vm)
+    {
+        return PYCO_NULL;
+    }
+
+    *vm = (pyco_vm){.options = options};
+    vm->options.stack_size = options.stack_size ? options.stack_size : PYCO_VM_DEFAULT_STACK_SIZE;
+    vm->options.frames_size = options.frames_size ? options.frames_size : PYCO_VM_DEFAULT_FRAMES_SIZE;
+    vm->stack = _vm_malloc(vm, sizeof(pyco_value) * vm->options.stack_size);
+    vm->frames = _vm_malloc(vm, sizeof(pyco_vm_frame) * vm->options.frames_size);
+
+    if (!vm->stack || !vm->frames)
+    {
+        pyco_vm_free(vm);
+        return PYCO_NULL;
+    }
+
+    vm->stack_end = vm->stack + vm->options.stack_size;
+    vm->frames_end = vm->frames + vm->options.frames_size;
+    _vm_clear_stack(vm, vm->options.stack_size);
+
+    return vm;
+}
+
+pyco_uint32 pyco_vm_load(pyco_vm *vm, const pyco_uint8 *data, pyco_uint64 size)
+{
+    if (!vm)
+    {
+        return PYCO_VM_INVALID_PROGRAM;
+    }
+
+    pyco_vm_reset(vm);
+    _vm_free(vm, vm->constants);
+    _vm_free(vm, vm->globals);
+    vm->constants = PYCO_NULL;
+    vm->globals = PYCO_NULL;
+    vm->program = PYCO_NULL;
+
+    if (!_vm_verify(vm, data, size))
+    {
+        return PYCO_VM_INVALID_PROGRAM;
+    }
+
+    const pyco_bytecode_header *header = vm->header;
+
+    // one more than needed, so an empty section is not a zero sized allocation
+    vm->constants = _vm_malloc(vm, sizeof(pyco_value) * (header->constants_count + 1));
+    vm->globals = _vm_malloc(vm, sizeof(pyco_value) * (header->globals_count + 1));
+
+    if (!vm->constants || !vm->globals)
+    {
+        return PYCO_VM_INVALID_PROGRAM;
+    }
+
+    const pyco_bytecode_constant *constants = (const pyco_bytecode_constant *)(data + header->constants);
+
+    for (pyco_uint32 i = 0; i < header->constants_count; i++)
+    {
+        switch (constants[i].type)
+        {
+        case PYCO_CONSTANT_INTEGER:
+            vm->constants[i] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = (long long)constants[i].value.integer};
+            break;
+        case PYCO_CONSTANT_REAL:
+            vm->constants[i] = (pyco_value){.type = PYCO_VALUE_REAL, .as.real = constants[i].value.real};
+            break;
+        case PYCO_CONSTANT_STRING:
+            vm->constants[i] = (pyco_value){.type = PYCO_VALUE_STRING, .length = constants[i].length, .as.string = vm->names + constants[i].value.string};
+            break;
+        }
+    }
+
+    for (pyco_uint32 i = 0; i < header->globals_count; i++)
+    {
+        vm->globals[i] = (pyco_value){PYCO_VALUE_NIL};
+    }
+
+    vm->program = data;
+
+    return PYCO_VM_OK;
+}
+
+pyco_uint32 pyco_vm_set_global(pyco_vm *vm, const char *name, pyco_value value)
+{
+    if (!vm || !vm->program)
+    {
+        return false;
+    }
+
+    const pyco_uint64 length = strlen(name);
+
+    for (pyco_uint32 i = 0; i < vm->header->globals_count; i++)
+    {
+        const pyco_bytecode_global *global = &vm->globals_table[i];
+
+        if (global->kind == PYCO_GLOBAL_EXTERN && global->name_length == length && memcmp(vm->names + global->name, name, length) == 0)
+        {
+            vm->globals[i] = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+pyco_value pyco_vm_native(const pyco_native *native)
+{
+    return (pyco_value){.type = PYCO_VALUE_NATIVE, .as.native = native};
+}
+
+pyco_uint32 pyco_vm_run(pyco_vm *vm, pyco_value *result)
+{
+    pyco_value returned = {PYCO_VALUE_NIL};
+
+    if (result)
+    {
+        *result = returned;
+    }
+
+    if (!vm || !vm->program)
+    {
+        return PYCO_VM_INVALID_PROGRAM;
+    }
+
+    pyco_vm_reset(vm);
+
+    // the externs the host set are kept
+    for (pyco_uint32 i = 0; i < vm->header->globals_count; i++)
+    {
+        const pyco_bytecode_global *global = &vm->globals_table[i];
+
+        switch (global->kind)
+        {
+        case PYCO_GLOBAL_VARIABLE:
+            vm->globals[i] = (pyco_value){PYCO_VALUE_NIL};
+            break;
+        case PYCO_GLOBAL_FUNCTION:
+            vm->globals[i] = (pyco_value){.type = PYCO_VALUE_FUNCTION, .as.index = global->index};
+            break;
+        case PYCO_GLOBAL_STRUCT:
+            vm->globals[i] = (pyco_value){.type = PYCO_VALUE_STRUCT, .as.index = global->index};
+            break;
+        }
+    }
+
+    if (vm->functions[0].registers > vm->options.stack_size)
+    {
+        return PYCO_VM_STACK_OVERFLOW;
+    }
+
+    // a register the code reads before writing holds nil, never what an earlier run left in it. the registers
+    // of every call are cleared by CALL
+    _vm_clear_stack(vm, vm->functions[0].registers);
+
+    pyco_uint32 status;
+
+#if PYCO_VM_COMPUTED_GOTO
+    if (vm->options.dispatch != PYCO_VM_DISPATCH_SWITCH)
+    {
+        status = _vm_run_threaded(vm, &returned);
+    }
+    else
+#endif
+    {
+        status = _vm_run_switch(vm, &returned);
+    }
+
+    if (result)
+    {
+        *result = returned;
+    }
+
+    return status;
+}
+
+void pyco_vm_reset(pyco_vm *vm)
+{
+    if (!vm)
+    {
+        return;
+    }
+
+    while (vm->arrays)
+    {
+        pyco_array *next = vm->arrays->next;
+        _vm_free(vm, vm->arrays);
+        vm->arrays = next;
+    }
+
+    while (vm->objects)
+    {
+        pyco_object *next = vm->objects->next;
+        _vm_free(vm, vm->objects);
+        vm->objects = next;
+    }
+}
+
+void pyco_vm_free(pyco_vm *vm)
+{
+    if (!vm)
+    {
+        return;
+    }
+
+    pyco_vm_reset(vm);
+    _vm_free(vm, vm->constants);
+    _vm_free(vm, vm->globals);
+    _vm_free(vm, vm->stack);
+    _vm_free(vm, vm->frames);
+    _vm_free(vm, vm);
+}
+
+#else
+
+// MARK: interpreter
+
+// R[A] = R[B] op R[C], integers wrap around and an integer with a real gives a real
+#define PYCO_VM_ARITHMETIC(operator)                                                                                   \
+    {                                                                                                                  \
+        const pyco_value *left = &base[PYCO_INSTRUCTION_B(instruction)];                                               \
+        const pyco_value *right = &base[PYCO_INSTRUCTION_C(instruction)];                                              \
+        double x;                                                                                                      \
+        double y;                                                                                                      \
+                                                                                                                       \
+        if (left->type == PYCO_VALUE_INTEGER && right->type == PYCO_VALUE_INTEGER)                                     \
+        {                                                                                                              \
+            const unsigned long long value = (unsigned long long)left->as.integer operator(unsigned long long) right->as.integer; \
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = (long long)value}; \
+        }                                                                                                              \
+        else if (_vm_number(left, &x) && _vm_number(right, &y))                                                        \
+        {                                                                                                              \
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_REAL, .as.real = x operator y};    \
+        }                                                                                                              \
+        else                                                                                                           \
+        {                                                                                                              \
+            PYCO_VM_FAIL(PYCO_VM_TYPE_ERROR);                                                                          \
+        }                                                                                                              \
+                                                                                                                       \
+        PYCO_VM_NEXT();                                                                                                \
+    }
+
+#define PYCO_VM_COMPARE(operator)                                                                                      \
+    {                                                                                                                  \
+        const pyco_value *left = &base[PYCO_INSTRUCTION_B(instruction)];                                               \
+        const pyco_value *right = &base[PYCO_INSTRUCTION_C(instruction)];                                              \
+        double x;                                                                                                      \
+        double y;                                                                                                      \
+        bool value;                                                                                                    \
+                                                                                                                       \
+        if (left->type == PYCO_VALUE_INTEGER && right->type == PYCO_VALUE_INTEGER)                                     \
+        {                                                                                                              \
+            value = left->as.integer operator right->as.integer;                                                       \
+        }                                                                                                              \
+        else if (_vm_number(left, &x) && _vm_number(right, &y))                                                        \
+        {                                                                                                              \
+            value = x operator y;                                                                                      \
+        }                                                                                                              \
+        else                                                                                                           \
+        {                                                                                                              \
+            PYCO_VM_FAIL(PYCO_VM_TYPE_ERROR);                                                                          \
+        }                                                                                                              \
+                                                                                                                       \
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = value};         \
+        PYCO_VM_NEXT();                                                                                                \
+    }
+
+#define PYCO_VM_FAIL(error)                                                                                            \
+    {                                                                                                                  \
+        status = error;                                                                                                \
+        goto done;                                                                                                     \
+    }
+
+#if PYCO_VM_THREADED
+// every handler ends in a jump of its own, so the branch predictor learns which instruction tends to follow which
+#define PYCO_VM_CASE(op) op_##op:
+#define PYCO_VM_NEXT()                                                                                                 \
+    {                                                                                                                  \
+        instruction = *ip++;                                                                                           \
+        goto *labels[PYCO_INSTRUCTION_OP(instruction)];                                                                \
+    }
+#else
+#define PYCO_VM_CASE(op) case op:
+#define PYCO_VM_NEXT() goto dispatch
+#endif
+
+// runs function 0, the registers of a call start right after the register of the callee and the arguments are
+// already in place there, so calling copies nothing and returning writes the result over the callee
+static pyco_uint32 PYCO_VM_INTERPRETER(pyco_vm *vm, pyco_value *result)
+{
+#if PYCO_VM_THREADED
+    static const void *labels[PYCO_OP_COUNT] = {
+        [PYCO_OP_NOP] = &&op_PYCO_OP_NOP,
+        [PYCO_OP_MOVE] = &&op_PYCO_OP_MOVE,
+        [PYCO_OP_LOAD_NIL] = &&op_PYCO_OP_LOAD_NIL,
+        [PYCO_OP_LOAD_INT] = &&op_PYCO_OP_LOAD_INT,
+        [PYCO_OP_LOAD_CONST] = &&op_PYCO_OP_LOAD_CONST,
+        [PYCO_OP_LOAD_FUNCTION] = &&op_PYCO_OP_LOAD_FUNCTION,
+        [PYCO_OP_LOAD_STRUCT] = &&op_PYCO_OP_LOAD_STRUCT,
+        [PYCO_OP_GET_GLOBAL] = &&op_PYCO_OP_GET_GLOBAL,
+        [PYCO_OP_SET_GLOBAL] = &&op_PYCO_OP_SET_GLOBAL,
+        [PYCO_OP_ADD] = &&op_PYCO_OP_ADD,
+        [PYCO_OP_SUBTRACT] = &&op_PYCO_OP_SUBTRACT,
+        [PYCO_OP_MULTIPLY] = &&op_PYCO_OP_MULTIPLY,
+        [PYCO_OP_DIVIDE] = &&op_PYCO_OP_DIVIDE,
+        [PYCO_OP_ADD_INT] = &&op_PYCO_OP_ADD_INT,
+        [PYCO_OP_EQUAL] = &&op_PYCO_OP_EQUAL,
+        [PYCO_OP_LESS] = &&op_PYCO_OP_LESS,
+        [PYCO_OP_LESS_EQUAL] = &&op_PYCO_OP_LESS_EQUAL,
+        [PYCO_OP_NOT] = &&op_PYCO_OP_NOT,
+        [PYCO_OP_BITWISE_NOT] = &&op_PYCO_OP_BITWISE_NOT,
+        [PYCO_OP_JUMP] = &&op_PYCO_OP_JUMP,
+        [PYCO_OP_JUMP_IF] = &&op_PYCO_OP_JUMP_IF,
+        [PYCO_OP_JUMP_IF_NOT] = &&op_PYCO_OP_JUMP_IF_NOT,
+        [PYCO_OP_NEW_ARRAY] = &&op_PYCO_OP_NEW_ARRAY,
+        [PYCO_OP_GET_INDEX] = &&op_PYCO_OP_GET_INDEX,
+        [PYCO_OP_SET_INDEX] = &&op_PYCO_OP_SET_INDEX,
+        [PYCO_OP_CALL] = &&op_PYCO_OP_CALL,
+        [PYCO_OP_RETURN] = &&op_PYCO_OP_RETURN,
+    };
+#endif
+
+    const pyco_uint32 *code = vm->code;
+    const pyco_value *constants = vm->constants;
+    pyco_value *globals = vm->globals;
+    pyco_vm_frame *frame = vm->frames;
+    pyco_value *base = vm->stack;
+    const pyco_uint32 *ip = code + vm->functions[0].code;
+    pyco_uint32 instruction;
+    pyco_uint32 status = PYCO_VM_OK;
+
+#if PYCO_VM_THREADED
+    PYCO_VM_NEXT();
+#else
+dispatch:
+    instruction = *ip++;
+
+    switch (PYCO_INSTRUCTION_OP(instruction))
+    {
+#endif
+
+    PYCO_VM_CASE(PYCO_OP_NOP)
+    {
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_MOVE)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = base[PYCO_INSTRUCTION_B(instruction)];
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LOAD_NIL)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){PYCO_VALUE_NIL};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LOAD_INT)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = PYCO_INSTRUCTION_SBX(instruction)};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LOAD_CONST)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = constants[PYCO_INSTRUCTION_BX(instruction)];
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LOAD_FUNCTION)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_FUNCTION, .as.index = PYCO_INSTRUCTION_BX(instruction)};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LOAD_STRUCT)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_STRUCT, .as.index = PYCO_INSTRUCTION_BX(instruction)};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_GET_GLOBAL)
+    {
+        base[PYCO_INSTRUCTION_A(instruction)] = globals[PYCO_INSTRUCTION_BX(instruction)];
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_SET_GLOBAL)
+    {
+        globals[PYCO_INSTRUCTION_BX(instruction)] = base[PYCO_INSTRUCTION_A(instruction)];
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_ADD)
+    PYCO_VM_ARITHMETIC(+)
+
+    PYCO_VM_CASE(PYCO_OP_SUBTRACT)
+    PYCO_VM_ARITHMETIC(-)
+
+    PYCO_VM_CASE(PYCO_OP_MULTIPLY)
+    PYCO_VM_ARITHMETIC(*)
+
+    PYCO_VM_CASE(PYCO_OP_DIVIDE)
+    {
+        const pyco_value *left = &base[PYCO_INSTRUCTION_B(instruction)];
+        const pyco_value *right = &base[PYCO_INSTRUCTION_C(instruction)];
+        double x;
+        double y;
+
+        if (left->type == PYCO_VALUE_INTEGER && right->type == PYCO_VALUE_INTEGER)
+        {
+            if (!right->as.integer)
+            {
+                PYCO_VM_FAIL(PYCO_VM_DIVISION_BY_ZERO);
+            }
+
+            // the smallest integer divided by -1 does not fit, it wraps around like the other operations
+            const long long value = right->as.integer == -1 ? (long long)(0ull - (unsigned long long)left->as.integer) : left->as.integer / right->as.integer;
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = value};
+        }
+        else if (_vm_number(left, &x) && _vm_number(right, &y))
+        {
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_REAL, .as.real = x / y};
+        }
+        else
+        {
+            PYCO_VM_FAIL(PYCO_VM_TYPE_ERROR);
+        }
+
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_ADD_INT)
+    {
+        const pyco_value *left = &base[PYCO_INSTRUCTION_B(instruction)];
+
+        if (left->type == PYCO_VALUE_INTEGER)
+        {
+            const unsigned long long value = (unsigned long long)left->as.integer + (unsigned long long)(long long)PYCO_INSTRUCTION_SC(instruction);
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = (long long)value};
+        }
+        else if (left->type == PYCO_VALUE_REAL)
+        {
+            base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_REAL, .as.real = left->as.real + PYCO_INSTRUCTION_SC(instruction)};
+        }
+        else
+        {
+            PYCO_VM_FAIL(PYCO_VM_TYPE_ERROR);
+        }
+
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_EQUAL)
+    {
+        const bool value = _vm_equal(&base[PYCO_INSTRUCTION_B(instruction)], &base[PYCO_INSTRUCTION_C(instruction)]);
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = value};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_LESS)
+    PYCO_VM_COMPARE(<)
+
+    PYCO_VM_CASE(PYCO_OP_LESS_EQUAL)
+    PYCO_VM_COMPARE(<=)
+
+    PYCO_VM_CASE(PYCO_OP_NOT)
+    {
+        const bool value = !_vm_truthy(&base[PYCO_INSTRUCTION_B(instruction)]);
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = value};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_BITWISE_NOT)
+    {
+        const pyco_value *value = &base[PYCO_INSTRUCTION_B(instruction)];
+
+        if (value->type != PYCO_VALUE_INTEGER)
+        {
+            PYCO_VM_FAIL(PYCO_VM_TYPE_ERROR);
+        }
+
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = ~value->as.integer};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_JUMP)
+    {
+        ip += PYCO_INSTRUCTION_SBX(instruction);
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_JUMP_IF)
+    {
+        if (_vm_truthy(&base[PYCO_INSTRUCTION_A(instruction)]))
+        {
+            ip += PYCO_INSTRUCTION_SBX(instruction);
+        }
+
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_JUMP_IF_NOT)
+    {
+        if (!_vm_truthy(&base[PYCO_INSTRUCTION_A(instruction)]))
+        {
+            ip += PYCO_INSTRUCTION_SBX(instruction);
+        }
+
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_NEW_ARRAY)
+    {
+        pyco_array *array = _vm_new_array(vm, &base[PYCO_INSTRUCTION_B(instruction)], PYCO_INSTRUCTION_C(instruction), &status);
+
+        if (!array)
+        {
+            goto done;
+        }
+
+        base[PYCO_INSTRUCTION_A(instruction)] = (pyco_value){.type = PYCO_VALUE_ARRAY, .as.array = array};
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_GET_INDEX)
+    {
+        const pyco_value *container = &base[PYCO_INSTRUCTION_B(instruction)];
+        const pyco_value *key = &base[PYCO_INSTRUCTION_C(instruction)];
+        const pyco_value *element;
+
+        // arrays indexed by integers are what loops do, they skip the call
+        if (container->type == PYCO_VALUE_ARRAY && key->type == PYCO_VALUE_INTEGER && (pyco_uint64)key->as.integer < container->as.array->count)
+        {
+            element = &container->as.array->elements[key->as.integer];
+        }
+        else if (!(element = _vm_element(vm, container, key, &status)))
+        {
+            goto done;
+        }
+
+        base[PYCO_INSTRUCTION_A(instruction)] = *element;
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_SET_INDEX)
+    {
+        const pyco_value *container = &base[PYCO_INSTRUCTION_A(instruction)];
+        const pyco_value *key = &base[PYCO_INSTRUCTION_B(instruction)];
+        pyco_value *element;
+
+        if (container->type == PYCO_VALUE_ARRAY && key->type == PYCO_VALUE_INTEGER && (pyco_uint64)key->as.integer < container->as.array->count)
+        {
+            element = &container->as.array->elements[key->as.integer];
+        }
+        else if (!(element = _vm_element(vm, container, key, &status)))
+        {
+            goto done;
+        }
+
+        *element = base[PYCO_INSTRUCTION_C(instruction)];
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_CALL)
+    {
+        pyco_value *callee = &base[PYCO_INSTRUCTION_A(instruction)];
+        const pyco_uint32 arguments_count = PYCO_INSTRUCTION_B(instruction);
+
+        // the host can set an extern to a function or struct value with any index
+        if (callee->type == PYCO_VALUE_FUNCTION && callee->as.index < vm->header->functions_count)
+        {
+            const pyco_bytecode_function *function = &vm->functions[callee->as.index];
+            pyco_value *callee_base = callee + 1;
+
+            if (callee_base + function->registers > vm->stack_end || frame + 1 == vm->frames_end)
+            {
+                PYCO_VM_FAIL(PYCO_VM_STACK_OVERFLOW);
+            }
+
+            // missing arguments and every register past the parameters start out nil
+            for (pyco_uint32 i = arguments_count < function->arity ? arguments_count : function->arity; i < function->registers; i++)
+            {
+                callee_base[i] = (pyco_value){PYCO_VALUE_NIL};
+            }
+
+            frame++;
+            frame->ip = ip;
+            frame->base = base;
+            base = callee_base;
+            ip = code + function->code;
+        }
+        else if (callee->type == PYCO_VALUE_STRUCT && callee->as.index < vm->header->structs_count)
+        {
+            pyco_object *object = _vm_new_object(vm, callee->as.index, callee + 1, arguments_count);
+
+            if (!object)
+            {
+                PYCO_VM_FAIL(PYCO_VM_OUT_OF_MEMORY);
+            }
+
+            *callee = (pyco_value){.type = PYCO_VALUE_OBJECT, .as.object = object};
+        }
+        else if (callee->type == PYCO_VALUE_NATIVE)
+        {
+            *callee = callee->as.native->function(callee->as.native->context, callee + 1, arguments_count);
+        }
+        else
+        {
+            PYCO_VM_FAIL(PYCO_VM_NOT_CALLABLE);
+        }
+
+        PYCO_VM_NEXT();
+    }
+
+    PYCO_VM_CASE(PYCO_OP_RETURN)
+    {
+        const pyco_value value = PYCO_INSTRUCTION_B(instruction) ? base[PYCO_INSTRUCTION_A(instruction)] : (pyco_value){PYCO_VALUE_NIL};
+
+        if (frame == vm->frames)
+        {
+            *result = value;
+            goto done;
+        }
+
+        // the register the callee was in
+        base[-1] = value;
+        base = frame->base;
+        ip = frame->ip;
+        frame--;
+        PYCO_VM_NEXT();
+    }
+
+#if !PYCO_VM_THREADED
+    default:
+        PYCO_VM_FAIL(PYCO_VM_INVALID_PROGRAM);
+    }
+#endif
+
+done:
+    return status;
+}
+
+#undef PYCO_VM_ARITHMETIC
+#undef PYCO_VM_COMPARE
+#undef PYCO_VM_FAIL
+#undef PYCO_VM_CASE
+#undef PYCO_VM_NEXT
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef PYCO_VM_H
+#define PYCO_VM_H
+
+#include "pyco_bytecode.h"
+
+// computed goto threads the dispatch, every instruction jumps straight to the next one's handler. compilers without
+// labels as values only have the switch, define PYCO_VM_COMPUTED_GOTO as 0 to leave it out on the others as well
+#ifndef PYCO_VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define PYCO_VM_COMPUTED_GOTO 1
+#else
+#define PYCO_VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+enum PYCO_VALUE_TYPE
+{
+    PYCO_VALUE_NIL = 0,
+    PYCO_VALUE_INTEGER,
+    PYCO_VALUE_REAL,
+    PYCO_VALUE_STRING, // points into the program, length bytes
+    PYCO_VALUE_FUNCTION,
+    PYCO_VALUE_STRUCT,
+    PYCO_VALUE_ARRAY,
+    PYCO_VALUE_OBJECT, // a value of a struct
+    PYCO_VALUE_NATIVE, // a function of the host
+};
+
+typedef struct pyco_vm pyco_vm;
+typedef struct pyco_value pyco_value;
+
+typedef struct pyco_array pyco_array;
+typedef struct pyco_object pyco_object;
+
+// called for a native value, the result goes where the script called it
+typedef pyco_value (*PYCO_FUNC_NATIVE)(void *context, const pyco_value *arguments, pyco_uint32 arguments_count);
+
+typedef struct pyco_native
+{
+    PYCO_FUNC_NATIVE function;
+    void *context;
+} pyco_native;
+
+struct pyco_value
+{
+    pyco_uint32 type;
+    pyco_uint32 length; // bytes of a string
+    union
+    {
+        long long integer;
+        double real;
+        const pyco_uint8 *string;
+        pyco_uint32 index; // function or struct
+        pyco_array *array;
+        pyco_object *object;
+        const pyco_native *native;
+    } as;
+};
+
+struct pyco_array
+{
+    pyco_array *next; // every array and object the VM made, freed together
+    pyco_uint64 count;
+    pyco_value elements[];
+};
+
+struct pyco_object
+{
+    pyco_object *next;
+    pyco_uint32 type; // struct index
+    pyco_uint32 count;
+    pyco_value fields[];
+};
+
+enum PYCO_VM_DISPATCH
+{
+    PYCO_VM_DISPATCH_DEFAULT = 0, // threaded when it was compiled in
+    PYCO_VM_DISPATCH_SWITCH,
+    PYCO_VM_DISPATCH_THREADED,
+};
+
+enum PYCO_VM_STATUS
+{
+    PYCO_VM_OK = 0,
+    PYCO_VM_INVALID_PROGRAM, // the program failed to load, or none was
+    PYCO_VM_TYPE_ERROR,
+    PYCO_VM_DIVISION_BY_ZERO,
+    PYCO_VM_INDEX_OUT_OF_RANGE,
+    PYCO_VM_NOT_CALLABLE,
+    PYCO_VM_STACK_OVERFLOW,
+    PYCO_VM_OUT_OF_MEMORY,
+};
+
+typedef struct pyco_vm_options
+{
+    pyco_allocators allocators;
+    pyco_uint32 stack_size;  // values shared by the registers of all running functions, 0 picks 65536
+    pyco_uint32 frames_size; // deepest call nesting, 0 picks 1024
+    pyco_uint32 dispatch;
+} pyco_vm_options;
+
+pyco_vm_options pyco_vm_initialize_options();
+
+// the value stack and call frames are allocated here once, calling and returning never allocates
+pyco_vm *pyco_vm_create(pyco_vm_options options);
+
+// checks the whole program before it can run, so running it checks only what depends on the values. the program
+// is not copied and has to outlive the VM or the next load, PYCO_VM_OK or PYCO_VM_INVALID_PROGRAM
+pyco_uint32 pyco_vm_load(pyco_vm *vm, const pyco_uint8 *data, pyco_uint64 size);
+
+// sets a global the script uses without declaring it, false when the script has no such global
+pyco_uint32 pyco_vm_set_global(pyco_vm *vm, const char *name, pyco_value value);
+
+pyco_value pyco_vm_native(const pyco_native *native);
+
+// runs the script from the start with the globals it declares set back to nil, result is what it returned.
+// the arrays and objects of the last run are freed first, arrays and objects are not reference counted yet
+pyco_uint32 pyco_vm_run(pyco_vm *vm, pyco_value *result);
+
+// frees the arrays and objects of the last run
+void pyco_vm_reset(pyco_vm *vm);
+
+void pyco_vm_free(pyco_vm *vm);
+
+#endif
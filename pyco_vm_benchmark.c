@@ -0,0 +1,181 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pyco_vm.h"
+
+// compares the dispatch modes of the VM on loop-heavy scripts, each one runs a few times in every mode and the
+// fastest run counts. pass a number to scale the iterations
+
+#define PYCO_BENCHMARK_RUNS 5
+
+typedef struct pyco_benchmark
+{
+    const char *name;
+    const char *source;
+} pyco_benchmark;
+
+// rounds comes from the host so the compiler cannot see through the loops
+static const pyco_benchmark benchmarks[] = {
+    {"grid", "\n\
+        grid := [100][100]int32\n\
+        total := 0\n\
+        for r := 0; r < rounds; r++ {\n\
+            for i := 0; i < 100; i++ {\n\
+                for j := 0; j < 100; j++ {\n\
+                    grid[i][j] = i + j\n\
+                }\n\
+            }\n\
+            for i := 0; i < 100; i++ {\n\
+                for j := 0; j < 100; j++ {\n\
+                    total += grid[i][j]\n\
+                }\n\
+            }\n\
+        }\n\
+        return total\n\
+        "},
+    {"calls", "\n\
+        add :: function(a, b) => a + b\n\
+        sum :: function(n) {\n\
+            total := 0\n\
+            for i := 0; i < n; i++ {\n\
+                total = add(total, i)\n\
+            }\n\
+            return total\n\
+        }\n\
+        return sum(rounds * 10000)\n\
+        "},
+    {"fibonacci", "\n\
+        fibonacci :: function(n) {\n\
+            if n < 2 {\n\
+                return n\n\
+            }\n\
+            return fibonacci(n - 1) + fibonacci(n - 2)\n\
+        }\n\
+        total := 0\n\
+        i := 0\n\
+        while i < rounds {\n\
+            total += fibonacci(15)\n\
+            i++\n\
+        }\n\
+        return total\n\
+        "},
+};
+
+static const char *dispatch_names[] = {"default", "switch", "threaded"};
+
+static unsigned long long _benchmark_nanoseconds()
+{
+    struct timespec time;
+
+#if defined(_WIN32)
+    timespec_get(&time, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &time);
+#endif
+
+    return (unsigned long long)time.tv_sec * 1000000000ull + (unsigned long long)time.tv_nsec;
+}
+
+// the fastest of a few runs, 0 when the script failed
+static unsigned long long _benchmark_run(const pyco_compiled_program *program, pyco_uint32 dispatch, long long rounds, pyco_value *result)
+{
+    pyco_vm_options options = pyco_vm_initialize_options();
+    options.dispatch = dispatch;
+
+    pyco_vm *vm = pyco_vm_create(options);
+    unsigned long long best = 0;
+
+    if (!vm || pyco_vm_load(vm, program->data, program->size) != PYCO_VM_OK)
+    {
+        pyco_vm_free(vm);
+        return 0;
+    }
+
+    for (int run = 0; run < PYCO_BENCHMARK_RUNS; run++)
+    {
+        pyco_vm_set_global(vm, "rounds", (pyco_value){.type = PYCO_VALUE_INTEGER, .as.integer = rounds});
+
+        const unsigned long long start = _benchmark_nanoseconds();
+        const pyco_uint32 status = pyco_vm_run(vm, result);
+        const unsigned long long elapsed = _benchmark_nanoseconds() - start;
+
+        if (status != PYCO_VM_OK)
+        {
+            printf("  %s failed with status %u\n", dispatch_names[dispatch], status);
+            best = 0;
+            break;
+        }
+
+        if (!best || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    pyco_vm_free(vm);
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const long long rounds = argc > 1 ? atoll(argv[1]) : 100;
+    int failed = 0;
+
+    printf("%-10s %12s %12s %8s %s\n", "script", "switch ms", "threaded ms", "speedup", "result");
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        pyco_compile_options compile_options = pyco_initialize_compile_options();
+        compile_options.allocators = pyco_default_allocators();
+
+        pyco_compiled_program program = pyco_compile((const pyco_uint8 *)benchmarks[i].source, strlen(benchmarks[i].source), compile_options);
+
+        if (!program.data)
+        {
+            printf("%-10s does not compile, %u errors\n", benchmarks[i].name, program.errors);
+            pyco_free_compiled_program(&program);
+            failed = 1;
+            continue;
+        }
+
+        pyco_value switch_result;
+        pyco_value threaded_result;
+        const unsigned long long switch_time = _benchmark_run(&program, PYCO_VM_DISPATCH_SWITCH, rounds, &switch_result);
+
+#if PYCO_VM_COMPUTED_GOTO
+        const unsigned long long threaded_time = _benchmark_run(&program, PYCO_VM_DISPATCH_THREADED, rounds, &threaded_result);
+#else
+        const unsigned long long threaded_time = 0;
+        threaded_result = switch_result;
+#endif
+
+        if (!switch_time || (PYCO_VM_COMPUTED_GOTO && !threaded_time))
+        {
+            failed = 1;
+        }
+        else if (switch_result.type != threaded_result.type || switch_result.as.integer != threaded_result.as.integer)
+        {
+            printf("%-10s the dispatch modes disagree\n", benchmarks[i].name);
+            failed = 1;
+        }
+        else if (threaded_time)
+        {
+            printf("%-10s %12.3f %12.3f %7.2fx %lld\n", benchmarks[i].name, switch_time / 1e6, threaded_time / 1e6,
+                   (double)switch_time / (double)threaded_time, switch_result.as.integer);
+        }
+        else
+        {
+            printf("%-10s %12.3f %12s %8s %lld\n", benchmarks[i].name, switch_time / 1e6, "-", "-", switch_result.as.integer);
+        }
+
+        pyco_free_compiled_program(&program);
+    }
+
+    return failed;
+}